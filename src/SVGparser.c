@@ -54,10 +54,18 @@
  * one coordinate such as these cannot be rotated. These elements are represented  
  * internally by a LINETO with two coordinates. A similar problem occurs with ARCTO 
  * commands. To rotate an ARCTO command the rotation angle is added to the angle of the
- * ARCTO, while the last point is multipled by the matrix.
+ * ARCTO, while the last point is multipled by the matrix. Other transformations (non
+ * uniform scales, skews, reflections) give the radii and the angle of the transformed
+ * ellipse (see transformArc).
  * 
  * The function getRotationAngleFromMatrix can be used to get this angle from the matrix.
  *
+ * The parser works in double precision, but each subpath is stored either in float
+ * or in double precision. By default double precision is only used for subpaths with
+ * coordinates too large to keep 3 digits after the decimal point in a float (see
+ * DOUBLE_THRESHOLD), which is typical of GIS and CAD exports. Parameters -f and -d
+ * force float or double precision for all subpaths.
+ *
  * Finally, command line parameters were implemented to supply a matrix (-m) or to
  * instruct the parser to generate relative coordinates (-r) instead of the default 
  * absolute coordinates (the internal representation), as well as a path to be parsed.
@@ -71,19 +79,49 @@
 #define NULL 0
 #endif
 
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L   // needed by clock_gettime with -std=c99
+#endif
+
 #include <string.h>
 #include <stdio.h>
+#include <stdarg.h>
 #include <stdlib.h>
 #include <math.h>
 #include <stdint.h>
 #include <float.h>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#endif
+#ifdef __linux__
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#endif
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
 
 //#define DEBUG       // when defined it print traces
 //#define VERBOSE   // when not defined it uses only 3 digits after the decimal point
 #define NSVG_INLINE inline
 
 #define NSVG_EPSILON (1e-12)
-#define NSVG_PI (3.14159265358979323846264338327f)
+#define NSVG_PI (3.14159265358979323846264338327)
 
 /* Internal codes for commands - they hide the number of arguments in the 2nd byte*/
 #define LINETO      (2 << 8)
@@ -97,7 +135,7 @@
 // macro to convert a float pointer to a 32 bits integer pointer
 #define command(p) ((int32_t *)(p))       
 // macro to round and trucate at 3 digits after the decimal point 
-#define dig3(n) (roundf((n)*1000.0f)/1000.0f)
+#define dig3(n) (round((n)*1000.0)/1000.0 + 0.0)   // + 0.0: no negative zeros
 
 #ifdef VERBOSE
 #define trnc(a) (a)
@@ -112,27 +150,38 @@ char *v_format = "v%f";
 char *pt_format = "%f,%f ";
 char *last_pt  = "%f,%f";
 char *a_format = "%f,%f %f %f %f %f,%f";
+char *n_format = "%f";
 #else
 #define trnc(a) dig3(a)
-char *M_format = "M%g,%g";
-char *L_format = "L%g,%g";
-char *H_format = "H%g";
-char *V_format = "V%g";
-char *m_format = "m%g,%g";
-char *l_format = "l%g,%g";
-char *h_format = "h%g";
-char *v_format = "v%g";
-char *pt_format = "%g,%g ";
-char *last_pt  = "%g,%g";
-char *a_format = "%g,%g %g %g %g %g,%g";
+char *M_format = "M%.15g,%.15g";
+char *L_format = "L%.15g,%.15g";
+char *H_format = "H%.15g";
+char *V_format = "V%.15g";
+char *m_format = "m%.15g,%.15g";
+char *l_format = "l%.15g,%.15g";
+char *h_format = "h%.15g";
+char *v_format = "v%.15g";
+char *pt_format = "%.15g,%.15g ";
+char *last_pt  = "%.15g,%.15g";
+char *a_format = "%.15g,%.15g %.15g %.15g %.15g %.15g,%.15g";
+char *n_format = "%.15g";
 #endif
 
 #define ITEM_SIZE 64
 
+// precision of the elements of an SVGpath
+#define PRECISION_FLOAT  0
+#define PRECISION_DOUBLE 1
+#define PRECISION_AUTO   2   // parser only: double only for subpaths reaching DOUBLE_THRESHOLD
+
+// From 8192 on, consecutive floats are almost 0.001 apart, which is the resolution
+// of the generated numbers. Subpaths with larger coordinates are stored in doubles.
+#define DOUBLE_THRESHOLD 8192.0
+
 /* Types */
 
-//  SVGpath is the node of a linked list of subpaths that are part of the same path.
-//  The subpath corresponding to this node is stored in the array of float elements.
+//  SVGpath describes one of the subpaths that are part of the same path, kept in the
+//  table of an SVGpaths. The subpath is stored in its array of float elements.
 //    These elements are either point coordinates, either a command represented by a
 //  32 bits integer, either other parameters of an arcto command. The size of this 
 //  array is stored in variable size. Elements are to be treated in groups strting
@@ -152,22 +201,69 @@ char *a_format = "%g,%g %g %g %g %g,%g";
 //  |  ARCTO               |   rx, ry, angle, 1.0/0.0, 1.0/0.0, x, y  |      A      |
 //  +----------------------+------------------------------------------+-------------+
 //
+//  The elements are either floats or doubles according to precision. They should be
+//  read with the macros pathElement and pathCommand, which work with both.
+//
 typedef struct SVGpath {
-    float* elements;        // elements array (see description above)
+    void* elements;         // elements array of floats or doubles (see description above)
+    size_t offset;          // offset of elements in the buffer of the table, in bytes
     int size;               // Total number elenyss.
     char closed;            // Flag indicating if shapes should be treated as closed.
-    struct SVGpath* next;   // Pointer to next path, or NULL if last element.
+    char precision;         // PRECISION_FLOAT or PRECISION_DOUBLE, the type of elements
+    double bounds[4];       // [xmin, ymin, xmax, ymax] of all points, control points included
+    struct SVGlengthIndex* lengths; // arc length index, built on the first length query
 } SVGpath;
 
-// Data Structure used by the parser - plist is the linked list of all parsed subpaths
+//  Source text of the number giving an element, when it is parsed with an identity
+//  matrix: the element is base plus the number, base being 0 for absolute arguments
+//  and the current point for relative ones. Computed elements have no start.
+typedef struct SVGlexeme {
+    const char* start;      // first character of the number in the path data, or NULL
+    int length;             // number of characters of the number
+    double base;            // value the number is relative to
+} SVGlexeme;
+
+//  SVGpaths is the table of the subpaths of a path, in the order of the source. The
+//  SVGpaths are contiguous, so that the nth subpath is paths[n], and their elements
+//  follow each other in a single buffer, each array aligned on a double. When the
+//  buffer grows, the elements of the subpaths are relocated from their offsets.
+typedef struct SVGpaths {
+    SVGpath* paths;         // descriptors of the subpaths
+    int npaths;             // number of subpaths
+    int capacity;           // capacity of paths
+    char* buffer;           // elements of all the subpaths
+    size_t used;            // bytes used in buffer
+    size_t allocated;       // bytes allocated for buffer
+    SVGlexeme* lexemes;     // lexemes of the elements in double precision, indexed like
+                            // the doubles of buffer, or NULL if they are not recorded
+    size_t nlexemes;        // capacity of lexemes
+} SVGpaths;
+
+//  Bounds of the loops on the subpaths of a table, which may be NULL when nothing has
+//  been parsed:  for (p = firstPath(plist); p != endPath(plist); p++)
+#define firstPath(plist) ((plist) ? (plist)->paths : NULL)
+#define endPath(plist)   ((plist) ? (plist)->paths + (plist)->npaths : NULL)
+
+static void deleteLengthIndex(struct SVGlengthIndex* index);
+
+// macros to read element i of an SVGpath as a double or as a command, whatever its precision
+#define pathElement(path,i) ((path)->precision ? ((double*)(path)->elements)[i] \
+                                               : (double)((float*)(path)->elements)[i])
+#define pathCommand(path,i) ((path)->precision ? *command((double*)(path)->elements+(i)) \
+                                               : *command((float*)(path)->elements+(i)))
+
+// Data Structure used by the parser - plist is the table of all parsed subpaths
 typedef struct SVGPathparser {
-    float* matrix;          // tranformation matrix, systematically multiplied by every pt
-    float* elements;        // elements Arraylist (parsed commands are temporarily stored here)
+    double* matrix;         // tranformation matrix, systematically multiplied by every pt
+    double* elements;       // elements Arraylist (parsed commands are temporarily stored here)
     int size;               // size of space used in Arraylist
     int capacity;           // capacity of elements Arraylist (increases when needed)
-    float angle;            // angle corresponding to the rotation in the matrix
-    SVGpath* plist;         // once parsed, elements are copied to elements in a new SVGpath
-                            // which becomes head of this linked list
+    double angle;           // angle corresponding to the rotation in the matrix
+    int precision;          // PRECISION_FLOAT, PRECISION_DOUBLE or PRECISION_AUTO for new SVGpaths
+    SVGpaths* plist;        // once parsed, elements are copied to a new SVGpath appended
+                            // to this table, created by the first subpath
+    int passthrough;        // flag to record the lexemes of the elements
+    SVGlexeme* lexemes;     // lexemes of the elements, with the same capacity
 } SVGPathparser;
 
 // Table to be indexed like sz[c-'A'], where c is any letter in the alphabet. sz[c-'A'] either 
@@ -188,8 +284,8 @@ static char relative[NCOMMANDS] = { 'l', 't', 'q', 's', 'c', 'a' };
 
 /* Generic functions  */
 
-static float sqr(float x) { return x*x; }
-static float norm(float x, float y) { return sqrtf(x*x + y*y); }
+static double sqr(double x) { return x*x; }
+static double norm(double x, double y) { return sqrt(x*x + y*y); }
 static double bezierCoordinate(double t, double p0, double p1, double p2, double p3) {
     double it = 1.0-t;
     return it*it*it*p0 + 3.0*it*it*t*p1 + 3.0*it*t*t*p2 + t*t*t*p3;
@@ -300,60 +396,60 @@ static char* parseNumber(char* s, char* it, const int size)
     return s;
 }
 
-static void copyMatrix(float* t, float* m) {
+static void copyMatrix(double* t, double* m) {
     t[0] = m[0]; t[1] = m[1];
     t[2] = m[2]; t[3] = m[3];
     t[4] = m[4]; t[5] = m[5];
 }
 
-static void identityMatrix(float* t) {
-    t[0] = 1.0f; t[1] = 0.0f;
-    t[2] = 0.0f; t[3] = 1.0f;
-    t[4] = 0.0f; t[5] = 0.0f;
+static void identityMatrix(double* t) {
+    t[0] = 1.0; t[1] = 0.0;
+    t[2] = 0.0; t[3] = 1.0;
+    t[4] = 0.0; t[5] = 0.0;
 }
 
-static void setTranslationInMatrix(float* t, float tx, float ty) {
-    t[0] = 1.0f; t[1] = 0.0f;
-    t[2] = 0.0f; t[3] = 1.0f;
+static void setTranslationInMatrix(double* t, double tx, double ty) {
+    t[0] = 1.0; t[1] = 0.0;
+    t[2] = 0.0; t[3] = 1.0;
     t[4] = tx; t[5] = ty;
 }
 
-static void setScaleInMatrix(float* t, float sx, float sy){
-    t[0] = sx; t[1] = 0.0f;
-    t[2] = 0.0f; t[3] = sy;
-    t[4] = 0.0f; t[5] = 0.0f;
+static void setScaleInMatrix(double* t, double sx, double sy){
+    t[0] = sx; t[1] = 0.0;
+    t[2] = 0.0; t[3] = sy;
+    t[4] = 0.0; t[5] = 0.0;
 }
 
-static void setSkewXInMatrix(float* t, float a){
-    t[0] = 1.0f; t[1] = 0.0f;
-    t[2] = tanf(a); t[3] = 1.0f;
-    t[4] = 0.0f; t[5] = 0.0f;
+static void setSkewXInMatrix(double* t, double a){
+    t[0] = 1.0; t[1] = 0.0;
+    t[2] = tan(a); t[3] = 1.0;
+    t[4] = 0.0; t[5] = 0.0;
 }
 
-static void setSkewYInMatrix(float* t, float a){
-    t[0] = 1.0f; t[1] = tanf(a);
-    t[2] = 0.0f; t[3] = 1.0f;
-    t[4] = 0.0f; t[5] = 0.0f;
+static void setSkewYInMatrix(double* t, double a){
+    t[0] = 1.0; t[1] = tan(a);
+    t[2] = 0.0; t[3] = 1.0;
+    t[4] = 0.0; t[5] = 0.0;
 }
 
-static void setRotation(float*t, float cs, float sn) {
+static void setRotation(double*t, double cs, double sn) {
     t[0] = cs; t[1] = sn;
     t[2] = -sn; t[3] = cs;
-    t[4] = 0.0f; t[5] = 0.0f;
+    t[4] = 0.0; t[5] = 0.0;
 }
 
-static void setRotationInMatrix(float* t, float a){
-    if (a == 0.0f) { identityMatrix(t); return; }
-    if (a == 90.0f) { setRotation(t, 0.0f, 1.0f); return; }
-    if (a == 180.0f) { setRotation(t, -1.0f, 0.0f); return; }
-    if (a == 270.0f) { setRotation(t, 0.0f, -1.0f); return; }
-    setRotation(t, cosf(a), sinf(a));
+static void setRotationInMatrix(double* t, double a){
+    if (a == 0.0) { identityMatrix(t); return; }
+    if (a == 90.0) { setRotation(t, 0.0, 1.0); return; }
+    if (a == 180.0) { setRotation(t, -1.0, 0.0); return; }
+    if (a == 270.0) { setRotation(t, 0.0, -1.0); return; }
+    setRotation(t, cos(a), sin(a));
 }
 
-static void matrixMultiply(float* t, float* s){
-    float t0 = t[0] * s[0] + t[1] * s[2];
-    float t2 = t[2] * s[0] + t[3] * s[2];
-    float t4 = t[4] * s[0] + t[5] * s[2] + s[4];
+static void matrixMultiply(double* t, double* s){
+    double t0 = t[0] * s[0] + t[1] * s[2];
+    double t2 = t[2] * s[0] + t[3] * s[2];
+    double t4 = t[4] * s[0] + t[5] * s[2] + s[4];
     t[1] = t[0] * s[1] + t[1] * s[3];
     t[3] = t[2] * s[1] + t[3] * s[3];
     t[5] = t[4] * s[1] + t[5] * s[3] + s[5];
@@ -362,46 +458,46 @@ static void matrixMultiply(float* t, float* s){
     t[4] = t4;
 }
 
-static void matrixInverse(float* inv, float* t){
-    double invdet, det = (double)t[0] * t[3] - (double)t[2] * t[1];
+static void matrixInverse(double* inv, double* t){
+    double invdet, det = t[0] * t[3] - t[2] * t[1];
     if (det > -1e-6 && det < 1e-6) {
         identityMatrix(t);
         return;
     }
     invdet = 1.0 / det;
-    inv[0] = (float)(t[3] * invdet);
-    inv[2] = (float)(-t[2] * invdet);
-    inv[4] = (float)(((double)t[2] * t[5] - (double)t[3] * t[4]) * invdet);
-    inv[1] = (float)(-t[1] * invdet);
-    inv[3] = (float)(t[0] * invdet);
-    inv[5] = (float)(((double)t[1] * t[4] - (double)t[0] * t[5]) * invdet);
+    inv[0] = t[3] * invdet;
+    inv[2] = -t[2] * invdet;
+    inv[4] = (t[2] * t[5] - t[3] * t[4]) * invdet;
+    inv[1] = -t[1] * invdet;
+    inv[3] = t[0] * invdet;
+    inv[5] = (t[1] * t[4] - t[0] * t[5]) * invdet;
 }
 
-static void matrixPremultiply(float* t, float* s){
-    float s2[6];
-    memcpy(s2, s, sizeof(float)*6);
+static void matrixPremultiply(double* t, double* s){
+    double s2[6];
+    memcpy(s2, s, sizeof(double)*6);
     matrixMultiply(s2, t);
-    memcpy(t, s2, sizeof(float)*6);
+    memcpy(t, s2, sizeof(double)*6);
 }
 
-static void pointMatrixMultiply(float* dx, float* dy, float x, float y, float* t){
+static void pointMatrixMultiply(double* dx, double* dy, double x, double y, double* t){
     *dx = x*t[0] + y*t[2] + t[4];
     *dy = x*t[1] + y*t[3] + t[5];
 }
 
-static void vectorMatrixMultiply(float* dx, float* dy, float x, float y, float* t) {
+static void vectorMatrixMultiply(double* dx, double* dy, double x, double y, double* t) {
     *dx = x*t[0] + y*t[2];
     *dy = x*t[1] + y*t[3];
 }
 
-static float getRotationAngleFromMatrix(float* t) {
-    return(atan2(t[1], t[0])*180.0f/NSVG_PI);
+static double getRotationAngleFromMatrix(double* t) {
+    return(atan2(t[1], t[0])*180.0/NSVG_PI);
 }
 
 /* end generic fuctions */
 
-static NSVG_INLINE float nsvg__minf(float a, float b) { return a < b ? a : b; }
-static NSVG_INLINE float nsvg__maxf(float a, float b) { return a > b ? a : b; }
+static NSVG_INLINE double nsvg__minf(double a, double b) { return a < b ? a : b; }
+static NSVG_INLINE double nsvg__maxf(double a, double b) { return a > b ? a : b; }
 
 /* parser functions */
 
@@ -432,15 +528,20 @@ static int numberOfArguments(int cmd){
 }
 
 
-static float* guarantee_capacity(SVGPathparser* p, int n){
-    if (p->size+n > p->capacity) {
-        p->capacity = p->capacity ? (p->capacity<<1) : 32;
-        p->elements = (float*)realloc(p->elements, p->capacity*sizeof(float));
+static double* guarantee_capacity(SVGPathparser* p, int n){
+    if (p->size+n > p->capacity || (p->passthrough && p->lexemes == NULL)) {
+        if (p->size+n > p->capacity)
+            p->capacity = p->capacity ? (p->capacity<<1) : 32;
+        p->elements = (double*)realloc(p->elements, p->capacity*sizeof(double));
+        if (p->passthrough) {
+            p->lexemes = (SVGlexeme*)realloc(p->lexemes, p->capacity*sizeof(SVGlexeme));
+            if (p->lexemes == NULL) return NULL;
+        }
     }
     return p->elements;
 }
 
-static void moveto(SVGPathparser* p, float x, float y){
+static void moveto(SVGPathparser* p, double x, double y){
     if (p->size > 0) {
         printf("**Error: unexpected moveTo with size of elements not zero\n");
         exit(1);
@@ -452,7 +553,7 @@ static void moveto(SVGPathparser* p, float x, float y){
 }
 
 
-static void lineto(SVGPathparser* p, float x, float y) {
+static void lineto(SVGPathparser* p, double x, double y) {
     if (p->size > 0) {
         if (!guarantee_capacity(p,3)) return;
         *command(p->elements+p->size) = LINETO;
@@ -462,7 +563,7 @@ static void lineto(SVGPathparser* p, float x, float y) {
     }
 }
 
-static void curveto(SVGPathparser* p, float cpx1, float cpy1, float cpx2, float cpy2, float x, float y) {
+static void curveto(SVGPathparser* p, double cpx1, double cpy1, double cpx2, double cpy2, double x, double y) {
     if (p->size > 0) {
         if (!guarantee_capacity(p,7)) return;
         *command(p->elements+p->size) = CURVETO;
@@ -479,7 +580,7 @@ static void curveto(SVGPathparser* p, float cpx1, float cpy1, float cpx2, float
     }
 }
 
-static void scurveto(SVGPathparser* p, float cpx2, float cpy2, float x, float y) {
+static void scurveto(SVGPathparser* p, double cpx2, double cpy2, double x, double y) {
     if (p->size > 0) {
         if (!guarantee_capacity(p,5)) return;
         *command(p->elements+p->size) = SCURVETO;
@@ -494,9 +595,8 @@ static void scurveto(SVGPathparser* p, float cpx2, float cpy2, float x, float y)
     }
 }
 
-static void quadto(SVGPathparser* p, float cpx, float cpy, float x, float y) {
+static void quadto(SVGPathparser* p, double cpx, double cpy, double x, double y) {
     if (p->size > 0) {
-        printf("quadto: %f %f ",  cpx, cpy);
         if (!guarantee_capacity(p,5)) return;
         *command(p->elements+p->size) = QUADTO;
         p->elements[p->size+1] = cpx;
@@ -505,12 +605,12 @@ static void quadto(SVGPathparser* p, float cpx, float cpy, float x, float y) {
         p->elements[p->size+4] = y;
         p->size+=5;
 #ifdef DEBUG
-        printf("%f %f\n", x, y);
+        printf("quadto: %f %f %f %f\n", cpx, cpy, x, y);
 #endif
     }
 }
 
-static void tquadto(SVGPathparser* p, float x, float y) {
+static void tquadto(SVGPathparser* p, double x, double y) {
     if (p->size > 0) {
         if (!guarantee_capacity(p,3)) return;
         *command(p->elements+p->size) = TQUADTO;
@@ -523,7 +623,7 @@ static void tquadto(SVGPathparser* p, float x, float y) {
     }
 }
 
-static void arcto(SVGPathparser* p, float* args, float x, float y) {
+static void arcto(SVGPathparser* p, double* args, double x, double y) {
     if (p->size > 0) {
         if (!guarantee_capacity(p,8)) return;
         *command(p->elements+p->size) = ARCTO;
@@ -541,7 +641,7 @@ static void arcto(SVGPathparser* p, float* args, float x, float y) {
     }
 }
 
-static void nsvg__pathMoveTo(SVGPathparser* p, float* cpx, float* cpy, float* args, int rel) {
+static void nsvg__pathMoveTo(SVGPathparser* p, double* cpx, double* cpy, double* args, int rel) {
     if (rel) {
         *cpx += args[0];
         *cpy += args[1];
@@ -555,7 +655,7 @@ static void nsvg__pathMoveTo(SVGPathparser* p, float* cpx, float* cpy, float* ar
 #endif
 }
 
-static void nsvg__pathLineTo(SVGPathparser* p, float* cpx, float* cpy, float* args, int rel) {
+static void nsvg__pathLineTo(SVGPathparser* p, double* cpx, double* cpy, double* args, int rel) {
     if (rel) {
         *cpx += args[0];
         *cpy += args[1];
@@ -569,7 +669,7 @@ static void nsvg__pathLineTo(SVGPathparser* p, float* cpx, float* cpy, float* ar
 #endif
 }
 
-static void nsvg__pathHLineTo(SVGPathparser* p, float* cpx, float* cpy, float* args, int rel) {
+static void nsvg__pathHLineTo(SVGPathparser* p, double* cpx, double* cpy, double* args, int rel) {
     if (rel)
         *cpx += args[0];
     else
@@ -580,7 +680,7 @@ static void nsvg__pathHLineTo(SVGPathparser* p, float* cpx, float* cpy, float* a
 #endif
 }
 
-static void nsvg__pathVLineTo(SVGPathparser* p, float* cpx, float* cpy, float* args, int rel) {
+static void nsvg__pathVLineTo(SVGPathparser* p, double* cpx, double* cpy, double* args, int rel) {
     if (rel)
         *cpy += args[0];
     else
@@ -591,10 +691,10 @@ static void nsvg__pathVLineTo(SVGPathparser* p, float* cpx, float* cpy, float* a
 #endif
 }
 
-static void nsvg__pathCubicBezTo(SVGPathparser* p, float* cpx, float* cpy,
-                                 float* cpx2, float* cpy2, float* args, int rel)
+static void nsvg__pathCubicBezTo(SVGPathparser* p, double* cpx, double* cpy,
+                                 double* cpx2, double* cpy2, double* args, int rel)
 {
-    float x2, y2, cx1, cy1, cx2, cy2;
+    double x2, y2, cx1, cy1, cx2, cy2;
 
     if (rel) {
         cx1 = *cpx + args[0];
@@ -620,9 +720,9 @@ static void nsvg__pathCubicBezTo(SVGPathparser* p, float* cpx, float* cpy,
     *cpy = y2;
 }
 
-static void nsvg__pathCubicBezShortTo(SVGPathparser* p, float* cpx, float* cpy,
-                                      float* cpx2, float* cpy2, float* args, int rel) {
-    float x1, y1, x2, y2,  cx2, cy2;
+static void nsvg__pathCubicBezShortTo(SVGPathparser* p, double* cpx, double* cpy,
+                                      double* cpx2, double* cpy2, double* args, int rel) {
+    double x1, y1, x2, y2,  cx2, cy2;
 
     x1 = *cpx;
     y1 = *cpy;
@@ -646,9 +746,9 @@ static void nsvg__pathCubicBezShortTo(SVGPathparser* p, float* cpx, float* cpy,
     *cpy = y2;
 }
 
-static void nsvg__pathQuadBezTo(SVGPathparser* p, float* cpx, float* cpy,
-                                float* cpx2, float* cpy2, float* args, int rel) {
-    float x2, y2, cx, cy;
+static void nsvg__pathQuadBezTo(SVGPathparser* p, double* cpx, double* cpy,
+                                double* cpx2, double* cpy2, double* args, int rel) {
+    double x2, y2, cx, cy;
 
     if (rel) {
         cx = *cpx + args[0];
@@ -670,10 +770,10 @@ static void nsvg__pathQuadBezTo(SVGPathparser* p, float* cpx, float* cpy,
     *cpy = y2;
 }
 
-static void nsvg__pathQuadBezShortTo(SVGPathparser* p, float* cpx, float* cpy,
-                                     float* cpx2, float* cpy2, float* args, int rel) {
-    float x1, y1, x2, y2, cx, cy;
-    float cx1, cy1, cx2, cy2;
+static void nsvg__pathQuadBezShortTo(SVGPathparser* p, double* cpx, double* cpy,
+                                     double* cpx2, double* cpy2, double* args, int rel) {
+    double x1, y1, x2, y2, cx, cy;
+    double cx1, cy1, cx2, cy2;
 
     x1 = *cpx;
     y1 = *cpy;
@@ -696,28 +796,28 @@ static void nsvg__pathQuadBezShortTo(SVGPathparser* p, float* cpx, float* cpy,
     *cpy = y2;
 }
 
-static float nsvg__vecrat(float ux, float uy, float vx, float vy)
+static double nsvg__vecrat(double ux, double uy, double vx, double vy)
 {
     return (ux*vx + uy*vy) / (norm(ux,uy) * norm(vx,vy));
 }
 
-static float nsvg__vecang(float ux, float uy, float vx, float vy)
+static double nsvg__vecang(double ux, double uy, double vx, double vy)
 {
-    float r = nsvg__vecrat(ux,uy, vx,vy);
-    if (r < -1.0f) r = -1.0f;
-    if (r > 1.0f) r = 1.0f;
-    return ((ux*vy < uy*vx) ? -1.0f : 1.0f) * acosf(r);
+    double r = nsvg__vecrat(ux,uy, vx,vy);
+    if (r < -1.0) r = -1.0;
+    if (r > 1.0) r = 1.0;
+    return ((ux*vy < uy*vx) ? -1.0 : 1.0) * acos(r);
 }
 
-static void nsvg__pathArcTo(SVGPathparser* p, float* cpx, float* cpy, float* args, int rel) {
-    float rx, ry;
-    float x1, y1, x2, y2, dx, dy, d;
+static void nsvg__pathArcTo(SVGPathparser* p, double* cpx, double* cpy, double* args, int rel) {
+    double rx, ry;
+    double x1, y1, x2, y2, dx, dy, d;
 
     int fa, fs;
 
 
-    rx = fabsf(args[0]);                // y radius
-    ry = fabsf(args[1]);                // x radius
+    rx = fabs(args[0]);                // y radius
+    ry = fabs(args[1]);                // x radius
     x1 = *cpx;                            // start point
     y1 = *cpy;
     if (rel) {                            // end point
@@ -730,8 +830,8 @@ static void nsvg__pathArcTo(SVGPathparser* p, float* cpx, float* cpy, float* arg
 
     dx = x1 - x2;
     dy = y1 - y2;
-    d = sqrtf(dx*dx + dy*dy);
-    if (d < 1e-6f || rx < 1e-6f || ry < 1e-6f) {
+    d = sqrt(dx*dx + dy*dy);
+    if (d < 1e-6 || rx < 1e-6 || ry < 1e-6) {
         // The arc degenerates to a line
         lineto(p, x2, y2);
         *cpx = x2;
@@ -746,77 +846,227 @@ static void nsvg__pathArcTo(SVGPathparser* p, float* cpx, float* cpy, float* arg
 }
 
 
-static void nsvg__addPath(SVGPathparser* p, char closed)
+//
+//  Transforms the radii and the angle of the arc whose elements start at e (rx, ry,
+//  angle, large arc flag, sweep flag) by the linear part of t. A rotation with a
+//  uniform scale only adds angle, the angle of t, and scales the radii. Otherwise the
+//  image of the ellipse is found from the eigenvalues of M M^T, M being the matrix
+//  mapping the unit circle to the ellipse, and a reflection reverses the sweep.
+//
+static void transformArc(double* e, double* t, double angle)
+{
+    double a, cs, sn, m[4], s0, s1, s2, tr, d, l0, l1, det = t[0]*t[3] - t[1]*t[2];
+    double scale = fabs(t[0]) + fabs(t[1]) + fabs(t[2]) + fabs(t[3]);
+    if (fabs(t[0] - t[3]) <= 1e-12*scale && fabs(t[1] + t[2]) <= 1e-12*scale) {
+        d = sqrt(fabs(det));
+        if (d != 1.0) { e[0] *= d; e[1] *= d; }
+        e[2] += angle;
+        return;
+    }
+    a = e[2] * NSVG_PI / 180.0;
+    cs = cos(a); sn = sin(a);
+    m[0] = (t[0]*cs + t[2]*sn) * e[0];      // columns of M
+    m[1] = (t[1]*cs + t[3]*sn) * e[0];
+    m[2] = (t[2]*cs - t[0]*sn) * e[1];
+    m[3] = (t[3]*cs - t[1]*sn) * e[1];
+    s0 = m[0]*m[0] + m[2]*m[2];             // M M^T = [s0 s1; s1 s2]
+    s1 = m[0]*m[1] + m[2]*m[3];
+    s2 = m[1]*m[1] + m[3]*m[3];
+    tr = (s0 + s2) * 0.5;
+    d = sqrt(nsvg__maxf(tr*tr - (s0*s2 - s1*s1), 0.0));
+    l0 = tr + d;
+    l1 = nsvg__maxf(tr - d, 0.0);
+    e[0] = sqrt(l0);
+    e[1] = sqrt(l1);
+    if (fabs(s1) > 1e-12*l0) e[2] = atan2(l0 - s0, s1) * 180.0 / NSVG_PI;
+    else e[2] = (s0 < s2) ? 90.0 : 0.0;
+    if (det < 0.0) e[4] = (e[4] != 0.0) ? 0.0 : 1.0;
+}
+
+//
+//  Transforms in place the size elements e of a subpath (same format as SVGpath, in
+//  double precision) by matrix t, adding angle to the angle of the arcs, and puts the
+//  bounds of the transformed points and control points in bounds.
+//
+static void transformElements(double* e, int size, double* t, double angle, double* bounds)
 {
-    SVGpath* path = NULL;
     int i, j;
     int nargs;
     int32_t cmd;
-    float xmin, ymin, xmax, ymax;
-    if (p->size < 4)
-        return;
-
-    if (closed)
-        lineto(p, p->elements[0], p->elements[1]);
-
-
-    path = (SVGpath*)malloc(sizeof(SVGpath));
-    if (path == NULL) goto error;
-    memset(path, 0, sizeof(SVGpath));
-
-    path->elements = (float*)malloc(p->size*sizeof(float));
-    if (path->elements == NULL) goto error;
-    path->closed = closed;
-    path->size = p->size;
-
-    // Transform path.
-    
-    pointMatrixMultiply(&path->elements[0], &path->elements[1], p->elements[0], p->elements[1], p->matrix);
-    for (i = 2; i < p->size; ) {
-        *command(path->elements+i) = cmd = *command(p->elements+i);
+    double xmin, ymin, xmax, ymax;
+    pointMatrixMultiply(&e[0], &e[1], e[0], e[1], t);
+    xmin = xmax = e[0];
+    ymin = ymax = e[1];
+    for (i = 2; i < size; ) {
+        cmd = *command(e+i);
         nargs = cmd >> 8;    // get number of argments from command code
         if (nargs < 7) { // for every one except arcs
             for (j = 1; j < nargs; j+=2 ) {
-               pointMatrixMultiply(&path->elements[i+j], &path->elements[i+j+1], p->elements[i+j], p->elements[i+j+1], p->matrix);
-               xmin = nsvg__minf(path->elements[i+j],xmin);
-               ymin = nsvg__minf(path->elements[i+j+1],ymin);
-               xmax = nsvg__maxf(path->elements[i+j],xmax);
-               ymax = nsvg__maxf(path->elements[i+j+1],ymax);
+               pointMatrixMultiply(&e[i+j], &e[i+j+1], e[i+j], e[i+j+1], t);
+               xmin = nsvg__minf(e[i+j],xmin);
+               ymin = nsvg__minf(e[i+j+1],ymin);
+               xmax = nsvg__maxf(e[i+j],xmax);
+               ymax = nsvg__maxf(e[i+j+1],ymax);
             }
             i += j;
             continue;
         }
-        // this is an arc - we use the matrix only for the last point
-        path->elements[i+1] = p->elements[i+1]; // x radius remains constant
-        path->elements[i+2] = p->elements[i+2]; // y radius remains constant
-        path->elements[i+3] = p->elements[i+3] + p->angle;    // adds the angle of the transformation matrix
-        path->elements[i+4] = p->elements[i+4]; // remains constant
-        path->elements[i+5] = p->elements[i+5]; // remains constant
-        pointMatrixMultiply(&path->elements[i+6], &path->elements[i+7], p->elements[i+6], p->elements[i+7], p->matrix);
-        xmin = nsvg__minf(path->elements[i+6],xmin);
-        ymin = nsvg__minf(path->elements[i+7],ymin);
-        xmax = nsvg__maxf(path->elements[i+6],xmax);
-        ymax = nsvg__maxf(path->elements[i+7],ymax);
+        // this is an arc - the matrix transforms its last point and its ellipse
+        transformArc(e+i+1, t, angle);
+        pointMatrixMultiply(&e[i+6], &e[i+7], e[i+6], e[i+7], t);
+        xmin = nsvg__minf(e[i+6],xmin);
+        ymin = nsvg__minf(e[i+7],ymin);
+        xmax = nsvg__maxf(e[i+6],xmax);
+        ymax = nsvg__maxf(e[i+7],ymax);
         i += 8;
     }
+    bounds[0] = xmin; bounds[1] = ymin;
+    bounds[2] = xmax; bounds[3] = ymax;
+}
+
+static SVGpaths* createPaths(void) {
+    SVGpaths* plist = (SVGpaths*)malloc(sizeof(SVGpaths));
+    if (plist != NULL) memset(plist, 0, sizeof(SVGpaths));
+    return plist;
+}
+
+// empties the table, keeping its memory for the next subpaths
+static void clearPaths(SVGpaths* plist) {
+    int k;
+    if (plist == NULL) return;
+    for (k = 0; k < plist->npaths; k++)
+        deleteLengthIndex(plist->paths[k].lengths);
+    plist->npaths = 0;
+    plist->used = 0;
+}
+
+static void nsvg__deletePaths(SVGpaths* plist)
+{
+    if (plist == NULL) return;
+    clearPaths(plist);
+    free(plist->paths);
+    free(plist->buffer);
+    free(plist->lexemes);
+    free(plist);
+}
+
+//
+//  Appends to plist a subpath of the size elements e (in double precision), stored as
+//  floats or as doubles according to precision. Returns the new SVGpath, which stays
+//  valid until the next one is appended, or NULL on allocation error.
+//
+static SVGpath* appendPath(SVGpaths* plist, double* e, int size, int precision,
+                           char closed, double* bounds)
+{
+    SVGpath* path;
+    char* buffer;
+    float* f;
+    size_t offset, bytes, allocated;
+    int i, j, k;
+    int nargs;
+    int32_t cmd;
+    if (plist->npaths == plist->capacity) {
+        k = plist->capacity ? 2*plist->capacity : 16;
+        path = (SVGpath*)realloc(plist->paths, k*sizeof(SVGpath));
+        if (path == NULL) return NULL;
+        plist->paths = path;
+        plist->capacity = k;
+    }
+    bytes = (size_t)size*(precision == PRECISION_DOUBLE ? sizeof(double) : sizeof(float));
+    offset = (plist->used + sizeof(double) - 1) & ~(sizeof(double) - 1);
+    if (offset + bytes > plist->allocated) {
+        allocated = plist->allocated ? 2*plist->allocated : 1024;
+        if (allocated < offset + bytes) allocated = offset + bytes;
+        buffer = (char*)realloc(plist->buffer, allocated);
+        if (buffer == NULL) return NULL;
+        plist->buffer = buffer;
+        plist->allocated = allocated;
+        for (k = 0; k < plist->npaths; k++)
+            plist->paths[k].elements = buffer + plist->paths[k].offset;
+    }
+    path = plist->paths + plist->npaths++;
+    memset(path, 0, sizeof(SVGpath));
+    path->offset = offset;
+    path->elements = plist->buffer + offset;
+    path->size = size;
+    path->closed = closed;
+    path->precision = (char)precision;
+    memcpy(path->bounds, bounds, sizeof(path->bounds));
+    plist->used = offset + bytes;
+    if (precision == PRECISION_DOUBLE) {
+        memcpy(path->elements, e, bytes);
+        return path;
+    }
+    f = (float*)path->elements;
+    f[0] = (float)e[0];
+    f[1] = (float)e[1];
+    for (i = 2; i < size; i += nargs + 1) {
+        *command(f+i) = cmd = *command(e+i);
+        nargs = cmd >> 8;
+        for (j = 1; j <= nargs; j++) f[i+j] = (float)e[i+j];
+    }
+    return path;
+}
+
+//
+//  Copies the size lexemes l of the elements of path, the last subpath of plist, in
+//  the lexemes of plist. Returns 0 on allocation error.
+//
+static int appendLexemes(SVGpaths* plist, SVGpath* path, SVGlexeme* l, int size) {
+    size_t first = path->offset / sizeof(double), n = plist->allocated / sizeof(double);
+    SVGlexeme* lexemes;
+    if (path->precision != PRECISION_DOUBLE) return 1;
+    if (n > plist->nlexemes) {
+        lexemes = (SVGlexeme*)realloc(plist->lexemes, n*sizeof(SVGlexeme));
+        if (lexemes == NULL) return 0;
+        plist->lexemes = lexemes;
+        plist->nlexemes = n;
+    }
+    memcpy(plist->lexemes + first, l, size*sizeof(SVGlexeme));
+    return 1;
+}
+
+static void nsvg__addPath(SVGPathparser* p, char closed)
+{
+    double* e;
+    double bounds[4];
+    int precision;
+    SVGpath* path;
+    if (p->size < 4)
+        return;
+
+    if (closed) {
+        lineto(p, p->elements[0], p->elements[1]);
+        if (p->passthrough) {
+            p->lexemes[p->size-2] = p->lexemes[0];
+            p->lexemes[p->size-1] = p->lexemes[1];
+        }
+    }
+
+    // Transform path. This is done in place, since the parsed elements are discarded
+    // once the path is added, and it gives the bounds needed to choose the precision.
+    e = p->elements;
+    transformElements(e, p->size, p->matrix, p->angle, bounds);
 
-    path->next = p->plist;
-    p->plist = path;
+    precision = p->precision;
+    if (precision == PRECISION_AUTO)
+        precision = (nsvg__maxf(nsvg__maxf(-bounds[0], bounds[2]), nsvg__maxf(-bounds[1], bounds[3])) >= DOUBLE_THRESHOLD)
+                    ? PRECISION_DOUBLE : PRECISION_FLOAT;
+
+    if (p->plist == NULL && (p->plist = createPaths()) == NULL) goto error;
+    if ((path = appendPath(p->plist, e, p->size, precision, closed, bounds)) == NULL) goto error;
+    if (p->passthrough && !appendLexemes(p->plist, path, p->lexemes, p->size)) goto error;
     return;
 
 error:
-    if (path != NULL) {
-        if (path->elements != NULL) free(path->elements);
-        free(path);
-    }
     printf("allocation error: addPath\n");
 }
 
-static float nsvg__getAverageScale(float* t)
+static double nsvg__getAverageScale(double* t)
 {
-    float sx = sqrtf(t[0]*t[0] + t[2]*t[2]);
-    float sy = sqrtf(t[1]*t[1] + t[3]*t[3]);
-    return (sx + sy) * 0.5f;
+    double sx = sqrt(t[0]*t[0] + t[2]*t[2]);
+    double sy = sqrt(t[1]*t[1] + t[3]*t[3]);
+    return (sx + sy) * 0.5;
 }
 
 
@@ -851,14 +1101,58 @@ static char* nsvg__getNextPathItem(char* s, char* it)
     return s;
 }
 
+//
+//  Records the lexemes of the arguments of command cmd, stored from element first
+//  by the parser, (x, y) being the current point before the command.
+//
+static void recordLexemes(SVGPathparser* p, char cmd, SVGlexeme* args, int first, double x, double y)
+{
+    SVGlexeme* l = p->lexemes + first;
+    int n = p->size - first, k;
+    if (n <= 0) return;
+    if (cmd >= 'A' && cmd <= 'Z') x = y = 0.0;
+    switch (cmd | 0x20) {
+        case 'm':
+            l[0] = args[0]; l[0].base = x;
+            l[1] = args[1]; l[1].base = y;
+            return;
+        case 'h':
+            l[1] = args[0]; l[1].base = x;
+            l[2].start = NULL;
+            return;
+        case 'v':
+            l[1].start = NULL;
+            l[2] = args[0]; l[2].base = y;
+            return;
+        case 'a':
+            if (n == 8)
+                for (k = 1; k <= 5; k++) { l[k] = args[k-1]; l[k].base = 0.0; }
+            args += 5;
+            // the coordinates of the end point are the last elements, even if the arc
+            // degenerates to a line
+            l += n - 3;
+            n = 3;
+            break;
+    }
+    for (k = 1; k < n; k++) {
+        l[k] = args[k-1];
+        l[k].base = (k & 1) ? x : y;
+    }
+}
+
 static void nsvg__parsePath(SVGPathparser* p, char*s)
 {
     char cmd = '\0';
-    float args[10];
+    double args[10];
+    SVGlexeme lexemes[10], first[2];
+    char* start = NULL;
+    double x0, y0;
+    char op;
+    int size = 0;
     int nargs;
     int rargs = 0;
     char initPoint;
-    float cpx, cpy, cpx2, cpy2;
+    double cpx, cpy, cpx2, cpy2;
     const char* tmp[4];
     char closedFlag;
     int i;
@@ -872,15 +1166,25 @@ static void nsvg__parsePath(SVGPathparser* p, char*s)
         nargs = 0;
         while (*s) {
             item[0] = '\0';
+            if (p->passthrough)
+                for (start = s; *start && (space(*start) || *start == ','); start++);
             if ((cmd == 'A' || cmd == 'a') && (nargs == 3 || nargs == 4))
                 s = nsvg__getNextPathItemWhenArcFlag(s, item);
             if (!*item)
                 s = nsvg__getNextPathItem(s, item);
             if (!*item) break;
             if (cmd != '\0' && coordinate(item)) {
-                if (nargs < 10)
-                    args[nargs++] = (float)str2f(item);
+                if (nargs < 10) {
+                    if (p->passthrough) {
+                        lexemes[nargs].start = start;
+                        lexemes[nargs].length = (int)(s - start);
+                    }
+                    args[nargs++] = str2f(item);
+                }
                 if (nargs >= rargs) {
+                    size = p->size;
+                    x0 = cpx; y0 = cpy;         // current point before the command
+                    op = cmd;
                     switch (cmd) {
                         case 'm':
                         case 'M':
@@ -936,7 +1240,7 @@ static void nsvg__parsePath(SVGPathparser* p, char*s)
                             }
                             break;
                     }
-
+                    if (p->passthrough) recordLexemes(p, op, lexemes, size, x0, y0);
                     nargs = 0;
                 }
             } else {
@@ -956,16 +1260,19 @@ static void nsvg__parsePath(SVGPathparser* p, char*s)
                 if (cmd == 'Z' || cmd == 'z') {
                     closedFlag = 1;
                     // Commit path.
+                    first[0].start = first[1].start = NULL;
                     if (p->size > 0) {
                         // Move current point to first point
                         cpx = p->elements[0];
                         cpy = p->elements[1];
                         cpx2 = cpx; cpy2 = cpy;
+                        if (p->passthrough) { first[0] = p->lexemes[0]; first[1] = p->lexemes[1]; }
                         nsvg__addPath(p, closedFlag);
                     }
                     // Start new subpath.
                     nsvg__resetPath(p);
                     moveto(p, cpx, cpy);
+                    if (p->passthrough) { p->lexemes[0] = first[0]; p->lexemes[1] = first[1]; }
                     closedFlag = 0;
                     nargs = 0;
                 }
@@ -984,214 +1291,7588 @@ static void nsvg__parsePath(SVGPathparser* p, char*s)
 
 }
 
-//
-//  Prints an SVG path with absolute or relative coordinates
-//    Input:  (1) a linked list of SVG subpaths (SVGpath)
-//            (2) a zero for relative coordinates or a 1 for absolute coordinates
-//    Output: prints the svg path on the console by using the internal path
-//            representation, and substuting linetos by hlinetos or vlinetos
-//            when appropriate.
-//
+/* validation */
 
-static void generateSVG(SVGpath* path, int absolute) {
-    SVGpath* p;
-    float* elements;
-    int size;
-    int i, j, nargs;
-    int32_t cmd;
-    float cpx, cpy, x, y;
-    char *format = M_format;
-    for( p = path; p; p = p->next){
-        elements = p->elements;
-        size = p->size;
-        if ( absolute ) printf(format, trnc(elements[0]), trnc(elements[1]));
-        else {
-            if ( format == M_format ) {
-                printf(format, trnc(elements[0]), trnc(elements[1]));
-                format = m_format; //next movetos in subpaths are relative
+//  Path data is checked against the grammar of SVG paths without converting numbers
+//  nor storing anything, so that malformed paths can be rejected before parsing them.
+//  The path starts with a moveto, every command but closepath is followed by one or
+//  more complete groups of arguments (sz gives the size of a group), the following
+//  groups repeating the command implicitly, arc flags are single 0 or 1 digits, and
+//  two arguments are separated by white spaces with at most one comma, or nothing
+//  when the second one starts with a sign or a dot.
+
+#define whiteSpace(c) ((c) == ' ' || ((c) >= '\t' && (c) <= '\r'))
+#define numberStart(c) (digit(c) || (c) == '.' || (c) == '-' || (c) == '+')
+
+// end of the number starting at s, or s if no number starts there
+static const char* scanNumber(const char* s) {
+    const char* t = s;
+    const char* e;
+    int digits = 0;
+    if (*t == '-' || *t == '+') t++;
+    while (digit(*t)) { t++; digits = 1; }
+    if (*t == '.') {
+        t++;
+        while (digit(*t)) { t++; digits = 1; }
+    }
+    if (!digits) return s;
+    if (*t == 'e' || *t == 'E') {
+        // an exponent without digits is not part of the number
+        e = t + 1;
+        if (*e == '-' || *e == '+') e++;
+        if (digit(*e)) {
+            while (digit(*e)) e++;
+            t = e;
+        }
+    }
+    return t;
+}
+
+//  Validates path data d. Returns -1 if it is valid (an empty path is valid),
+//  otherwise the byte offset in d of the first error, described by *error.
+static long validatePath(const char* d, const char** error) {
+    const char* s = d;
+    const char* t;
+    const char* comma;
+    int cmd, nargs, k;
+    while (whiteSpace(*s)) s++;
+    if (*s && *s != 'M' && *s != 'm') {
+        *error = "the path does not start with a moveto";
+        return (long)(s - d);
+    }
+    while (*s) {
+        cmd = *s;
+        if ((nargs = numberOfArguments(cmd)) < 0) {
+            *error = "unknown command";
+            return (long)(s - d);
+        }
+        s++;
+        while (whiteSpace(*s)) s++;
+        if (nargs == 0) {
+            if (numberStart(*s) || *s == ',') {
+                *error = "closepath has no arguments";
+                return (long)(s - d);
             }
-            else printf(format, trnc(elements[0]-cpx), trnc(elements[1]-cpy));
+            continue;
         }
-        cpx = elements[0]; cpy = elements[1];
-        for (i = 2; i < size; ) {
-            cmd = *command(p->elements+i);
-            if (cmd == LINETO) {
-                x = p->elements[i+1]; y = p->elements[i+2];
-                if ( trnc(x) == trnc(cpx) ) {
-                    if ( trnc(y) != trnc(cpy)) {
-                        if ( absolute ) printf(V_format, trnc(y));
-                        else printf(v_format, trnc(y - cpy));
-                        cpy = y;
+        for (;;) {
+            for (k = 0; k < nargs; k++) {
+                if (k > 0) {
+                    while (whiteSpace(*s)) s++;
+                    if (*s == ',') {
+                        s++;
+                        while (whiteSpace(*s)) s++;
                     }
-                   i+=3;
-                   continue;
                 }
-                if ( trnc(y) == trnc(cpy) ) {
-                   // trnc(x) != trnc(cpx), otherwise we wouldn't be here
-                   if ( absolute ) printf(H_format, trnc(x));
-                   else printf(h_format, trnc(x - cpx));
-                   cpx = x;
-                   i+=3;
-                   continue;
+                if (nargs == 7 && (k == 3 || k == 4)) {
+                    if (*s != '0' && *s != '1') {
+                        *error = "invalid arc flag";
+                        return (long)(s - d);
+                    }
+                    s++;
+                    continue;
                 }
-                if ( absolute ) printf(L_format, trnc(x), trnc(y));
-                else printf(l_format, trnc(x - cpx), trnc(y - cpy));
-                cpx = x; cpy = y;
-                i+=3;
-                continue;
-            }
-            printf("%c", (( absolute ) ? commands[cmd & 0xff] : relative[cmd & 0xff]));
-            nargs = cmd >> 8;    // get number of argments from command code
-            if (nargs < 7) { // for every one except arcs
-              if ( absolute )
-                for (j = 1; ;  ) { 
-                  if ((j += 2) >= nargs) {
-                    printf(last_pt, trnc(p->elements[i+j-2]), trnc(p->elements[i+j-1]));
-                    break; 
-                  }
-                  printf(pt_format, trnc(p->elements[i+j-2]), trnc(p->elements[i+j-1]));
+                if ((t = scanNumber(s)) == s) {
+                    *error = "missing argument";
+                    return (long)(s - d);
                 }
-              else
-                for (j = 1; ;  ) { 
-                  if ((j += 2) >= nargs) {
-                    printf(last_pt, trnc(p->elements[i+j-2] - cpx), trnc(p->elements[i+j-1] - cpy));
-                    break;
-                  }
-                  printf(pt_format, trnc(p->elements[i+j-2] - cpx), trnc(p->elements[i+j-1] - cpy));
+                s = t;
+            }
+            // another group of arguments, or the next command
+            while (whiteSpace(*s)) s++;
+            comma = NULL;
+            if (*s == ',') {
+                comma = s++;
+                while (whiteSpace(*s)) s++;
+            }
+            if (!numberStart(*s)) {
+                if (comma) {
+                    *error = "comma after the last argument";
+                    return (long)(comma - d);
                 }
-              i += j;
-              cpx = p->elements[i-2]; cpy = p->elements[i-1];
-              continue;
+                break;
             }
-            // this is an arc
-            if ( absolute )
-                printf(a_format, 
-                    trnc(p->elements[i+1]), trnc(p->elements[i+2]), // radii
-                    trnc(p->elements[i+3]), trnc(p->elements[i+4]), trnc(p->elements[i+5]), 
-                    trnc(p->elements[i+6]), trnc(p->elements[i+7]) // last coordinates
-                );                
-            else
-                printf(a_format, 
-                    trnc(p->elements[i+1]), trnc(p->elements[i+2]), // radii
-                    trnc(p->elements[i+3]), trnc(p->elements[i+4]), trnc(p->elements[i+5]), // angle, etc.
-                    trnc(p->elements[i+6] - cpx), trnc(p->elements[i+7] - cpy) // last coordinates
-                );
-            cpx = p->elements[i+6]; cpy = p->elements[i+7];        
-            i += 8;            
         }
     }
+    return -1;
 }
 
-static SVGPathparser* nsvg__createParser(void){
-    SVGPathparser* p;
-    p = (SVGPathparser*)malloc(sizeof(SVGPathparser));
-    if (p == NULL) goto error;
-    memset(p, 0, sizeof(SVGPathparser));
-    p->matrix = (float*) malloc(sizeof(float)*6);
-    if (p->matrix == NULL) goto error;
-    identityMatrix(p->matrix);
-    p->angle = 0;
-    return p;
+/* segment functions */
 
-error:
-    if (p) {
-        if (p->matrix) free(p->matrix);
-        free(p);
+//  SVGsegment is a segment of a subpath with all its points resolved in absolute
+//  coordinates: smooth commands (S and T) get their reflected control point and
+//  arcs get their center parameterization. The points are stored in p as
+//  x0, y0 (start point), followed by:
+//
+//  +-----------+------------------------------------------------------------+
+//  |  type     |   following points in p                                    |
+//  +-----------+------------------------------------------------------------+
+//  |  LINETO   |   x, y                                                     |
+//  |  QUADTO   |   x1, y1, x, y                                             |
+//  |  CURVETO  |   x1, y1, x2, y2, x, y                                     |
+//  |  ARCTO    |   x, y  (arc contains cx, cy, rx, ry, rotation, a1, da)     |
+//  +-----------+------------------------------------------------------------+
+//
+typedef struct SVGsegment {
+    int32_t type;           // LINETO, QUADTO, CURVETO or ARCTO
+    int index;              // index in the elements of the subpath of the original command
+    double p[8];            // points (see description above)
+    double arc[7];          // center, radii, rotation (radians), start angle and sweep angle
+} SVGsegment;
+
+// State kept while walking the segments of a subpath
+typedef struct SVGsegmentIterator {
+    SVGpath* path;
+    int i;                  // index in elements of the next command
+    int32_t last;           // type of the previous command
+    double cpx, cpy;        // current point
+    double cpx2, cpy2;      // last control point, reflected by smooth commands
+} SVGsegmentIterator;
+
+static void beginSegments(SVGsegmentIterator* it, SVGpath* path) {
+    it->path = path;
+    it->i = 2;
+    it->last = 0;
+    it->cpx = it->cpx2 = pathElement(path,0);
+    it->cpy = it->cpy2 = pathElement(path,1);
+}
+
+//  Converts the endpoint parameterization of an arc to its center parameterization,
+//  as done by nsvg__pathArcTo in the original work. Returns 0 if the arc degenerates
+//  to a line.
+static int arcCenter(SVGsegment* s, double rx, double ry, double angle, int fa, int fs) {
+    double x1 = s->p[0], y1 = s->p[1], x2 = s->p[2], y2 = s->p[3];
+    double dx, dy, d, sinrx, cosrx, x1p, y1p, sa, sb, sc, cxp, cyp, ux, uy, vx, vy, a1, da;
+
+    rx = fabs(rx);
+    ry = fabs(ry);
+    dx = x1 - x2;
+    dy = y1 - y2;
+    d = sqrt(dx*dx + dy*dy);
+    if (d < 1e-6 || rx < 1e-6 || ry < 1e-6) return 0;
+    angle = angle * NSVG_PI / 180.0;
+    sinrx = sin(angle);
+    cosrx = cos(angle);
+
+    // Convert to center point parameterization.
+    // http://www.w3.org/TR/SVG11/implnote.html#ArcImplementationNotes
+    // 1) Compute x1', y1'
+    x1p = cosrx * dx / 2.0 + sinrx * dy / 2.0;
+    y1p = -sinrx * dx / 2.0 + cosrx * dy / 2.0;
+    d = sqr(x1p)/sqr(rx) + sqr(y1p)/sqr(ry);
+    if (d > 1) {
+        d = sqrt(d);
+        rx *= d;
+        ry *= d;
     }
-    printf("allocation error: nsvg__createParser\n");
-    return NULL;
+    // 2) Compute cx', cy'
+    sa = sqr(rx)*sqr(ry) - sqr(rx)*sqr(y1p) - sqr(ry)*sqr(x1p);
+    sb = sqr(rx)*sqr(y1p) + sqr(ry)*sqr(x1p);
+    if (sa < 0.0) sa = 0.0;
+    sc = (sb > 0.0) ? sqrt(sa / sb) : 0.0;
+    if (fa == fs) sc = -sc;
+    cxp = sc * rx * y1p / ry;
+    cyp = sc * -ry * x1p / rx;
+    // 3) Compute cx,cy from cx',cy'
+    s->arc[0] = (x1 + x2)/2.0 + cosrx*cxp - sinrx*cyp;
+    s->arc[1] = (y1 + y2)/2.0 + sinrx*cxp + cosrx*cyp;
+    // 4) Calculate theta1, and delta theta.
+    ux = (x1p - cxp) / rx;
+    uy = (y1p - cyp) / ry;
+    vx = (-x1p - cxp) / rx;
+    vy = (-y1p - cyp) / ry;
+    a1 = nsvg__vecang(1.0,0.0, ux,uy);    // Initial angle
+    da = nsvg__vecang(ux,uy, vx,vy);      // Delta angle
+    if (fs == 0 && da > 0)
+        da -= 2 * NSVG_PI;
+    else if (fs == 1 && da < 0)
+        da += 2 * NSVG_PI;
+    s->arc[2] = rx;
+    s->arc[3] = ry;
+    s->arc[4] = angle;
+    s->arc[5] = a1;
+    s->arc[6] = da;
+    return 1;
 }
 
-int main(int argc, char *argv[]) {
-    char c, c1, c2;
-    char* d = NULL;
-    char* n;
-    char item[ITEM_SIZE];
-    char *pars = NULL;
-    char *end = NULL;
-    float t[] = { 1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f };
-    int absolute = 1; // generate absolute code by default
-    int angle = 0;    // flag to indicate an angle was given
-    int matrix = 0;   // flag to indicate a matrix was given
-    float a, ang = 0.0f; 
-    int i,j;
-#ifdef DEBUG
-    printf("**start**\n");
-#endif
-    SVGPathparser *p = nsvg__createParser();
-    for (i = 1; i < argc; i++) {
-#ifdef DEBUG
-        printf("**argument %d\n%s\n", i, argv[i]);
-#endif
-        c1 = *argv[i];
-        if (c1 == '-') {
-            c2 = *(argv[i]+1);
-            n = argv[i]+2;
-            if (c2 == 'p' || c2 == 'P') {
-                pars = argv[i]+2;                      // extra attributes of the path like color stroke width, etc.
-                continue;
-            }
-            if (c2 == 'e' || c2 == 'E') {
-                end = argv[i]+2;                      // end of path data to be added to the end of a path (ex. 'z')
-                continue;
+//  Resolves the next segment of the subpath in s. Returns 0 when there are no more
+//  segments.
+static int nextSegment(SVGsegmentIterator* it, SVGsegment* s) {
+    SVGpath* path = it->path;
+    int i = it->i;
+    int32_t cmd;
+    if (i >= path->size) return 0;
+    cmd = pathCommand(path,i);
+    s->index = i;
+    s->p[0] = it->cpx;
+    s->p[1] = it->cpy;
+    switch (cmd) {
+        case LINETO:
+        case TQUADTO:
+            if (cmd == LINETO) {
+                s->type = LINETO;
+                s->p[2] = pathElement(path,i+1);
+                s->p[3] = pathElement(path,i+2);
+                it->cpx2 = s->p[2]; it->cpy2 = s->p[3];
+                break;
             }
-            if (c2 == 'a' || c2 == 'A') {
-                if (angle) continue;                 // if angle already given, ignore new one
-                angle = 1;
-                n = parseNumber(n, item, ITEM_SIZE);
-                if (!*item) continue;                // angle is not anumber or not given. ignore
-                ang = str2f(item);     
-#ifdef DEBUG
-                printf("%f\n",ang);
-#endif          // if it doesn't match matrix, ignore it
-                if (matrix && (truncf(ang) != truncf(a))) continue;
-                p->angle = ang;                      // matches matrix or new angle
-                continue;
+            s->type = QUADTO;
+            if (it->last == QUADTO || it->last == TQUADTO) {
+                s->p[2] = 2*it->cpx - it->cpx2;
+                s->p[3] = 2*it->cpy - it->cpy2;
+            } else {
+                s->p[2] = it->cpx;
+                s->p[3] = it->cpy;
             }
-            if (c2 == 'r' || c2 == 'R') {
-                absolute = 0;
-                continue;
+            s->p[4] = pathElement(path,i+1);
+            s->p[5] = pathElement(path,i+2);
+            it->cpx2 = s->p[2]; it->cpy2 = s->p[3];
+            break;
+        case QUADTO:
+            s->type = QUADTO;
+            s->p[2] = pathElement(path,i+1);
+            s->p[3] = pathElement(path,i+2);
+            s->p[4] = pathElement(path,i+3);
+            s->p[5] = pathElement(path,i+4);
+            it->cpx2 = s->p[2]; it->cpy2 = s->p[3];
+            break;
+        case SCURVETO:
+        case CURVETO:
+            s->type = CURVETO;
+            if (cmd == CURVETO) {
+                s->p[2] = pathElement(path,i+1);
+                s->p[3] = pathElement(path,i+2);
+                i += 2;
+            } else if (it->last == CURVETO || it->last == SCURVETO) {
+                s->p[2] = 2*it->cpx - it->cpx2;
+                s->p[3] = 2*it->cpy - it->cpy2;
+            } else {
+                s->p[2] = it->cpx;
+                s->p[3] = it->cpy;
             }
-            if (c2 == 'm' || c2 == 'M') {
-                if (matrix) continue;                 // if already given, ignore new one
-                matrix = 1;
-                for (j = 0; j < 6; j++) {
-                   while (*n && space(*n)) n++;
-                   n = parseNumber(n, item, ITEM_SIZE);
-                   if (!*item) break;                 // matrix incomplete. exit loop
-                   t[j] = str2f(item);
-                }
-                if (!*item) continue;                 // matrix incomplete. ignore
-                copyMatrix(p->matrix, t);
-                a = getRotationAngleFromMatrix(t);    // mismatch with matrix, take matrix
-                if (truncf(ang) != truncf(a)) p->angle = a;            
-#ifdef DEBUG
-                printf("[%f %f %f %f %f %f]\n",t[0],t[1],t[2],t[3],t[4],t[5],t[6]);
-                printf("ang: %f - angle calculated: %f - angle stored: %f\n", ang, a, p->angle);
-#endif
-                continue;
+            s->p[4] = pathElement(path,i+1);
+            s->p[5] = pathElement(path,i+2);
+            s->p[6] = pathElement(path,i+3);
+            s->p[7] = pathElement(path,i+4);
+            it->cpx2 = s->p[4]; it->cpy2 = s->p[5];
+            break;
+        default: // ARCTO
+            s->type = ARCTO;
+            s->p[2] = pathElement(path,i+6);
+            s->p[3] = pathElement(path,i+7);
+            if (!arcCenter(s, pathElement(path,i+1), pathElement(path,i+2), pathElement(path,i+3),
+                           pathElement(path,i+4) != 0.0, pathElement(path,i+5) != 0.0))
+                s->type = LINETO;
+            it->cpx2 = s->p[2]; it->cpy2 = s->p[3];
+            break;
+    }
+    it->last = cmd;
+    it->i = s->index + (cmd >> 8) + 1;
+    it->cpx = pathElement(path,it->i-2);
+    it->cpy = pathElement(path,it->i-1);
+    return 1;
+}
+
+// index in p of the end point of a segment
+static int segmentEnd(SVGsegment* s) {
+    return (s->type == QUADTO) ? 4 : (s->type == CURVETO) ? 6 : 2;
+}
+
+// point of segment s at parameter t in [0,1]
+static void segmentPoint(SVGsegment* s, double t, double* x, double* y) {
+    double* p = s->p;
+    double it = 1.0 - t, a, c, sn, cs;
+    switch (s->type) {
+        case LINETO:
+            *x = p[0] + (p[2]-p[0])*t;
+            *y = p[1] + (p[3]-p[1])*t;
+            return;
+        case QUADTO:
+            *x = it*it*p[0] + 2*it*t*p[2] + t*t*p[4];
+            *y = it*it*p[1] + 2*it*t*p[3] + t*t*p[5];
+            return;
+        case CURVETO:
+            *x = bezierCoordinate(t, p[0], p[2], p[4], p[6]);
+            *y = bezierCoordinate(t, p[1], p[3], p[5], p[7]);
+            return;
+    }
+    a = s->arc[5] + s->arc[6]*t;
+    sn = sin(s->arc[4]); cs = cos(s->arc[4]);
+    c = cos(a); a = sin(a);
+    *x = s->arc[0] + s->arc[2]*cs*c - s->arc[3]*sn*a;
+    *y = s->arc[1] + s->arc[2]*sn*c + s->arc[3]*cs*a;
+}
+
+// derivative of segment s with respect to its parameter t in [0,1]
+static void segmentDerivative(SVGsegment* s, double t, double* dx, double* dy) {
+    double* p = s->p;
+    double it = 1.0 - t, a, c, sn, cs;
+    switch (s->type) {
+        case LINETO:
+            *dx = p[2]-p[0];
+            *dy = p[3]-p[1];
+            return;
+        case QUADTO:
+            *dx = 2*it*(p[2]-p[0]) + 2*t*(p[4]-p[2]);
+            *dy = 2*it*(p[3]-p[1]) + 2*t*(p[5]-p[3]);
+            return;
+        case CURVETO:
+            *dx = 3*it*it*(p[2]-p[0]) + 6*it*t*(p[4]-p[2]) + 3*t*t*(p[6]-p[4]);
+            *dy = 3*it*it*(p[3]-p[1]) + 6*it*t*(p[5]-p[3]) + 3*t*t*(p[7]-p[5]);
+            return;
+    }
+    a = s->arc[5] + s->arc[6]*t;
+    sn = sin(s->arc[4]); cs = cos(s->arc[4]);
+    c = cos(a); a = sin(a);
+    *dx = s->arc[6]*(-s->arc[2]*cs*a - s->arc[3]*sn*c);
+    *dy = s->arc[6]*(-s->arc[2]*sn*a + s->arc[3]*cs*c);
+}
+
+// unit tangent of segment s at t, stepping inside the segment where the derivative vanishes
+static void segmentTangent(SVGsegment* s, double t, double* tx, double* ty) {
+    double d;
+    segmentDerivative(s, t, tx, ty);
+    if ((d = norm(*tx, *ty)) < 1e-12) {
+        segmentDerivative(s, (t < 0.5) ? t + 1e-4 : t - 1e-4, tx, ty);
+        if ((d = norm(*tx, *ty)) < 1e-12) { *tx = 1.0; *ty = 0.0; return; }
+    }
+    *tx /= d;
+    *ty /= d;
+}
+
+// length of segment s between parameters t0 and t1, with 5 points Gauss-Legendre quadrature
+static double segmentLength(SVGsegment* s, double t0, double t1) {
+    static const double x[5] = { 0.0, -0.5384693101056831, 0.5384693101056831,
+                                      -0.9061798459386640, 0.9061798459386640 };
+    static const double w[5] = { 0.5688888888888889, 0.4786286704993665, 0.4786286704993665,
+                                 0.2369268850561891, 0.2369268850561891 };
+    double h = (t1 - t0) * 0.5, m = (t1 + t0) * 0.5, len = 0.0, dx, dy;
+    int k;
+    if (s->type == LINETO) return norm(s->p[2]-s->p[0], s->p[3]-s->p[1]) * (t1 - t0);
+    for (k = 0; k < 5; k++) {
+        segmentDerivative(s, m + h*x[k], &dx, &dy);
+        len += w[k] * norm(dx, dy);
+    }
+    return len * h;
+}
+
+//  Parameters in (0,1) where the coordinate axis (0 for x, 1 for y) of segment s
+//  reaches an extremum, in increasing order. Between them the segment is monotone
+//  along this axis. Returns the number of parameters (at most 3).
+static int segmentExtrema(SVGsegment* s, int axis, double* ts) {
+    double* p = s->p + axis;
+    double a, b, c, d, t, t1, t2, e, sn, cs;
+    int n = 0, k;
+    switch (s->type) {
+        case LINETO:
+            return 0;
+        case QUADTO:
+            d = p[0] - 2*p[2] + p[4];
+            if (fabs(d) < 1e-12) return 0;
+            t = (p[0] - p[2]) / d;
+            if (t > 0.0 && t < 1.0) ts[n++] = t;
+            return n;
+        case CURVETO:
+            // derivative is a*t^2 + b*t + c
+            a = 3*(-p[0] + 3*p[2] - 3*p[4] + p[6]);
+            b = 6*(p[0] - 2*p[2] + p[4]);
+            c = 3*(p[2] - p[0]);
+            if (fabs(a) < 1e-12) {
+                if (fabs(b) < 1e-12) return 0;
+                t = -c / b;
+                if (t > 0.0 && t < 1.0) ts[n++] = t;
+                return n;
             }
-            continue;
+            d = b*b - 4*a*c;
+            if (d < 0.0) return 0;
+            d = sqrt(d);
+            t1 = (-b - d) / (2*a);
+            t2 = (-b + d) / (2*a);
+            if (t1 > t2) { t = t1; t1 = t2; t2 = t; }
+            if (t1 > 0.0 && t1 < 1.0) ts[n++] = t1;
+            if (t2 > 0.0 && t2 < 1.0 && t2 != t1) ts[n++] = t2;
+            return n;
+    }
+    // arc: extrema of rx*cos(a) * (cs or sn) -/+ ry*sin(a) * (sn or cs) are at e + k*PI
+    sn = sin(s->arc[4]); cs = cos(s->arc[4]);
+    e = (axis == 0) ? atan2(-s->arc[3]*sn, s->arc[2]*cs) : atan2(s->arc[3]*cs, s->arc[2]*sn);
+    if (fabs(s->arc[6]) < 1e-12) return 0;
+    for (k = -4; k <= 4; k++) {
+        t = (e + k*NSVG_PI - s->arc[5]) / s->arc[6];
+        if (t > 0.0 && t < 1.0 && n < 3) ts[n++] = t;
+    }
+    // the sweep is negative when the arc turns counterclockwise
+    if (n > 1 && ts[0] > ts[n-1])
+        for (k = 0; k < n/2; k++) { t = ts[k]; ts[k] = ts[n-1-k]; ts[n-1-k] = t; }
+    return n;
+}
+
+// coordinate axis (0 for x, 1 for y) of segment s at parameter t
+static double segmentCoordinate(SVGsegment* s, int axis, double t) {
+    double x, y;
+    segmentPoint(s, t, &x, &y);
+    return axis ? y : x;
+}
+
+//  Finds the parameters where the coordinate axis of segment s equals c. Each
+//  monotone piece of the segment counts its crossing if c is in [min, max) of the
+//  piece, which counts each crossing once when pieces and segments are chained.
+//  dirs receives +1 if the coordinate increases at the crossing and -1 otherwise.
+//  Returns the number of crossings (at most 4).
+static int segmentCrossings(SVGsegment* s, int axis, double c, double* ts, int* dirs) {
+    double bounds[5], lo, hi, ca, cb, tm, cm;
+    int n, k, i, count = 0;
+    bounds[0] = 0.0;
+    n = segmentExtrema(s, axis, bounds + 1) + 1;
+    bounds[n] = 1.0;
+    for (k = 0; k < n; k++) {
+        ca = segmentCoordinate(s, axis, bounds[k]);
+        cb = segmentCoordinate(s, axis, bounds[k+1]);
+        if (ca == cb) continue;
+        if (ca < cb) { if (c < ca || c >= cb) continue; }
+        else if (c < cb || c >= ca) continue;
+        lo = bounds[k]; hi = bounds[k+1];
+        if (s->type == LINETO)
+            tm = lo + (hi - lo) * (c - ca) / (cb - ca);
+        else for (i = 0; i < 50; i++) {  // bisection on the monotone piece
+            tm = (lo + hi) * 0.5;
+            cm = segmentCoordinate(s, axis, tm);
+            if ((cm < c) == (ca < cb)) lo = tm; else hi = tm;
         }
-        d = argv[i]; // it's no a flag, thus, we assume it's the path
+        ts[count] = tm;
+        dirs[count++] = (ca < cb) ? 1 : -1;
     }
-    if (angle && !matrix) setRotationInMatrix(p->matrix, ang * NSVG_PI / 180.0f);
-#ifdef DEBUG
-    copyMatrix(t, p->matrix);
-    printf("final matrix: [%f %f %f %f %f %f]\n",t[0],t[1],t[2],t[3],t[4],t[5],t[6]);
-    printf("**parsing*\n");
-#endif
-    nsvg__parsePath(p,d);
-#ifdef DEBUG
-    printf("**generating SVG with %s coordinates**\n", ((absolute)? "absolute" : "relative"));
-#endif
-    if  (!pars) printf("<path d=\"");
-    else  printf("<path %s d=\"", pars);
-    generateSVG(p->plist,absolute);
-    if (!end) printf("\"/>\n");
-    else printf("%s\"/>\n", end);
-#ifdef DEBUG
-    printf("**finished**\n");
-#endif
-    return 0;
+    return count;
+}
+
+// bounds [xmin, ymin, xmax, ymax] of segment s (tight for lines and arcs, hull for curves)
+static void segmentBounds(SVGsegment* s, double* b) {
+    double ts[3], x, y;
+    int k, n, axis;
+    b[0] = b[2] = s->p[0];
+    b[1] = b[3] = s->p[1];
+    n = segmentEnd(s);
+    for (k = 2; k <= n; k += 2) {
+        b[0] = nsvg__minf(b[0], s->p[k]);   b[2] = nsvg__maxf(b[2], s->p[k]);
+        b[1] = nsvg__minf(b[1], s->p[k+1]); b[3] = nsvg__maxf(b[3], s->p[k+1]);
+    }
+    if (s->type != ARCTO) return;
+    for (axis = 0; axis < 2; axis++) {
+        n = segmentExtrema(s, axis, ts);
+        for (k = 0; k < n; k++) {
+            segmentPoint(s, ts[k], &x, &y);
+            b[0] = nsvg__minf(b[0], x); b[2] = nsvg__maxf(b[2], x);
+            b[1] = nsvg__minf(b[1], y); b[3] = nsvg__maxf(b[3], y);
+        }
+    }
+}
+
+//  Nearest point of segment s to (px, py). The best of some samples is refined by
+//  golden section search around it. Returns the squared distance and sets t.
+static double segmentNearest(SVGsegment* s, double px, double py, double* t) {
+    const double g = 0.6180339887498949;
+    double x, y, d, best, lo, hi, a, b, da, db, dx, dy, l;
+    int k, n = 16;
+    if (s->type == LINETO) {
+        dx = s->p[2] - s->p[0];
+        dy = s->p[3] - s->p[1];
+        l = dx*dx + dy*dy;
+        *t = (l > 0.0) ? ((px - s->p[0])*dx + (py - s->p[1])*dy) / l : 0.0;
+        if (*t < 0.0) *t = 0.0; else if (*t > 1.0) *t = 1.0;
+        segmentPoint(s, *t, &x, &y);
+        return sqr(x - px) + sqr(y - py);
+    }
+    best = DBL_MAX;
+    for (k = 0; k <= n; k++) {
+        segmentPoint(s, (double)k/n, &x, &y);
+        if ((d = sqr(x - px) + sqr(y - py)) < best) { best = d; *t = (double)k/n; }
+    }
+    lo = nsvg__maxf(0.0, *t - 1.0/n);
+    hi = nsvg__minf(1.0, *t + 1.0/n);
+    a = hi - g*(hi - lo);
+    b = lo + g*(hi - lo);
+    segmentPoint(s, a, &x, &y); da = sqr(x - px) + sqr(y - py);
+    segmentPoint(s, b, &x, &y); db = sqr(x - px) + sqr(y - py);
+    for (k = 0; k < 40; k++) {
+        if (da < db) {
+            hi = b; b = a; db = da;
+            a = hi - g*(hi - lo);
+            segmentPoint(s, a, &x, &y); da = sqr(x - px) + sqr(y - py);
+        } else {
+            lo = a; a = b; da = db;
+            b = lo + g*(hi - lo);
+            segmentPoint(s, b, &x, &y); db = sqr(x - px) + sqr(y - py);
+        }
+    }
+    if (da < best) { best = da; *t = a; }
+    if (db < best) { best = db; *t = b; }
+    return best;
+}
+
+//  Bounds of all the segments of the subpaths. Unlike the bounds of SVGpath, they
+//  include the extent of the arcs.
+static void pathsBounds(SVGpaths* plist, double* b) {
+    SVGsegmentIterator it;
+    SVGsegment s;
+    SVGpath* p;
+    double sb[4];
+    b[0] = b[1] = DBL_MAX;
+    b[2] = b[3] = -DBL_MAX;
+    for (p = firstPath(plist); p != endPath(plist); p++) {
+        b[0] = nsvg__minf(b[0], p->bounds[0]); b[1] = nsvg__minf(b[1], p->bounds[1]);
+        b[2] = nsvg__maxf(b[2], p->bounds[2]); b[3] = nsvg__maxf(b[3], p->bounds[3]);
+        beginSegments(&it, p);
+        while (nextSegment(&it, &s))
+            if (s.type == ARCTO) {
+                segmentBounds(&s, sb);
+                b[0] = nsvg__minf(b[0], sb[0]); b[1] = nsvg__minf(b[1], sb[1]);
+                b[2] = nsvg__maxf(b[2], sb[2]); b[3] = nsvg__maxf(b[3], sb[3]);
+            }
+    }
+}
+
+/* arc length index */
+
+#define LENGTH_SAMPLES 16   // number of intervals of the table of lengths of each curve
+
+//  SVGlengthIndex is built on the first length query of an SVGpath. It keeps the
+//  resolved segments, the length of the subpath at the end of each segment, and
+//  for each curve a table of the lengths at parameters t = k/LENGTH_SAMPLES. Both
+//  are searched by bisection, so that queries are O(log n).
+typedef struct SVGlengthIndex {
+    int nsegments;
+    SVGsegment* segments;
+    double* lengths;        // cumulative length at the end of each segment
+    double* table;          // LENGTH_SAMPLES+1 lengths per segment, from the start of the segment
+    double start;           // length of the subpaths before this one, set by pointAtLength
+    int first;              // number of their segments, -1 until set by pointAtLength
+} SVGlengthIndex;
+
+static void deleteLengthIndex(SVGlengthIndex* index) {
+    if (index == NULL) return;
+    free(index->segments);
+    free(index->lengths);
+    free(index->table);
+    free(index);
+}
+
+static SVGlengthIndex* lengthIndex(SVGpath* path) {
+    SVGlengthIndex* index;
+    SVGsegmentIterator it;
+    SVGsegment s;
+    double len = 0.0, *table;
+    int n = 0, k;
+    if (path->lengths) return path->lengths;
+    index = (SVGlengthIndex*)malloc(sizeof(SVGlengthIndex));
+    if (index == NULL) goto error;
+    memset(index, 0, sizeof(SVGlengthIndex));
+    index->first = -1;
+    // there are at most (size-2)/3 segments, LINETO being the smallest command
+    k = (path->size - 2)/3 + 1;
+    index->segments = (SVGsegment*)malloc(k*sizeof(SVGsegment));
+    index->lengths = (double*)malloc(k*sizeof(double));
+    index->table = (double*)malloc(k*(LENGTH_SAMPLES+1)*sizeof(double));
+    if (!index->segments || !index->lengths || !index->table) goto error;
+    beginSegments(&it, path);
+    while (nextSegment(&it, &s)) {
+        index->segments[n] = s;
+        table = index->table + n*(LENGTH_SAMPLES+1);
+        table[0] = 0.0;
+        for (k = 1; k <= LENGTH_SAMPLES; k++)
+            table[k] = table[k-1] + segmentLength(&s, (double)(k-1)/LENGTH_SAMPLES, (double)k/LENGTH_SAMPLES);
+        len += table[LENGTH_SAMPLES];
+        index->lengths[n++] = len;
+    }
+    index->nsegments = n;
+    path->lengths = index;
+    return index;
+
+error:
+    deleteLengthIndex(index);
+    printf("allocation error: lengthIndex\n");
+    return NULL;
+}
+
+static double pathLength(SVGpath* path) {
+    SVGlengthIndex* index = lengthIndex(path);
+    if (index == NULL || index->nsegments == 0) return 0.0;
+    return index->lengths[index->nsegments-1];
+}
+
+//  Parameter t of segment s where its length from the start of the segment is len,
+//  given the table of lengths of the segment. The table gives the interval of t and
+//  Newton iterations refine the linear interpolation inside it.
+static double segmentParameter(SVGsegment* s, double* table, double len) {
+    int lo = 0, hi = LENGTH_SAMPLES, mid, k;
+    double t, t0, f, dx, dy, d;
+    if (len <= 0.0) return 0.0;
+    if (len >= table[LENGTH_SAMPLES]) return 1.0;
+    while (hi - lo > 1) {
+        mid = (lo + hi) >> 1;
+        if (table[mid] <= len) lo = mid; else hi = mid;
+    }
+    t0 = (double)lo / LENGTH_SAMPLES;
+    t = t0 + (len - table[lo]) / (table[hi] - table[lo]) / LENGTH_SAMPLES;
+    if (s->type == LINETO) return t;
+    for (k = 0; k < 3; k++) {
+        f = table[lo] + segmentLength(s, t0, t) - len;
+        segmentDerivative(s, t, &dx, &dy);
+        if ((d = norm(dx, dy)) < 1e-12) break;
+        t -= f / d;
+        if (fabs(f) < 1e-9) break;
+    }
+    return (t < t0) ? t0 : (t > (double)hi / LENGTH_SAMPLES) ? (double)hi / LENGTH_SAMPLES : t;
+}
+
+//  Finds the segment of the subpath at length len (clamped to the subpath), its
+//  point (x, y) and its unit tangent (tx, ty). Returns the index of the segment,
+//  or -1 if the subpath has no segments.
+static int pathAtLength(SVGpath* path, double len, double* x, double* y, double* tx, double* ty) {
+    SVGlengthIndex* index = lengthIndex(path);
+    int lo = 0, hi, mid;
+    double t;
+    if (index == NULL || index->nsegments == 0) return -1;
+    hi = index->nsegments - 1;
+    while (lo < hi) {  // first segment ending after len
+        mid = (lo + hi) >> 1;
+        if (index->lengths[mid] < len) lo = mid + 1; else hi = mid;
+    }
+    t = segmentParameter(index->segments + lo, index->table + lo*(LENGTH_SAMPLES+1),
+                         len - (lo ? index->lengths[lo-1] : 0.0));
+    segmentPoint(index->segments + lo, t, x, y);
+    segmentTangent(index->segments + lo, t, tx, ty);
+    return lo;
+}
+
+//  Point and tangent at length len of the subpaths of plist taken as a whole path, as
+//  getPointAtLength does in browsers. Returns the number of the segment counting the
+//  segments of all the subpaths, or -1 if the path is empty. The first query indexes
+//  the subpaths with the length and the segments before each of them, so that the
+//  subpath at len is found by a binary search like the segment within it.
+static int pointAtLength(SVGpaths* plist, double len, double* x, double* y, double* tx, double* ty) {
+    SVGlengthIndex* index;
+    SVGpath* p;
+    double start = 0.0;
+    int first = 0, lo = 0, hi, mid;
+    if (plist == NULL || plist->npaths == 0) return -1;
+    hi = plist->npaths - 1;
+    if (plist->paths[hi].lengths == NULL || plist->paths[hi].lengths->first < 0) {
+        for (p = firstPath(plist); p != endPath(plist); p++) {
+            if ((index = lengthIndex(p)) == NULL) return -1;
+            index->start = start;
+            index->first = first;
+            start += pathLength(p);
+            first += index->nsegments;
+        }
+    }
+    index = plist->paths[hi].lengths;
+    if (index->first + index->nsegments == 0) return -1;
+    while (lo < hi) {  // first subpath ending after len
+        mid = (lo + hi) >> 1;
+        if (plist->paths[mid].lengths->start + pathLength(plist->paths + mid) < len) lo = mid + 1; else hi = mid;
+    }
+    // a subpath without segments gives way to the next one, or to the previous one at the end
+    while (lo < plist->npaths - 1 && plist->paths[lo].lengths->nsegments == 0) lo++;
+    while (plist->paths[lo].lengths->nsegments == 0) lo--;
+    index = plist->paths[lo].lengths;
+    return index->first + pathAtLength(plist->paths + lo, len - index->start, x, y, tx, ty);
+}
+
+//  Same as pointAtLength, but walking and integrating all the segments on each query
+//  instead of using the indexes. It is the reference for the benchmark of the indexes.
+static int pointAtLengthNaive(SVGpaths* plist, double len, double* x, double* y, double* tx, double* ty) {
+    SVGpath* p;
+    SVGsegmentIterator it;
+    SVGsegment s, last;
+    double table[LENGTH_SAMPLES+1], lastTable[LENGTH_SAMPLES+1], t;
+    int n = -1, k;
+    for (p = firstPath(plist); p != endPath(plist); p++) {
+        beginSegments(&it, p);
+        while (nextSegment(&it, &s)) {
+            table[0] = 0.0;
+            for (k = 1; k <= LENGTH_SAMPLES; k++)
+                table[k] = table[k-1] + segmentLength(&s, (double)(k-1)/LENGTH_SAMPLES, (double)k/LENGTH_SAMPLES);
+            if (n >= 0) len -= lastTable[LENGTH_SAMPLES];
+            last = s;
+            memcpy(lastTable, table, sizeof(table));
+            n++;
+            if (len <= table[LENGTH_SAMPLES]) goto found;
+        }
+    }
+    if (n < 0) return -1;
+found:
+    t = segmentParameter(&last, lastTable, len);
+    segmentPoint(&last, t, x, y);
+    segmentTangent(&last, t, tx, ty);
+    return n;
+}
+
+/* geometric metrics */
+
+//  The signed area A of the fill of a subpath and its first moments Mx and My (the
+//  integrals of x and y over the area, whose ratios to A give the centroid) follow
+//  from Green's theorem on its boundary, closed by a line back to its start as when
+//  it is filled:
+//      A = 1/2 (x dy - y dx),  Mx = 1/3 x (x dy - y dx),  My = 1/3 y (x dy - y dx)
+//  integrated along each segment. The integrands of lines and Bezier curves are
+//  polynomials of t, integrated exactly from their coefficients. An elliptical arc is
+//  C + U cos(a) + V sin(a) with U x V = rx*ry, and its integrands are products of
+//  sines and cosines, integrated exactly as well, so that nothing is flattened. The
+//  points are taken relative to the start of the subpath, which keeps the precision
+//  far from the origin. A is positive when the subpath turns clockwise on the screen,
+//  the y axis pointing down. The length is the one of the arc length index.
+
+typedef struct SVGmetrics {
+    double area;            // signed area, positive if clockwise
+    double moments[2];      // integrals of x and y over the area
+    double length;
+} SVGmetrics;
+
+// coefficients of the power basis of coordinate axis of Bezier segment s, relative to o
+static int segmentPolynomial(SVGsegment* s, int axis, double o, double* c) {
+    double* p = s->p + axis;
+    c[0] = p[0] - o;
+    switch (s->type) {
+        case LINETO:
+            c[1] = p[2] - p[0];
+            return 1;
+        case QUADTO:
+            c[1] = 2*(p[2] - p[0]);
+            c[2] = p[0] - 2*p[2] + p[4];
+            return 2;
+    }
+    c[1] = 3*(p[2] - p[0]);
+    c[2] = 3*(p[0] - 2*p[2] + p[4]);
+    c[3] = p[6] - p[0] + 3*(p[2] - p[4]);
+    return 3;
+}
+
+//  Adds to m the integrals of segment s, relative to (ox, oy): twice the area and
+//  three times the moments.
+static void segmentMetrics(SVGsegment* s, double ox, double oy, SVGmetrics* m) {
+    double x[4], y[4], w[6], cx, cy, ux, uy, vx, vy, k, bu, bv, a1, a2, s1, s2, scc, sss, ssc, i0;
+    int n, i, j;
+    if (s->type != ARCTO) {
+        n = segmentPolynomial(s, 0, ox, x);
+        segmentPolynomial(s, 1, oy, y);
+        // w = x y' - y x', of degree 2n-1
+        for (i = 0; i < 2*n; i++) w[i] = 0.0;
+        for (i = 0; i <= n; i++)
+            for (j = 1; j <= n; j++) w[i+j-1] += j*(x[i]*y[j] - y[i]*x[j]);
+        for (j = 0; j < 2*n; j++) {
+            m->area += w[j] / (j + 1);
+            for (i = 0; i <= n; i++) {
+                m->moments[0] += x[i]*w[j] / (i + j + 1);
+                m->moments[1] += y[i]*w[j] / (i + j + 1);
+            }
+        }
+        return;
+    }
+    cx = s->arc[0] - ox;
+    cy = s->arc[1] - oy;
+    ux = s->arc[2]*cos(s->arc[4]);  uy = s->arc[2]*sin(s->arc[4]);
+    vx = -s->arc[3]*sin(s->arc[4]); vy = s->arc[3]*cos(s->arc[4]);
+    // w = k + bv cos(a) - bu sin(a)
+    k = ux*vy - uy*vx;
+    bu = cx*uy - cy*ux;
+    bv = cx*vy - cy*vx;
+    a1 = s->arc[5];
+    a2 = a1 + s->arc[6];
+    s1 = sin(a2) - sin(a1);                                     // integral of cos(a)
+    s2 = cos(a1) - cos(a2);                                     // of sin(a)
+    scc = s->arc[6]/2 + (sin(2*a2) - sin(2*a1))/4;              // of cos(a)^2
+    sss = s->arc[6]/2 - (sin(2*a2) - sin(2*a1))/4;              // of sin(a)^2
+    ssc = (sqr(sin(a2)) - sqr(sin(a1)))/2;                      // of sin(a) cos(a)
+    i0 = k*s->arc[6] + bv*s1 - bu*s2;
+    m->area += i0;
+    m->moments[0] += cx*i0 + ux*(k*s1 + bv*scc - bu*ssc) + vx*(k*s2 + bv*ssc - bu*sss);
+    m->moments[1] += cy*i0 + uy*(k*s1 + bv*scc - bu*ssc) + vy*(k*s2 + bv*ssc - bu*sss);
+}
+
+// metrics of subpath path
+static void pathMetrics(SVGpath* path, SVGmetrics* m) {
+    SVGsegmentIterator it;
+    SVGsegment s;
+    double ox = pathElement(path,0), oy = pathElement(path,1);
+    memset(m, 0, sizeof(SVGmetrics));
+    beginSegments(&it, path);
+    while (nextSegment(&it, &s)) segmentMetrics(&s, ox, oy, m);
+    // the line closing the subpath
+    s.type = LINETO;
+    s.p[0] = it.cpx; s.p[1] = it.cpy;
+    s.p[2] = ox;     s.p[3] = oy;
+    segmentMetrics(&s, ox, oy, m);
+    m->area *= 0.5;
+    m->moments[0] = m->moments[0]/3.0 + ox*m->area;
+    m->moments[1] = m->moments[1]/3.0 + oy*m->area;
+    m->length = pathLength(path);
+}
+
+//  Metrics of all the subpaths, the areas of subpaths turning in opposite directions
+//  cancelling as with the nonzero fill rule. Subpath metrics are also stored in
+//  subpaths if not NULL.
+static void pathsMetrics(SVGpaths* plist, SVGmetrics* total, SVGmetrics* subpaths) {
+    SVGmetrics m;
+    SVGpath* p;
+    memset(total, 0, sizeof(SVGmetrics));
+    for (p = firstPath(plist); p != endPath(plist); p++) {
+        pathMetrics(p, &m);
+        total->area += m.area;
+        total->moments[0] += m.moments[0];
+        total->moments[1] += m.moments[1];
+        total->length += m.length;
+        if (subpaths) *subpaths++ = m;
+    }
+}
+
+/* spatial index */
+
+#define FILL_NONZERO 0
+#define FILL_EVENODD 1
+#define BVH_LEAF_SIZE 4
+
+//  SVGspatialIndex is a bounding volume hierarchy over the segments of a linked list
+//  of subpaths. Open subpaths get an extra closing segment, which is only used for
+//  the fill (point in path). The nodes are stored in an array, the children of a
+//  node being stored right after it (left child) and at index right.
+typedef struct SVGspatialItem {
+    double bounds[4];
+    SVGsegment segment;
+    int number;             // number of the segment, counting the segments of all subpaths
+    char closing;           // implicit closing segment of an open subpath
+} SVGspatialItem;
+
+typedef struct SVGbvhNode {
+    double bounds[4];
+    int first;              // first item of a leaf
+    int count;              // number of items of a leaf, 0 for inner nodes
+    int right;              // right child of an inner node
+} SVGbvhNode;
+
+typedef struct SVGspatialIndex {
+    int nitems;
+    SVGspatialItem* items;
+    int nnodes;
+    SVGbvhNode* nodes;
+} SVGspatialIndex;
+
+static void deleteSpatialIndex(SVGspatialIndex* index) {
+    if (index == NULL) return;
+    free(index->items);
+    free(index->nodes);
+    free(index);
+}
+
+// center of item along axis, doubled
+#define itemCenter(item, axis) ((item)->bounds[axis] + (item)->bounds[(axis)+2])
+
+//  Reorders the count items so that item k has the kth center along axis, with no
+//  greater center before it and no smaller after it (quickselect).
+static void selectItem(SVGspatialItem* items, int count, int k, int axis) {
+    SVGspatialItem swap;
+    int lo = 0, hi = count - 1, i, j;
+    double pivot;
+    while (lo < hi) {
+        pivot = itemCenter(items + ((lo + hi) >> 1), axis);
+        i = lo;
+        j = hi;
+        while (i <= j) {
+            while (itemCenter(items + i, axis) < pivot) i++;
+            while (itemCenter(items + j, axis) > pivot) j--;
+            if (i <= j) {
+                swap = items[i]; items[i] = items[j]; items[j] = swap;
+                i++;
+                j--;
+            }
+        }
+        if (k <= j) hi = j;
+        else if (k >= i) lo = i;
+        else return;
+    }
+}
+
+// builds the subtree of the items in [first, first+count) and returns its node
+static int buildNode(SVGspatialIndex* index, int first, int count) {
+    int node = index->nnodes++, k, half;
+    double* b = index->nodes[node].bounds;
+    double* ib;
+    b[0] = b[1] = DBL_MAX;
+    b[2] = b[3] = -DBL_MAX;
+    for (k = first; k < first + count; k++) {
+        ib = index->items[k].bounds;
+        b[0] = nsvg__minf(b[0], ib[0]); b[1] = nsvg__minf(b[1], ib[1]);
+        b[2] = nsvg__maxf(b[2], ib[2]); b[3] = nsvg__maxf(b[3], ib[3]);
+    }
+    index->nodes[node].first = first;
+    index->nodes[node].count = count;
+    if (count <= BVH_LEAF_SIZE) return node;
+    // median split along the longest axis
+    half = count >> 1;
+    selectItem(index->items + first, count, half, (b[2] - b[0] >= b[3] - b[1]) ? 0 : 1);
+    index->nodes[node].count = 0;
+    buildNode(index, first, half);
+    index->nodes[node].right = buildNode(index, first + half, count - half);
+    return node;
+}
+
+static SVGspatialIndex* spatialIndex(SVGpaths* plist) {
+    SVGspatialIndex* index;
+    SVGsegmentIterator it;
+    SVGpath* p;
+    SVGspatialItem* item;
+    int n = 0, number = 0;
+    index = (SVGspatialIndex*)malloc(sizeof(SVGspatialIndex));
+    if (index == NULL) goto error;
+    memset(index, 0, sizeof(SVGspatialIndex));
+    for (p = firstPath(plist); p != endPath(plist); p++) n += (p->size - 2)/3 + 1;
+    index->items = (SVGspatialItem*)malloc(n*sizeof(SVGspatialItem));
+    index->nodes = (SVGbvhNode*)malloc(2*n*sizeof(SVGbvhNode));
+    if (!index->items || !index->nodes) goto error;
+    for (p = firstPath(plist); p != endPath(plist); p++) {
+        beginSegments(&it, p);
+        for (;;) {
+            item = index->items + index->nitems;
+            if (!nextSegment(&it, &item->segment)) break;
+            item->number = number++;
+            item->closing = 0;
+            segmentBounds(&item->segment, item->bounds);
+            index->nitems++;
+        }
+        if (!p->closed && (it.cpx != pathElement(p,0) || it.cpy != pathElement(p,1))) {
+            item = index->items + index->nitems++;
+            item->segment.type = LINETO;
+            item->segment.index = p->size;
+            item->segment.p[0] = it.cpx;
+            item->segment.p[1] = it.cpy;
+            item->segment.p[2] = pathElement(p,0);
+            item->segment.p[3] = pathElement(p,1);
+            item->number = -1;
+            item->closing = 1;
+            segmentBounds(&item->segment, item->bounds);
+        }
+    }
+    if (index->nitems) buildNode(index, 0, index->nitems);
+    return index;
+
+error:
+    deleteSpatialIndex(index);
+    printf("allocation error: spatialIndex\n");
+    return NULL;
+}
+
+//  Tells if (px, py) is inside the fill of the path with rule FILL_NONZERO or
+//  FILL_EVENODD. Counts the crossings of the segments with a ray going right from
+//  the point, visiting only the nodes the ray passes through.
+static int pointInPath(SVGspatialIndex* index, double px, double py, int rule) {
+    int stack[64], top = 0, node, k, n, c;
+    int dirs[4], winding = 0, crossings = 0;
+    double ts[4], x, y, *b;
+    SVGbvhNode* nd;
+    if (index == NULL || index->nitems == 0) return 0;
+    stack[top++] = 0;
+    while (top) {
+        nd = index->nodes + (node = stack[--top]);
+        b = nd->bounds;
+        if (py < b[1] || py > b[3] || px > b[2]) continue;
+        if (nd->count == 0) {
+            stack[top++] = nd->right;
+            stack[top++] = node + 1;
+            continue;
+        }
+        for (k = nd->first; k < nd->first + nd->count; k++) {
+            b = index->items[k].bounds;
+            if (py < b[1] || py > b[3] || px > b[2]) continue;
+            n = segmentCrossings(&index->items[k].segment, 1, py, ts, dirs);
+            for (c = 0; c < n; c++) {
+                segmentPoint(&index->items[k].segment, ts[c], &x, &y);
+                if (x > px) {
+                    winding += dirs[c];
+                    crossings++;
+                }
+            }
+        }
+    }
+    return (rule == FILL_EVENODD) ? (crossings & 1) : (winding != 0);
+}
+
+//  Nearest point (x, y) of the outline of the path to (px, py), closing segments
+//  excluded. The nodes are visited nearest first and pruned once they are farther
+//  than the best distance found. Returns the segment number or -1 if empty.
+static int nearestPoint(SVGspatialIndex* index, double px, double py, double* x, double* y, double* dist) {
+    int stack[64], top = 0, node, k, near, far, best = -1;
+    double d, dn, df, t, bt = 0.0, bd = DBL_MAX, *b;
+    SVGbvhNode* nd;
+    if (index == NULL || index->nitems == 0) return -1;
+    stack[top++] = 0;
+#define boxDistance(b) (sqr(nsvg__maxf(nsvg__maxf((b)[0] - px, px - (b)[2]), 0.0)) + \
+                        sqr(nsvg__maxf(nsvg__maxf((b)[1] - py, py - (b)[3]), 0.0)))
+    while (top) {
+        nd = index->nodes + (node = stack[--top]);
+        if (boxDistance(nd->bounds) >= bd) continue;
+        if (nd->count == 0) {
+            near = node + 1; far = nd->right;
+            dn = boxDistance(index->nodes[near].bounds);
+            df = boxDistance(index->nodes[far].bounds);
+            if (dn > df) { near = far; far = node + 1; }
+            stack[top++] = far;
+            stack[top++] = near;
+            continue;
+        }
+        for (k = nd->first; k < nd->first + nd->count; k++) {
+            b = index->items[k].bounds;
+            if (index->items[k].closing || boxDistance(b) >= bd) continue;
+            d = segmentNearest(&index->items[k].segment, px, py, &t);
+            if (d < bd) { bd = d; bt = t; best = k; }
+        }
+    }
+#undef boxDistance
+    if (best < 0) return -1;
+    segmentPoint(&index->items[best].segment, bt, x, y);
+    *dist = sqrt(bd);
+    return index->items[best].number;
+}
+
+// tells if segment s crosses or lies inside the rectangle r = [x0, y0, x1, y1]
+static int segmentInRect(SVGsegment* s, double* r) {
+    double ts[4], x, y;
+    int dirs[4], axis, side, n, k;
+    if (s->p[0] >= r[0] && s->p[0] <= r[2] && s->p[1] >= r[1] && s->p[1] <= r[3]) return 1;
+    for (axis = 0; axis < 2; axis++)
+        for (side = 0; side < 2; side++) {
+            n = segmentCrossings(s, axis, r[axis + 2*side], ts, dirs);
+            for (k = 0; k < n; k++) {
+                segmentPoint(s, ts[k], &x, &y);
+                if (axis == 0 && y >= r[1] && y <= r[3]) return 1;
+                if (axis == 1 && x >= r[0] && x <= r[2]) return 1;
+            }
+        }
+    return 0;
+}
+
+//  Tells if the rectangle r = [x0, y0, x1, y1] overlaps the path filled with rule,
+//  that is if the outline crosses the rectangle, or if the rectangle is entirely
+//  inside the fill.
+static int rectOverlap(SVGspatialIndex* index, double* r, int rule) {
+    int stack[64], top = 0, node, k;
+    double* b;
+    SVGbvhNode* nd;
+    if (index == NULL || index->nitems == 0) return 0;
+    stack[top++] = 0;
+    while (top) {
+        nd = index->nodes + (node = stack[--top]);
+        b = nd->bounds;
+        if (b[0] > r[2] || b[2] < r[0] || b[1] > r[3] || b[3] < r[1]) continue;
+        if (nd->count == 0) {
+            stack[top++] = nd->right;
+            stack[top++] = node + 1;
+            continue;
+        }
+        for (k = nd->first; k < nd->first + nd->count; k++) {
+            b = index->items[k].bounds;
+            if (b[0] > r[2] || b[2] < r[0] || b[1] > r[3] || b[3] < r[1]) continue;
+            if (segmentInRect(&index->items[k].segment, r)) return 1;
+        }
+    }
+    return pointInPath(index, r[0], r[1], rule);
+}
+
+/* flattening */
+
+//  SVGpolyline receives the subpaths flattened into contours of points. The contour
+//  k has the points from contours[k] to contours[k+1]-1. Contours are implicitly
+//  closed by the consumers filling them.
+typedef struct SVGpolyline {
+    double* points;         // x, y of each point
+    int npoints;
+    int capacity;
+    int* contours;          // first point of each contour, followed by npoints
+    int ncontours;
+    int ccapacity;
+} SVGpolyline;
+
+static void freePolyline(SVGpolyline* poly) {
+    free(poly->points);
+    free(poly->contours);
+    memset(poly, 0, sizeof(SVGpolyline));
+}
+
+static int addPoint(SVGpolyline* poly, double x, double y) {
+    double* points;
+    if (poly->npoints + 1 > poly->capacity) {
+        poly->capacity = poly->capacity ? (poly->capacity << 1) : 256;
+        points = (double*)realloc(poly->points, poly->capacity*2*sizeof(double));
+        if (points == NULL) return 0;
+        poly->points = points;
+    }
+    poly->points[2*poly->npoints] = x;
+    poly->points[2*poly->npoints+1] = y;
+    poly->npoints++;
+    return 1;
+}
+
+// starts a new contour, removing the previous one if it has less than 2 points
+static int addContour(SVGpolyline* poly) {
+    int* contours;
+    if (poly->ncontours > 0 && poly->npoints - poly->contours[poly->ncontours-1] < 2) {
+        poly->npoints = poly->contours[--poly->ncontours];
+    }
+    if (poly->ncontours + 2 > poly->ccapacity) {
+        poly->ccapacity = poly->ccapacity ? (poly->ccapacity << 1) : 16;
+        contours = (int*)realloc(poly->contours, poly->ccapacity*sizeof(int));
+        if (contours == NULL) return 0;
+        poly->contours = contours;
+    }
+    poly->contours[poly->ncontours++] = poly->npoints;
+    poly->contours[poly->ncontours] = poly->npoints;
+    return 1;
+}
+
+//  Number of lines approximating segment s transformed by matrix t within tol. The
+//  distance between a curve and its chords is bounded by its second differences.
+static int flatteningSteps(SVGsegment* s, double* t, double tol) {
+    double x[4], y[4], dd, r, a;
+    int k, n;
+    switch (s->type) {
+        case LINETO:
+            return 1;
+        case ARCTO:
+            r = nsvg__maxf(s->arc[2], s->arc[3]) * nsvg__getAverageScale(t);
+            a = (tol < r) ? 2.0*acos(1.0 - tol/r) : NSVG_PI;
+            n = (int)ceil(fabs(s->arc[6]) / a);
+            break;
+        default:
+            n = (s->type == QUADTO) ? 3 : 4;
+            for (k = 0; k < n; k++) pointMatrixMultiply(&x[k], &y[k], s->p[2*k], s->p[2*k+1], t);
+            dd = norm(x[0] - 2*x[1] + x[2], y[0] - 2*y[1] + y[2]);
+            if (n == 4) dd = nsvg__maxf(dd, norm(x[1] - 2*x[2] + x[3], y[1] - 2*y[2] + y[3]));
+            n = (int)ceil(sqrt(((n == 4) ? 0.75 : 0.25) * dd / tol));
+            break;
+    }
+    return (n < 1) ? 1 : (n > 1024) ? 1024 : n;
+}
+
+//  Flattens all the subpaths transformed by matrix t into contours of poly, with a
+//  maximum distance tol between the curves and their chords.
+static int flattenPaths(SVGpaths* plist, double* t, double tol, SVGpolyline* poly) {
+    SVGsegmentIterator it;
+    SVGsegment s;
+    SVGpath* p;
+    double x, y;
+    int k, n;
+    for (p = firstPath(plist); p != endPath(plist); p++) {
+        if (!addContour(poly)) return 0;
+        pointMatrixMultiply(&x, &y, pathElement(p,0), pathElement(p,1), t);
+        if (!addPoint(poly, x, y)) return 0;
+        beginSegments(&it, p);
+        while (nextSegment(&it, &s)) {
+            n = flatteningSteps(&s, t, tol);
+            for (k = 1; k <= n; k++) {
+                if (k == n) { x = s.p[segmentEnd(&s)]; y = s.p[segmentEnd(&s)+1]; }
+                else segmentPoint(&s, (double)k/n, &x, &y);
+                pointMatrixMultiply(&x, &y, x, y, t);
+                if (!addPoint(poly, x, y)) return 0;
+            }
+        }
+        poly->contours[poly->ncontours] = poly->npoints;
+    }
+    if (!addContour(poly)) return 0;  // drops a last contour too small
+    poly->ncontours--;
+    return 1;
+}
+
+/* simplification */
+
+//  Runs of consecutive linetos, as produced by auto-tracers and CAD exports, are
+//  simplified within a tolerance. Each run is first reduced by Ramer-Douglas-Peucker.
+//  The vertices of the reduced polyline turning by more than 60 degrees are corners,
+//  and each smooth piece between two corners is fitted by cubic Bezier curves by least
+//  squares (Philip J. Schneider, "An Algorithm for Automatically Fitting Digitized
+//  Curves", Graphics Gems, 1990). The curves replace the reduced polyline when they
+//  take fewer numbers, and joins of curves with the same tangent become S commands
+//  when the curves stay within the tolerance. The other commands are kept as is.
+
+#define SIMPLIFY_CORNER 0.5     // cosine of the turning angle of a corner
+#define SIMPLIFY_SAMPLES 16     // samples of each segment measuring the Hausdorff distance
+#define SIMPLIFY_ITERATIONS 20  // reparameterizations before splitting a curve
+
+// range of points to be fitted by a curve, with its unit tangents at both ends
+typedef struct SVGfitRange {
+    int first, last;
+    double t1[2], t2[2];        // t1 points forwards from first, t2 backwards from last
+} SVGfitRange;
+
+typedef struct SVGsimplifier {
+    double tolerance;
+    SVGpolyline run;            // points of the current run of linetos
+    char* keep;                 // vertices of the run kept by Ramer-Douglas-Peucker
+    double* u;                  // parameters of the points fitted by a curve
+    SVGfitRange* ranges;        // pending ranges, then ranges fitted by curves
+    int rcapacity;              // capacity of keep, u and ranges
+    double* curves;             // control points of the curves fitted (8 per curve)
+    int ncurves, ccapacity;
+    double* elements;           // elements of the simplified subpath
+    int size, capacity;
+    double error;               // Hausdorff distance between the runs and their simplification
+    int before, after;          // number of segments before and after simplification
+} SVGsimplifier;
+
+static void addElement(SVGsimplifier* s, double e) {
+    double* elements;
+    if (s->size + 1 > s->capacity) {
+        s->capacity = s->capacity ? (s->capacity << 1) : 256;
+        elements = (double*)realloc(s->elements, s->capacity*sizeof(double));
+        if (elements == NULL) {
+            printf("allocation error: simplification\n");
+            exit(1);
+        }
+        s->elements = elements;
+    }
+    s->elements[s->size++] = e;
+}
+
+static void addCommand(SVGsimplifier* s, int32_t cmd) {
+    addElement(s, 0.0);
+    *command(s->elements + s->size - 1) = cmd;
+}
+
+static void addCurve(SVGsimplifier* s, double* c) {
+    double* curves;
+    if (s->ncurves + 1 > s->ccapacity) {
+        s->ccapacity = s->ccapacity ? (s->ccapacity << 1) : 16;
+        curves = (double*)realloc(s->curves, s->ccapacity*8*sizeof(double));
+        if (curves == NULL) {
+            printf("allocation error: simplification\n");
+            exit(1);
+        }
+        s->curves = curves;
+    }
+    memcpy(s->curves + 8*s->ncurves++, c, 8*sizeof(double));
+}
+
+// squared distance of (px, py) to the line from a to b
+static double lineDistance(double* a, double* b, double px, double py) {
+    double dx = b[0] - a[0], dy = b[1] - a[1], l = dx*dx + dy*dy, t;
+    t = (l > 0.0) ? ((px - a[0])*dx + (py - a[1])*dy) / l : 0.0;
+    if (t < 0.0) t = 0.0; else if (t > 1.0) t = 1.0;
+    return sqr(a[0] + dx*t - px) + sqr(a[1] + dy*t - py);
+}
+
+//  Squared Hausdorff distance between the points first to last of the run and the
+//  segment seg replacing them, both being sampled.
+static double runDistance(SVGsimplifier* s, int first, int last, SVGsegment* seg) {
+    double* p = s->run.points;
+    double x, y, t, d, dmin, dmax = 0.0;
+    int i, k;
+    for (i = first; i <= last; i++) {
+        dmax = nsvg__maxf(dmax, segmentNearest(seg, p[2*i], p[2*i+1], &t));
+        if (i < last)
+            dmax = nsvg__maxf(dmax, segmentNearest(seg, (p[2*i] + p[2*i+2])*0.5, (p[2*i+1] + p[2*i+3])*0.5, &t));
+    }
+    for (k = 1; k < SIMPLIFY_SAMPLES; k++) {
+        segmentPoint(seg, (double)k/SIMPLIFY_SAMPLES, &x, &y);
+        for (dmin = DBL_MAX, i = first; i < last && dmin > dmax; i++)
+            if ((d = lineDistance(p + 2*i, p + 2*i + 2, x, y)) < dmin) dmin = d;
+        dmax = nsvg__maxf(dmax, dmin);
+    }
+    return dmax;
+}
+
+static double curveDistance(SVGsimplifier* s, int first, int last, double* c) {
+    SVGsegment seg;
+    seg.type = CURVETO;
+    memcpy(seg.p, c, 8*sizeof(double));
+    return runDistance(s, first, last, &seg);
+}
+
+//  Unit tangent at point i of the run towards point j (before or after i), taken to
+//  the first point at least the tolerance away, so that the noise is ignored.
+static void runTangent(SVGsimplifier* s, int i, int j, double* t) {
+    double* p = s->run.points;
+    int step = (j > i) ? 1 : -1, k;
+    double l;
+    for (k = i + step; k != j && sqr(p[2*k] - p[2*i]) + sqr(p[2*k+1] - p[2*i+1]) < sqr(s->tolerance); k += step);
+    t[0] = p[2*k] - p[2*i];
+    t[1] = p[2*k+1] - p[2*i+1];
+    l = sqrt(t[0]*t[0] + t[1]*t[1]);
+    if (l > 0.0) { t[0] /= l; t[1] /= l; }
+}
+
+// least squares cubic through the points of range r with parameters u (Schneider)
+static void fitCubic(SVGsimplifier* s, SVGfitRange* r, double* c) {
+    double* p = s->run.points;
+    double c00 = 0, c01 = 0, c11 = 0, x0 = 0, x1 = 0, det, al, ar, l, u, b0, b1, b2, b3, a0[2], a1[2], dx, dy;
+    int i;
+    c[0] = p[2*r->first]; c[1] = p[2*r->first+1];
+    c[6] = p[2*r->last];  c[7] = p[2*r->last+1];
+    l = sqrt(sqr(c[6] - c[0]) + sqr(c[7] - c[1]));
+    for (i = r->first; i <= r->last; i++) {
+        u = s->u[i];
+        b0 = (1-u)*(1-u)*(1-u); b1 = 3*u*(1-u)*(1-u); b2 = 3*u*u*(1-u); b3 = u*u*u;
+        a0[0] = r->t1[0]*b1; a0[1] = r->t1[1]*b1;
+        a1[0] = r->t2[0]*b2; a1[1] = r->t2[1]*b2;
+        c00 += a0[0]*a0[0] + a0[1]*a0[1];
+        c01 += a0[0]*a1[0] + a0[1]*a1[1];
+        c11 += a1[0]*a1[0] + a1[1]*a1[1];
+        dx = p[2*i]   - (c[0]*(b0 + b1) + c[6]*(b2 + b3));
+        dy = p[2*i+1] - (c[1]*(b0 + b1) + c[7]*(b2 + b3));
+        x0 += a0[0]*dx + a0[1]*dy;
+        x1 += a1[0]*dx + a1[1]*dy;
+    }
+    det = c00*c11 - c01*c01;
+    al = (det != 0.0) ? (x0*c11 - x1*c01) / det : 0.0;
+    ar = (det != 0.0) ? (c00*x1 - c01*x0) / det : 0.0;
+    // negative or tiny handles: the heuristic of Wu and Barsky
+    if (al < 1e-6*l || ar < 1e-6*l) al = ar = l/3.0;
+    c[2] = c[0] + r->t1[0]*al; c[3] = c[1] + r->t1[1]*al;
+    c[4] = c[6] + r->t2[0]*ar; c[5] = c[7] + r->t2[1]*ar;
+}
+
+// largest squared distance of the points of range r to cubic c, and the point reaching it
+static double fitError(SVGsimplifier* s, SVGfitRange* r, double* c, int* worst) {
+    double* p = s->run.points;
+    double x, y, d, dmax = 0.0;
+    int i;
+    *worst = (r->first + r->last) / 2;
+    for (i = r->first + 1; i < r->last; i++) {
+        x = bezierCoordinate(s->u[i], c[0], c[2], c[4], c[6]);
+        y = bezierCoordinate(s->u[i], c[1], c[3], c[5], c[7]);
+        if ((d = sqr(x - p[2*i]) + sqr(y - p[2*i+1])) > dmax) { dmax = d; *worst = i; }
+    }
+    return dmax;
+}
+
+// improves the parameters of the points of range r on cubic c by a Newton step
+static void reparameterize(SVGsimplifier* s, SVGfitRange* r, double* c) {
+    double* p = s->run.points;
+    SVGsegment seg;
+    double x, y, dx, dy, ddx, ddy, u, num, den;
+    int i;
+    seg.type = CURVETO;
+    memcpy(seg.p, c, 8*sizeof(double));
+    for (i = r->first + 1; i < r->last; i++) {
+        u = s->u[i];
+        segmentPoint(&seg, u, &x, &y);
+        segmentDerivative(&seg, u, &dx, &dy);
+        ddx = 6*(1-u)*(c[4] - 2*c[2] + c[0]) + 6*u*(c[6] - 2*c[4] + c[2]);
+        ddy = 6*(1-u)*(c[5] - 2*c[3] + c[1]) + 6*u*(c[7] - 2*c[5] + c[3]);
+        num = (x - p[2*i])*dx + (y - p[2*i+1])*dy;
+        den = dx*dx + dy*dy + (x - p[2*i])*ddx + (y - p[2*i+1])*ddy;
+        if (den != 0.0) u -= num / den;
+        s->u[i] = (u < 0.0) ? 0.0 : (u > 1.0) ? 1.0 : u;
+    }
+}
+
+//  Fits curves to the points first to last of the run, splitting the range at the
+//  worst point until each curve is within the tolerance. The curves are added in
+//  order to s->curves and their ranges to s->ranges.
+static void fitCurves(SVGsimplifier* s, int first, int last) {
+    double* p = s->run.points;
+    SVGfitRange r, *stack = s->ranges + 2*s->rcapacity;   // pending ranges, at the end of ranges
+    double c[8], d, l, tol2 = sqr(s->tolerance);
+    int n = 0, i, k, worst;
+    s->ncurves = 0;
+    r.first = first; r.last = last;
+    runTangent(s, first, last, r.t1);
+    runTangent(s, last, first, r.t2);
+    *--stack = r; n++;
+    while (n > 0) {
+        r = *stack++; n--;
+        // chord length parameterization
+        for (s->u[r.first] = 0.0, i = r.first + 1; i <= r.last; i++)
+            s->u[i] = s->u[i-1] + sqrt(sqr(p[2*i] - p[2*i-2]) + sqr(p[2*i+1] - p[2*i-1]));
+        for (l = s->u[r.last], i = r.first + 1; i <= r.last; i++) s->u[i] = (l > 0.0) ? s->u[i] / l : 1.0;
+        fitCubic(s, &r, c);
+        d = fitError(s, &r, c, &worst);
+        // close enough to be improved by moving the parameters of the points
+        for (k = 0; d > tol2 && d < 64*tol2 && k < SIMPLIFY_ITERATIONS; k++) {
+            reparameterize(s, &r, c);
+            fitCubic(s, &r, c);
+            d = fitError(s, &r, c, &worst);
+        }
+        // the points are within the tolerance, the curve between them should be too
+        if (r.last - r.first < 2 || (d <= tol2 && curveDistance(s, r.first, r.last, c) <= tol2)) {
+            s->ranges[s->ncurves] = r;
+            addCurve(s, c);
+            continue;
+        }
+        // splits at the worst point with a common tangent, the left range being popped first.
+        // Splitting near the ends gives many short curves, thus the middle is split instead.
+        if (worst < r.first + (r.last - r.first)/4 || worst > r.last - (r.last - r.first)/4)
+            worst = (r.first + r.last)/2;
+        stack -= 2; n += 2;
+        stack[1].first = worst; stack[1].last = r.last;
+        stack[0].first = r.first; stack[0].last = worst;
+        memcpy(stack[0].t1, r.t1, sizeof(r.t1));
+        memcpy(stack[1].t2, r.t2, sizeof(r.t2));
+        runTangent(s, worst, r.first, stack[0].t2);
+        runTangent(s, worst, r.last, stack[1].t1);
+        stack[0].t2[0] -= stack[1].t1[0]; stack[0].t2[1] -= stack[1].t1[1];
+        l = sqrt(sqr(stack[0].t2[0]) + sqr(stack[0].t2[1]));
+        if (l > 0.0) { stack[0].t2[0] /= l; stack[0].t2[1] /= l; }
+        stack[1].t1[0] = -stack[0].t2[0]; stack[1].t1[1] = -stack[0].t2[1];
+    }
+}
+
+// Ramer-Douglas-Peucker reduction of the points first to last of the run into s->keep
+static void reduceRun(SVGsimplifier* s, int first, int last) {
+    double* p = s->run.points;
+    SVGfitRange* stack = s->ranges;
+    double d, dmax, tol2 = sqr(s->tolerance);
+    int n = 0, a, b, i, worst;
+    memset(s->keep + first, 0, last - first + 1);
+    s->keep[first] = s->keep[last] = 1;
+    stack[n].first = first; stack[n++].last = last;
+    while (n > 0) {
+        a = stack[--n].first; b = stack[n].last;
+        for (dmax = 0.0, worst = -1, i = a + 1; i < b; i++)
+            if ((d = lineDistance(p + 2*a, p + 2*b, p[2*i], p[2*i+1])) > dmax) { dmax = d; worst = i; }
+        if (dmax <= tol2) continue;
+        s->keep[worst] = 1;
+        stack[n].first = a; stack[n++].last = worst;
+        stack[n].first = worst; stack[n++].last = b;
+    }
+}
+
+//  Adds the simplification of the points first to last of the run, which are turning
+//  by less than the corners, to the elements, and updates the Hausdorff distance.
+static void simplifyPiece(SVGsimplifier* s, int first, int last) {
+    double* p = s->run.points;
+    double *c, l1, l2, save[4], d, dmax = 0.0;
+    SVGsegment seg;
+    int i, j, nlines = 0, smooth;
+    for (i = first + 1; i <= last; i++) nlines += s->keep[i];
+    if (nlines > 3) fitCurves(s, first, last);
+    if (nlines <= 3 || 3*s->ncurves >= nlines) {
+        // the lines of the reduced polyline
+        seg.type = LINETO;
+        for (i = first, j = first + 1; j <= last; j++) {
+            if (!s->keep[j]) continue;
+            memcpy(seg.p, p + 2*i, 2*sizeof(double));
+            memcpy(seg.p + 2, p + 2*j, 2*sizeof(double));
+            dmax = nsvg__maxf(dmax, runDistance(s, i, j, &seg));
+            addCommand(s, LINETO);
+            addElement(s, p[2*j]); addElement(s, p[2*j+1]);
+            s->after++;
+            i = j;
+        }
+        s->error = nsvg__maxf(s->error, sqrt(dmax));
+        return;
+    }
+    for (i = 0; i < s->ncurves; i++) {
+        c = s->curves + 8*i;
+        d = curveDistance(s, s->ranges[i].first, s->ranges[i].last, c);
+        smooth = 0;
+        if (i > 0) {
+            // same handle lengths on both sides of the join, if the curves allow it
+            l1 = sqrt(sqr(c[2] - c[0]) + sqr(c[3] - c[1]));
+            l2 = sqrt(sqr(c[-4] - c[0]) + sqr(c[-3] - c[1]));
+            memcpy(save, c - 4, 2*sizeof(double));
+            memcpy(save + 2, c + 2, 2*sizeof(double));
+            if (l1 > 0.0 && l2 > 0.0) {
+                c[2] = c[0] + (c[2] - c[0]) * (l1 + l2) / (2*l1);
+                c[3] = c[1] + (c[3] - c[1]) * (l1 + l2) / (2*l1);
+                c[-4] = 2*c[0] - c[2];
+                c[-3] = 2*c[1] - c[3];
+                if (curveDistance(s, s->ranges[i-1].first, s->ranges[i-1].last, c - 8) <= sqr(s->tolerance) &&
+                    (d = curveDistance(s, s->ranges[i].first, s->ranges[i].last, c)) <= sqr(s->tolerance)) {
+                    smooth = 1;
+                    s->elements[s->size-4] = c[-4];    // previous curve already added
+                    s->elements[s->size-3] = c[-3];
+                } else {
+                    memcpy(c - 4, save, 2*sizeof(double));
+                    memcpy(c + 2, save + 2, 2*sizeof(double));
+                    d = curveDistance(s, s->ranges[i].first, s->ranges[i].last, c);
+                }
+            }
+        }
+        dmax = nsvg__maxf(dmax, d);
+        addCommand(s, smooth ? SCURVETO : CURVETO);
+        for (j = smooth ? 4 : 2; j < 8; j++) addElement(s, c[j]);
+        s->after++;
+    }
+    s->error = nsvg__maxf(s->error, sqrt(dmax));
+}
+
+// adds the simplification of the run of linetos to the elements, and empties the run
+static void simplifyRun(SVGsimplifier* s) {
+    double* p;
+    double ax, ay, bx, by, l;
+    int i, n, next, first, prev;
+    SVGfitRange* ranges;
+    char* keep;
+    double* u;
+    if (s->run.npoints > s->rcapacity) {
+        s->rcapacity = s->run.npoints;
+        keep = (char*)realloc(s->keep, s->rcapacity);
+        u = (double*)realloc(s->u, s->rcapacity*sizeof(double));
+        // the pending ranges of fitCurves use the second half of ranges
+        ranges = (SVGfitRange*)realloc(s->ranges, 2*s->rcapacity*sizeof(SVGfitRange));
+        if (keep) s->keep = keep;
+        if (u) s->u = u;
+        if (ranges) s->ranges = ranges;
+        if (!keep || !u || !ranges) {
+            printf("allocation error: simplification\n");
+            exit(1);
+        }
+    }
+    p = s->run.points;
+    n = s->run.npoints;
+    s->before += n - 1;
+    reduceRun(s, 0, n - 1);
+    // splits the run at the corners of the reduced polyline
+    for (first = 0, prev = 0, i = 1; i < n - 1; i++) {
+        if (!s->keep[i]) continue;
+        for (next = i + 1; !s->keep[next]; next++);
+        ax = p[2*i] - p[2*prev];    ay = p[2*i+1] - p[2*prev+1];
+        bx = p[2*next] - p[2*i];    by = p[2*next+1] - p[2*i+1];
+        l = sqrt((ax*ax + ay*ay) * (bx*bx + by*by));
+        if (l > 0.0 && (ax*bx + ay*by) < SIMPLIFY_CORNER * l) {
+            simplifyPiece(s, first, i);
+            first = i;
+        }
+        prev = i;
+    }
+    simplifyPiece(s, first, n - 1);
+    s->run.npoints = 1;
+    s->run.points[0] = p[2*n-2];
+    s->run.points[1] = p[2*n-1];
+}
+
+//
+//  Simplifies the runs of linetos of each subpath of plist within tolerance, in the
+//  coordinates of the subpaths. Returns in error the Hausdorff distance reached, and
+//  in before and after the numbers of segments.
+//
+
+static void simplifyPaths(SVGpaths* plist, double tolerance, double* error, int* before, int* after) {
+    SVGsimplifier s;
+    SVGpaths simplified;    // table of the simplified subpaths, replacing the table plist
+    SVGpath* path;
+    int i, j, nargs;
+    int32_t cmd;
+    double x, y, bounds[4], identity[6];
+    identityMatrix(identity);
+    memset(&s, 0, sizeof(SVGsimplifier));
+    memset(&simplified, 0, sizeof(SVGpaths));
+    s.tolerance = tolerance;
+    for (path = firstPath(plist); path != endPath(plist); path++) {
+        s.size = 0;
+        s.run.npoints = 0;
+        x = pathElement(path,0); y = pathElement(path,1);
+        addElement(&s, x); addElement(&s, y);
+        if (!addPoint(&s.run, x, y)) goto error;
+        for (i = 2; i < path->size; i += nargs + 1) {
+            cmd = pathCommand(path,i);
+            nargs = cmd >> 8;
+            if (cmd == LINETO) {
+                x = pathElement(path,i+1); y = pathElement(path,i+2);
+                // points repeated add nothing to the run
+                if (x == s.run.points[2*s.run.npoints-2] && y == s.run.points[2*s.run.npoints-1]) continue;
+                if (!addPoint(&s.run, x, y)) goto error;
+                continue;
+            }
+            if (s.run.npoints > 1) simplifyRun(&s);
+            addCommand(&s, cmd);
+            for (j = 1; j <= nargs; j++) addElement(&s, pathElement(path,i+j));
+            s.before++; s.after++;
+            s.run.npoints = 0;
+            if (!addPoint(&s.run, pathElement(path,i+nargs-1), pathElement(path,i+nargs))) goto error;
+        }
+        if (s.run.npoints > 1) simplifyRun(&s);
+        transformElements(s.elements, s.size, identity, 0.0, bounds);
+        if (!appendPath(&simplified, s.elements, s.size, path->precision, path->closed, bounds)) goto error;
+    }
+    if (plist) {
+        clearPaths(plist);
+        free(plist->paths);
+        free(plist->buffer);
+        *plist = simplified;
+    }
+    *error = s.error;
+    *before = s.before;
+    *after = s.after;
+    freePolyline(&s.run);
+    free(s.keep); free(s.u); free(s.ranges); free(s.curves); free(s.elements);
+    return;
+
+error:
+    printf("allocation error: simplification\n");
+    exit(1);
+}
+
+/* subpath ordering */
+
+#define ORDER_NEIGHBORS 8           // candidate subpaths of the 2-opt moves of each subpath
+#define ORDER_MAX_REVERSAL 50000    // longest run of subpaths reversed by a 2-opt move
+
+//  Endpoint of a subpath, where the pen enters or leaves it. Closed subpaths only
+//  have their initial point, open ones have both ends, so that they can be drawn
+//  backwards. The k-d tree keeps them sorted around the median of each node, with the
+//  number of endpoints not yet visited in each node, to find the nearest one quickly.
+typedef struct SVGendpoint {
+    double x, y;
+    int path;               // number of the subpath
+    int end;                // 0 for the initial point, 1 for the last one
+} SVGendpoint;
+
+typedef struct SVGkdtree {
+    SVGendpoint* points;    // the node of [lo, hi) has its splitting point at (lo + hi)/2
+    char* dims;             // splitting coordinate of each node (0 for x, 1 for y)
+    int* counts;            // number of alive points of each node
+    char* alive;
+    int* index;             // index in points of endpoint 2*path + end, or -1
+    int n;
+} SVGkdtree;
+
+static double endpointCoordinate(SVGendpoint* p, int dim) { return dim ? p->y : p->x; }
+
+// partially sorts points so that the kth one is at its place along dim
+static void selectEndpoint(SVGendpoint* points, int lo, int hi, int k, int dim) {
+    SVGendpoint tmp;
+    double pivot;
+    int i, j;
+    while (hi - lo > 1) {
+        pivot = endpointCoordinate(points + ((lo + hi) >> 1), dim);
+        for (i = lo, j = hi - 1; i <= j; ) {
+            while (endpointCoordinate(points + i, dim) < pivot) i++;
+            while (endpointCoordinate(points + j, dim) > pivot) j--;
+            if (i <= j) { tmp = points[i]; points[i] = points[j]; points[j] = tmp; i++; j--; }
+        }
+        if (k <= j) hi = j + 1;
+        else if (k >= i) lo = i;
+        else return;
+    }
+}
+
+static void buildKdNode(SVGkdtree* t, int lo, int hi) {
+    double b[4] = { DBL_MAX, DBL_MAX, -DBL_MAX, -DBL_MAX };
+    int mid = (lo + hi) >> 1, k, dim;
+    if (lo >= hi) return;
+    for (k = lo; k < hi; k++) {
+        b[0] = nsvg__minf(b[0], t->points[k].x); b[1] = nsvg__minf(b[1], t->points[k].y);
+        b[2] = nsvg__maxf(b[2], t->points[k].x); b[3] = nsvg__maxf(b[3], t->points[k].y);
+    }
+    dim = (b[3] - b[1] > b[2] - b[0]);
+    selectEndpoint(t->points, lo, hi, mid, dim);
+    t->dims[mid] = (char)dim;
+    t->counts[mid] = hi - lo;
+    buildKdNode(t, lo, mid);
+    buildKdNode(t, mid + 1, hi);
+}
+
+static void freeKdTree(SVGkdtree* t) {
+    free(t->points); free(t->dims); free(t->counts); free(t->alive); free(t->index);
+}
+
+//  Builds the k-d tree of the endpoints of the subpaths of plist. Returns 0 on
+//  allocation error.
+static int buildKdTree(SVGkdtree* t, SVGpaths* plist, int reversible) {
+    SVGpath* p;
+    int n = 0, k, np = plist->npaths;
+    memset(t, 0, sizeof(SVGkdtree));
+    t->points = (SVGendpoint*)malloc(2*np*sizeof(SVGendpoint));
+    t->dims = (char*)malloc(2*np);
+    t->counts = (int*)malloc(2*np*sizeof(int));
+    t->alive = (char*)malloc(2*np);
+    t->index = (int*)malloc(2*np*sizeof(int));
+    if (!t->points || !t->dims || !t->counts || !t->alive || !t->index) return 0;
+    for (k = 0; k < np; k++) {
+        p = plist->paths + k;
+        t->points[n].x = pathElement(p,0); t->points[n].y = pathElement(p,1);
+        t->points[n].path = k; t->points[n++].end = 0;
+        if (p->closed || !reversible) continue;
+        t->points[n].x = pathElement(p,p->size-2); t->points[n].y = pathElement(p,p->size-1);
+        t->points[n].path = k; t->points[n++].end = 1;
+    }
+    t->n = n;
+    buildKdNode(t, 0, n);
+    for (k = 0; k < 2*np; k++) t->index[k] = -1;
+    for (k = 0; k < n; k++) {
+        t->index[2*t->points[k].path + t->points[k].end] = k;
+        t->alive[k] = 1;
+    }
+    return 1;
+}
+
+// removes the endpoint at index i of the points from the search
+static void removeEndpoint(SVGkdtree* t, int i) {
+    int lo = 0, hi = t->n, mid;
+    if (i < 0 || !t->alive[i]) return;
+    t->alive[i] = 0;
+    while (lo < hi) {
+        mid = (lo + hi) >> 1;
+        t->counts[mid]--;
+        if (i == mid) return;
+        if (i < mid) hi = mid;
+        else lo = mid + 1;
+    }
+}
+
+//  Nearest alive endpoint of [lo, hi) to (x, y) closer than sqrt(*best), whose index is
+//  stored in *nearest.
+static void nearestEndpoint(SVGkdtree* t, int lo, int hi, double x, double y, int* nearest, double* best) {
+    SVGendpoint* p;
+    double d, diff;
+    int mid;
+    while (lo < hi) {
+        mid = (lo + hi) >> 1;
+        if (t->counts[mid] == 0) return;
+        p = t->points + mid;
+        if (t->alive[mid] && (d = sqr(p->x - x) + sqr(p->y - y)) < *best) {
+            *best = d;
+            *nearest = mid;
+        }
+        diff = t->dims[mid] ? y - p->y : x - p->x;
+        if (diff < 0.0) {
+            nearestEndpoint(t, lo, mid, x, y, nearest, best);
+            if (diff*diff >= *best) return;
+            lo = mid + 1;
+        } else {
+            nearestEndpoint(t, mid + 1, hi, x, y, nearest, best);
+            if (diff*diff >= *best) return;
+            hi = mid;
+        }
+    }
+}
+
+//  The k nearest endpoints of [lo, hi) to (x, y) which aren't endpoints of path, kept
+//  in ids and their squared distances in ds, sorted by distance.
+static void nearestEndpoints(SVGkdtree* t, int lo, int hi, double x, double y, int path,
+                             int k, int* ids, double* ds) {
+    SVGendpoint* p;
+    double d, diff;
+    int mid, j;
+    while (lo < hi) {
+        mid = (lo + hi) >> 1;
+        p = t->points + mid;
+        d = sqr(p->x - x) + sqr(p->y - y);
+        if (p->path != path && d < ds[k-1]) {
+            for (j = k - 1; j > 0 && ds[j-1] > d; j--) { ds[j] = ds[j-1]; ids[j] = ids[j-1]; }
+            ds[j] = d;
+            ids[j] = p->path;
+        }
+        diff = t->dims[mid] ? y - p->y : x - p->x;
+        if (diff < 0.0) {
+            nearestEndpoints(t, lo, mid, x, y, path, k, ids, ds);
+            if (diff*diff >= ds[k-1]) return;
+            lo = mid + 1;
+        } else {
+            nearestEndpoints(t, mid + 1, hi, x, y, path, k, ids, ds);
+            if (diff*diff >= ds[k-1]) return;
+            hi = mid;
+        }
+    }
+}
+
+//  Order of the subpaths: order[k] is the kth subpath drawn, backwards if reversed[k]
+//  (closed subpaths start and end at the same point, they are never drawn backwards).
+//  The pen starts at the origin and stays where the last subpath ends.
+typedef struct SVGtour {
+    int* order;
+    char* reversed;
+    int* position;          // position in order of each subpath
+    double* ends;           // initial and last points of each subpath
+    int n;
+} SVGtour;
+
+// point where the pen enters (end = 0) or leaves (end = 1) the subpath at position k
+static void tourPoint(SVGtour* t, int k, int end, double* x, double* y) {
+    double* e;
+    if (k < 0) { *x = *y = 0.0; return; }
+    e = t->ends + 4*t->order[k] + ((end != t->reversed[k]) ? 2 : 0);
+    *x = e[0];
+    *y = e[1];
+}
+
+// length of the move between positions a and b
+static double tourMove(SVGtour* t, int a, int b) {
+    double x0, y0, x1, y1;
+    if (b >= t->n) return 0.0;
+    tourPoint(t, a, 1, &x0, &y0);
+    tourPoint(t, b, 0, &x1, &y1);
+    return norm(x1 - x0, y1 - y0);
+}
+
+static double tourLength(SVGtour* t) {
+    double len = 0.0;
+    int k;
+    for (k = 0; k < t->n; k++) len += tourMove(t, k - 1, k);
+    return len;
+}
+
+//  Gain of the 2-opt move drawing the subpaths at positions a+1 to b in the reverse
+//  order and backwards. Only the moves into a+1 and out of b change.
+static double reversalGain(SVGtour* t, int a, int b) {
+    double xa, ya, xb, yb, xc, yc, xd, yd, gain;
+    tourPoint(t, a, 1, &xa, &ya);
+    tourPoint(t, a + 1, 0, &xc, &yc);
+    tourPoint(t, b, 1, &xb, &yb);
+    gain = norm(xc - xa, yc - ya) - norm(xb - xa, yb - ya);
+    if (b + 1 < t->n) {
+        tourPoint(t, b + 1, 0, &xd, &yd);
+        gain += norm(xd - xb, yd - yb) - norm(xd - xc, yd - yc);
+    }
+    return gain;
+}
+
+static void reverseTour(SVGtour* t, int a, int b) {
+    int i, j, k;
+    char r;
+    for (i = a + 1, j = b; i <= j; i++, j--) {
+        k = t->order[i]; t->order[i] = t->order[j]; t->order[j] = k;
+        r = t->reversed[i]; t->reversed[i] = !t->reversed[j]; t->reversed[j] = !r;
+        t->position[t->order[i]] = i;
+        t->position[t->order[j]] = j;
+    }
+}
+
+//
+//  Improves the tour with 2-opt moves between each subpath and its nearest subpaths,
+//  until no move shortens it. The subpaths whose moves changed are queued again.
+//
+static int improveTour(SVGtour* t, SVGkdtree* tree, SVGpaths* plist) {
+    SVGpath* path;
+    int *neighbors, *queue, ids[2*ORDER_NEIGHBORS];
+    char* queued;
+    double ds[2*ORDER_NEIGHBORS];
+    int n = t->n, head = 0, count = n, u, v, k, j, p, q, a, b, m, c, moved[4];
+    neighbors = (int*)malloc(n*ORDER_NEIGHBORS*sizeof(int));
+    queue = (int*)malloc(n*sizeof(int));
+    queued = (char*)malloc(n);
+    if (!neighbors || !queue || !queued) { free(neighbors); free(queue); free(queued); return 0; }
+    // nearest subpaths of each subpath, from both of its ends
+    for (u = 0; u < n; u++) {
+        path = plist->paths + u;
+        for (k = 0; k < 2*ORDER_NEIGHBORS; k++) { ids[k] = -1; ds[k] = DBL_MAX; }
+        nearestEndpoints(tree, 0, tree->n, pathElement(path,0), pathElement(path,1),
+                         u, 2*ORDER_NEIGHBORS, ids, ds);
+        if (!path->closed)
+            nearestEndpoints(tree, 0, tree->n, pathElement(path,path->size-2), pathElement(path,path->size-1),
+                             u, 2*ORDER_NEIGHBORS, ids, ds);
+        for (k = 0, m = 0; k < 2*ORDER_NEIGHBORS && m < ORDER_NEIGHBORS && ids[k] >= 0; k++) {
+            for (j = 0; j < m && neighbors[u*ORDER_NEIGHBORS + j] != ids[k]; j++);
+            if (j == m) neighbors[u*ORDER_NEIGHBORS + m++] = ids[k];
+        }
+        for (; m < ORDER_NEIGHBORS; m++) neighbors[u*ORDER_NEIGHBORS + m] = -1;
+        queue[u] = t->order[u];
+        queued[u] = 1;
+    }
+    while (count > 0) {
+        u = queue[head];
+        head = (head + 1) % n;
+        count--;
+        queued[u] = 0;
+        for (k = 0; k < ORDER_NEIGHBORS && (v = neighbors[u*ORDER_NEIGHBORS + k]) >= 0; k++) {
+            p = t->position[u];
+            q = t->position[v];
+            // the move joining the exits of both subpaths, then the one joining their entries
+            for (c = 0; c < 2; c++) {
+                a = (p < q ? p : q) - c;
+                b = (p < q ? q : p) - c;
+                if (b - a > ORDER_MAX_REVERSAL || reversalGain(t, a, b) <= 1e-9) continue;
+                reverseTour(t, a, b);
+                moved[0] = a; moved[1] = a + 1; moved[2] = b; moved[3] = b + 1;
+                for (j = 0; j < 4; j++) {
+                    if (moved[j] < 0 || moved[j] >= n || queued[m = t->order[moved[j]]]) continue;
+                    queue[(head + count++) % n] = m;
+                    queued[m] = 1;
+                }
+                p = t->position[u];
+                q = t->position[v];
+            }
+        }
+    }
+    free(neighbors); free(queue); free(queued);
+    return 1;
+}
+
+//  Copies the elements of subpath p in e, drawn backwards if reversed. Smooth commands
+//  then get their control points, and arcs the opposite sweep. Returns the size of e,
+//  which needs up to 7/3 of the size of p.
+static int subpathElements(SVGpath* p, int reversed, double* e) {
+    SVGsegmentIterator it;
+    SVGsegment s;
+    int size = 2, k;
+    int32_t cmd;
+    if (!reversed) {
+        e[0] = pathElement(p,0); e[1] = pathElement(p,1);
+        for (size = 2; size < p->size; size += (cmd >> 8) + 1) {
+            *command(e+size) = cmd = pathCommand(p,size);
+            for (k = 1; k <= (cmd >> 8); k++) e[size+k] = pathElement(p,size+k);
+        }
+        return size;
+    }
+    // the first segment is written last: its offset is known once all are counted
+    beginSegments(&it, p);
+    while (nextSegment(&it, &s))
+        size += (s.type == ARCTO) ? 8 : (s.type == CURVETO) ? 7 : (s.type == QUADTO) ? 5 : 3;
+    e[0] = pathElement(p,p->size-2); e[1] = pathElement(p,p->size-1);
+    k = size;
+    beginSegments(&it, p);
+    while (nextSegment(&it, &s)) {
+        switch (s.type) {
+            case LINETO:
+                k -= 3;
+                *command(e+k) = LINETO;
+                e[k+1] = s.p[0]; e[k+2] = s.p[1];
+                break;
+            case QUADTO:
+                k -= 5;
+                *command(e+k) = QUADTO;
+                e[k+1] = s.p[2]; e[k+2] = s.p[3];
+                e[k+3] = s.p[0]; e[k+4] = s.p[1];
+                break;
+            case CURVETO:
+                k -= 7;
+                *command(e+k) = CURVETO;
+                e[k+1] = s.p[4]; e[k+2] = s.p[5];
+                e[k+3] = s.p[2]; e[k+4] = s.p[3];
+                e[k+5] = s.p[0]; e[k+6] = s.p[1];
+                break;
+            default:
+                k -= 8;
+                *command(e+k) = ARCTO;
+                e[k+1] = pathElement(p,s.index+1); e[k+2] = pathElement(p,s.index+2);
+                e[k+3] = pathElement(p,s.index+3); e[k+4] = pathElement(p,s.index+4);
+                e[k+5] = (pathElement(p,s.index+5) != 0.0) ? 0.0 : 1.0;
+                e[k+6] = s.p[0]; e[k+7] = s.p[1];
+                break;
+        }
+    }
+    return size;
+}
+
+//
+//  Reorders the subpaths of plist, drawing open ones backwards when it helps and if
+//  reversible, to shorten the moves of the pen between them, starting from the
+//  origin. The tour is built by nearest neighbour and improved by 2-opt. A 2-opt move
+//  draws a run of subpaths backwards, so that it is only done if reversible or if
+//  all the subpaths are closed. Returns in lengths the total move before, after
+//  nearest neighbour and after 2-opt, or 0 on allocation error.
+//
+static int reorderPaths(SVGpaths* plist, int reversible, double* lengths) {
+    SVGpaths ordered;
+    SVGkdtree tree;
+    SVGtour t;
+    SVGpath* p;
+    double x = 0.0, y = 0.0, best, bounds[4], *e = NULL;
+    int k, i, n, size = 0, ok = 0, open = 0;
+    memset(&t, 0, sizeof(SVGtour));
+    memset(&ordered, 0, sizeof(SVGpaths));
+    lengths[0] = lengths[1] = lengths[2] = 0.0;
+    if (plist == NULL || (n = plist->npaths) == 0) return 1;
+    t.n = n;
+    t.order = (int*)malloc(n*sizeof(int));
+    t.reversed = (char*)malloc(n);
+    t.position = (int*)malloc(n*sizeof(int));
+    t.ends = (double*)malloc(4*n*sizeof(double));
+    if (!buildKdTree(&tree, plist, reversible) || !t.order || !t.reversed || !t.position || !t.ends) goto done;
+    for (k = 0; k < n; k++) {
+        p = plist->paths + k;
+        t.order[k] = k;
+        t.reversed[k] = 0;
+        t.ends[4*k] = pathElement(p,0);
+        t.ends[4*k+1] = pathElement(p,1);
+        t.ends[4*k+2] = pathElement(p,p->size-2);
+        t.ends[4*k+3] = pathElement(p,p->size-1);
+        open += !p->closed;
+    }
+    lengths[0] = tourLength(&t);
+    for (k = 0; k < n; k++) {
+        best = DBL_MAX;
+        i = -1;
+        nearestEndpoint(&tree, 0, tree.n, x, y, &i, &best);
+        t.order[k] = tree.points[i].path;
+        t.reversed[k] = (char)tree.points[i].end;
+        t.position[t.order[k]] = k;
+        removeEndpoint(&tree, tree.index[2*t.order[k]]);
+        removeEndpoint(&tree, tree.index[2*t.order[k] + 1]);
+        tourPoint(&t, k, 1, &x, &y);
+    }
+    lengths[1] = tourLength(&t);
+    if ((reversible || open == 0) && !improveTour(&t, &tree, plist)) goto done;
+    lengths[2] = tourLength(&t);
+    // the subpaths are copied in their new order to a new table
+    for (k = 0; k < n; k++) if (plist->paths[k].size > size) size = plist->paths[k].size;
+    if ((e = (double*)malloc(3*size*sizeof(double))) == NULL) goto done;
+    for (k = 0; k < n; k++) {
+        p = plist->paths + t.order[k];
+        size = subpathElements(p, t.reversed[k] && !p->closed, e);
+        memcpy(bounds, p->bounds, sizeof(bounds));
+        if (!appendPath(&ordered, e, size, p->precision, p->closed, bounds)) goto done;
+    }
+    clearPaths(plist);
+    free(plist->paths);
+    free(plist->buffer);
+    *plist = ordered;
+    memset(&ordered, 0, sizeof(SVGpaths));
+    ok = 1;
+
+done:
+    free(e);
+    free(ordered.paths);
+    free(ordered.buffer);
+    freeKdTree(&tree);
+    free(t.order); free(t.reversed); free(t.position); free(t.ends);
+    return ok;
+}
+
+/* rectangle clipping */
+
+//  Paths are clipped for filling. A line x = c or y = c splits each subpath, closed
+//  by a line if it is open, in a subpath on each side, like the Sutherland-Hodgman
+//  clipping of polygons: the segments are split exactly where they cross the line
+//  (curves are subdivided and arcs keep their ellipse between the crossings), the
+//  pieces on each side are kept in their order, and the gaps between them are closed
+//  along the line. This keeps the winding number of every point of each side, hence
+//  the fill whatever the fill rule. A rectangle is clipped by the 4 lines of its
+//  sides. A grid of tiles is clipped in one pass, by splitting the path in two at the
+//  middle column or row of the grid and each half recursively, so that each segment
+//  is split by O(log(tiles)) lines instead of 4 lines per tile.
+
+#define CLIP_EPSILON 1e-12      // pieces of segments shorter than this parameter are skipped
+
+//  Subpath being built on one side of the line, in the elements format of SVGpath,
+//  and the table receiving the subpaths of that side.
+typedef struct SVGclipSide {
+    SVGpaths* plist;        // subpaths of this side, NULL if this side is discarded
+    double* e;
+    int size, capacity;
+    int area;               // flag indicating a piece is strictly on this side
+} SVGclipSide;
+
+//  Clipped tiles of a grid of columns x rows tiles of width x height, whose first
+//  tile has its top left corner at (x, y). Each non-empty tile is passed to function
+//  tile with its column, its row and the table of its subpaths.
+typedef struct SVGgrid {
+    double x, y, width, height;
+    int columns, rows;
+    void (*tile)(void* data, int column, int row, SVGpaths* plist);
+    void* data;
+    int tiles;              // number of non-empty tiles
+} SVGgrid;
+
+//  Point at the blossom t[0..degree-1] of the Bezier curve of degree degree whose
+//  points are p. The points of the curve between u and v are the blossoms (u, u),
+//  (u, v), (v, v) for a quadratic curve and (u, u, u), (u, u, v), (u, v, v), (v, v, v)
+//  for a cubic curve.
+static void blossomPoint(double* p, int degree, double* t, double* x, double* y) {
+    double q[8];
+    int k, i;
+    memcpy(q, p, 2*(degree+1)*sizeof(double));
+    for (k = 0; k < degree; k++)
+        for (i = 0; i < 2*(degree - k); i++)
+            q[i] += (q[i+2] - q[i]) * t[k];
+    *x = q[0] + 0.0;        // no negative zeros
+    *y = q[1] + 0.0;
+}
+
+// makes room for n more elements in the subpath of side s
+static int clipRoom(SVGclipSide* s, int n) {
+    double* e;
+    int capacity;
+    if (s->size + n <= s->capacity) return 1;
+    capacity = s->capacity ? 2*s->capacity : 64;
+    while (capacity < s->size + n) capacity *= 2;
+    if ((e = (double*)realloc(s->e, capacity*sizeof(double))) == NULL) return 0;
+    s->e = e;
+    s->capacity = capacity;
+    return 1;
+}
+
+//  Appends a line to (x, y) to side s. A line continuing the previous line along the
+//  same horizontal or vertical line extends it, or shortens it when it goes back,
+//  which removes the back and forth of the joins along the clipping lines.
+static int clipLine(SVGclipSide* s, double x, double y) {
+    double* e = s->e + s->size - 3;
+    if (s->size >= 5 && *command(e) == LINETO &&
+        ((e[-2] == e[1] && e[1] == x) || (e[-1] == e[2] && e[2] == y))) {
+        if (e[-2] == x && e[-1] == y) s->size -= 3;     // back to the start of the line
+        else { e[1] = x; e[2] = y; }
+        return 1;
+    }
+    if (!clipRoom(s, 3)) return 0;
+    *command(s->e + s->size) = LINETO;
+    s->e[s->size+1] = x;
+    s->e[s->size+2] = y;
+    s->size += 3;
+    return 1;
+}
+
+//
+//  Appends to side s the piece of segment g between parameters t0 and t1, from point
+//  a to point b. The first piece starts the subpath, and a piece not starting where
+//  the previous one ended is joined to it by a line, along the clipping line.
+//
+static int clipPiece(SVGclipSide* s, SVGsegment* g, double t0, double t1, double* a, double* b) {
+    double t[3], *e;
+    double da;
+    if (s->size == 0) {
+        if (!clipRoom(s, 2)) return 0;
+        s->e[0] = a[0];
+        s->e[1] = a[1];
+        s->size = 2;
+    } else if (s->e[s->size-2] != a[0] || s->e[s->size-1] != a[1]) {
+        if (!clipLine(s, a[0], a[1])) return 0;
+    }
+    if (!clipRoom(s, 8)) return 0;
+    e = s->e + s->size;
+    switch (g->type) {
+        case LINETO:
+            return clipLine(s, b[0], b[1]);
+        case QUADTO:
+            *command(e) = QUADTO;
+            t[0] = t0; t[1] = t1;
+            blossomPoint(g->p, 2, t, e+1, e+2);
+            e[3] = b[0]; e[4] = b[1];
+            s->size += 5;
+            return 1;
+        case CURVETO:
+            *command(e) = CURVETO;
+            t[0] = t0; t[1] = t0; t[2] = t1;
+            blossomPoint(g->p, 3, t, e+1, e+2);
+            t[1] = t1;
+            blossomPoint(g->p, 3, t, e+3, e+4);
+            e[5] = b[0]; e[6] = b[1];
+            s->size += 7;
+            return 1;
+    }
+    // an arc keeps its ellipse, the flags being those of the sweep between t0 and t1
+    da = g->arc[6] * (t1 - t0);
+    *command(e) = ARCTO;
+    e[1] = g->arc[2];
+    e[2] = g->arc[3];
+    e[3] = g->arc[4] * 180.0 / NSVG_PI;
+    e[4] = (fabs(da) > NSVG_PI) ? 1.0 : 0.0;
+    e[5] = (da > 0.0) ? 1.0 : 0.0;
+    e[6] = b[0]; e[7] = b[1];
+    s->size += 8;
+    return 1;
+}
+
+//  Replaces the bounds of subpath p by the bounds of its segments, which contain the
+//  arcs and the reflected control points of the smooth curves, so that a subpath
+//  whose bounds are on one side of a line is entirely on that side.
+static void clipBounds(SVGpath* p) {
+    SVGsegmentIterator it;
+    SVGsegment g;
+    double b[4];
+    p->bounds[0] = p->bounds[2] = pathElement(p,0);
+    p->bounds[1] = p->bounds[3] = pathElement(p,1);
+    beginSegments(&it, p);
+    while (nextSegment(&it, &g)) {
+        segmentBounds(&g, b);
+        p->bounds[0] = nsvg__minf(p->bounds[0], b[0]); p->bounds[1] = nsvg__minf(p->bounds[1], b[1]);
+        p->bounds[2] = nsvg__maxf(p->bounds[2], b[2]); p->bounds[3] = nsvg__maxf(p->bounds[3], b[3]);
+    }
+}
+
+// closes the subpath of side s and appends it to the table of the side, if it has an area
+static int clipClose(SVGclipSide* s) {
+    SVGpath* p;
+    double bounds[4] = { 0.0, 0.0, 0.0, 0.0 };
+    int ok = 1;
+    if (s->size > 2 && s->area && s->plist) {
+        if (s->e[s->size-2] != s->e[0] || s->e[s->size-1] != s->e[1])
+            ok = clipLine(s, s->e[0], s->e[1]);
+        ok = ok && (p = appendPath(s->plist, s->e, s->size, PRECISION_DOUBLE, 1, bounds)) != NULL;
+        if (ok) clipBounds(p);
+    }
+    s->size = 0;
+    s->area = 0;
+    return ok;
+}
+
+//  Copies subpath p in double precision to the table of side s, with the bounds of
+//  its segments if bounded is not zero.
+static int clipWhole(SVGclipSide* s, SVGpath* p, int bounded) {
+    SVGpath* q;
+    int i, j, nargs;
+    int32_t cmd;
+    if (s->plist == NULL) return 1;
+    if (p->precision == PRECISION_DOUBLE)
+        q = appendPath(s->plist, (double*)p->elements, p->size, PRECISION_DOUBLE, p->closed, p->bounds);
+    else {
+        if (!clipRoom(s, p->size)) return 0;
+        s->e[0] = pathElement(p,0);
+        s->e[1] = pathElement(p,1);
+        for (i = 2; i < p->size; i += nargs + 1) {
+            *command(s->e + i) = cmd = pathCommand(p,i);
+            nargs = cmd >> 8;
+            for (j = 1; j <= nargs; j++) s->e[i+j] = pathElement(p,i+j);
+        }
+        q = appendPath(s->plist, s->e, p->size, PRECISION_DOUBLE, p->closed, p->bounds);
+    }
+    if (q && bounded) clipBounds(q);
+    return q != NULL;
+}
+
+// splits segment g by the line where coordinate axis is c, between the two sides
+static int clipSegment(SVGclipSide* sides, SVGsegment* g, int axis, double c) {
+    double ts[6], pts[12], m;
+    int dirs[4], n, k, side;
+    n = segmentCrossings(g, axis, c, ts + 1, dirs) + 1;
+    ts[0] = 0.0;
+    ts[n] = 1.0;
+    pts[0] = g->p[0];
+    pts[1] = g->p[1];
+    for (k = 1; k < n; k++) {
+        // the crossings are exactly on the line, so that the joins follow it
+        segmentPoint(g, ts[k], pts + 2*k, pts + 2*k + 1);
+        pts[2*k + axis] = c;
+    }
+    pts[2*n] = g->p[segmentEnd(g)];
+    pts[2*n + 1] = g->p[segmentEnd(g) + 1];
+    for (k = 0; k < n; k++) {
+        if (ts[k+1] - ts[k] < CLIP_EPSILON) continue;
+        m = segmentCoordinate(g, axis, (ts[k] + ts[k+1]) * 0.5);
+        side = (m > c);
+        if (m != c) sides[side].area = 1;
+        if (!clipPiece(sides + side, g, ts[k], ts[k+1], pts + 2*k, pts + 2*k + 2)) return 0;
+    }
+    return 1;
+}
+
+//
+//  Splits the subpaths of plist by the line where coordinate axis (0 for x, 1 for y)
+//  is c, appending the parts where it is below c to lo and the parts where it is above
+//  c to hi. lo or hi may be NULL to discard a side. Returns 0 on allocation error.
+//
+static int splitPaths(SVGpaths* plist, int axis, double c, SVGpaths* lo, SVGpaths* hi) {
+    SVGclipSide sides[2];
+    SVGsegmentIterator it;
+    SVGsegment g;
+    SVGpath* p;
+    int ok = 1;
+    memset(sides, 0, sizeof(sides));
+    sides[0].plist = lo;
+    sides[1].plist = hi;
+    for (p = firstPath(plist); ok && p != endPath(plist); p++) {
+        if (p->bounds[axis+2] <= c) { ok = clipWhole(sides, p, 0); continue; }
+        if (p->bounds[axis] >= c) { ok = clipWhole(sides + 1, p, 0); continue; }
+        beginSegments(&it, p);
+        while (ok && nextSegment(&it, &g)) ok = clipSegment(sides, &g, axis, c);
+        if (ok && (it.cpx != pathElement(p,0) || it.cpy != pathElement(p,1))) {
+            // the line closing an open subpath
+            g.type = LINETO;
+            g.p[0] = it.cpx; g.p[1] = it.cpy;
+            g.p[2] = pathElement(p,0); g.p[3] = pathElement(p,1);
+            ok = clipSegment(sides, &g, axis, c);
+        }
+        ok = ok && clipClose(sides) && clipClose(sides + 1);
+    }
+    free(sides[0].e);
+    free(sides[1].e);
+    return ok;
+}
+
+//  Clips plist to the rectangle r = [xmin, ymin, xmax, ymax], appending the result to
+//  clipped. Returns 0 on allocation error.
+static int clipRect(SVGpaths* plist, double* r, SVGpaths* clipped) {
+    SVGpaths* t[4] = { createPaths(), createPaths(), createPaths(), createPaths() };
+    SVGclipSide s;
+    SVGpath* p;
+    int ok = t[0] && t[1] && t[2] && t[3];
+    // the bounds of the subpaths of the source only contain their points
+    memset(&s, 0, sizeof(SVGclipSide));
+    s.plist = t[3];
+    for (p = firstPath(plist); ok && p != endPath(plist); p++) ok = clipWhole(&s, p, 1);
+    free(s.e);
+    ok = ok && splitPaths(t[3], 0, r[0], NULL, t[0]) && splitPaths(t[0], 0, r[2], t[1], NULL) &&
+               splitPaths(t[1], 1, r[1], NULL, t[2]) && splitPaths(t[2], 1, r[3], clipped, NULL);
+    nsvg__deletePaths(t[0]);
+    nsvg__deletePaths(t[1]);
+    nsvg__deletePaths(t[2]);
+    nsvg__deletePaths(t[3]);
+    return ok;
+}
+
+// clips plist, inside columns c0 to c1 - 1 and rows r0 to r1 - 1 of g, in the tiles of g
+static int clipGrid(SVGgrid* g, SVGpaths* plist, int c0, int c1, int r0, int r1) {
+    SVGpaths *lo, *hi;
+    int m, ok;
+    if (plist->npaths == 0) return 1;
+    if (c1 - c0 == 1 && r1 - r0 == 1) {
+        g->tiles++;
+        g->tile(g->data, c0, r0, plist);
+        return 1;
+    }
+    lo = createPaths();
+    hi = createPaths();
+    if (c1 - c0 >= r1 - r0) {
+        m = (c0 + c1) / 2;
+        ok = lo && hi && splitPaths(plist, 0, g->x + m*g->width, lo, hi) &&
+             clipGrid(g, lo, c0, m, r0, r1) && clipGrid(g, hi, m, c1, r0, r1);
+    } else {
+        m = (r0 + r1) / 2;
+        ok = lo && hi && splitPaths(plist, 1, g->y + m*g->height, lo, hi) &&
+             clipGrid(g, lo, c0, c1, r0, m) && clipGrid(g, hi, c0, c1, m, r1);
+    }
+    nsvg__deletePaths(lo);
+    nsvg__deletePaths(hi);
+    return ok;
+}
+
+//  Clips plist to the tiles of grid g, passing each non-empty tile to g->tile in no
+//  particular order. Returns 0 on allocation error.
+static int clipTiles(SVGpaths* plist, SVGgrid* g) {
+    SVGpaths* inside = createPaths();
+    double r[4];
+    int ok;
+    g->tiles = 0;
+    r[0] = g->x; r[2] = g->x + g->columns*g->width;
+    r[1] = g->y; r[3] = g->y + g->rows*g->height;
+    ok = inside && clipRect(plist, r, inside) && clipGrid(g, inside, 0, g->columns, 0, g->rows);
+    nsvg__deletePaths(inside);
+    return ok;
+}
+
+/* stroking */
+
+//  A stroke is converted to the outline of the area it paints, to be filled with the
+//  nonzero rule. An open subpath gives one contour going along the left side of its
+//  segments, around the end cap, back along the right side and around the start cap.
+//  A closed subpath gives two contours, one per side, going in opposite directions.
+//  The sides are offset curves: lines stay lines, circular arcs stay arcs of the same
+//  center, and the other curves are converted to cubic curves, offset as cubic curves
+//  whose handles are scaled by the curvature at their ends, and split until they are
+//  within the tolerance. At a corner the outer side gets the join, and the inner side
+//  goes through the corner itself, which keeps the inside of the corner covered
+//  whatever the lengths of the segments. Where a curve turns tighter than the half
+//  width, the offset of its inner side turns back and its loop cancels the outer
+//  side: a disc, as a contour of its own, covers it again.
+
+#define STROKE_TOLERANCE 0.01   // default distance of the offset curves to the exact offsets
+#define STROKE_DEPTH 8          // most subdivisions of a cubic curve
+#define STROKE_SMOOTH 1e-2      // sine of the turn of a corner drawn without join
+#define STROKE_SAMPLES 32       // curvature samples of a cubic curve, for its cusps
+
+#define JOIN_MITER 0
+#define JOIN_ROUND 1
+#define JOIN_BEVEL 2
+#define CAP_BUTT 0
+#define CAP_ROUND 1
+#define CAP_SQUARE 2
+
+typedef struct SVGstrokeStyle {
+    double width;
+    int join;               // JOIN_MITER, JOIN_ROUND or JOIN_BEVEL
+    int cap;                // CAP_BUTT, CAP_ROUND or CAP_SQUARE
+    double miterLimit;      // longest miter, in stroke widths
+    double tolerance;
+} SVGstrokeStyle;
+
+//  Segment of a subpath to be stroked: a line from p[0..1] to p[2..3], a cubic curve
+//  p[0..7], or a circular arc from p[0..1] to p[2..3] whose center, radius, start
+//  angle and sweep angle are in arc.
+typedef struct SVGstrokePiece {
+    int32_t type;           // LINETO, CURVETO or ARCTO
+    double p[8];
+    double arc[5];
+} SVGstrokePiece;
+
+typedef struct SVGstroker {
+    SVGstrokeStyle* style;
+    double d;               // half width
+    SVGstrokePiece* pieces; // segments of the subpath being stroked
+    int npieces, capacity;
+    double* e;              // contour being built, in the elements format of SVGpath
+    int size, ecapacity;
+    SVGpaths* outline;
+} SVGstroker;
+
+static double crossProduct(double ax, double ay, double bx, double by) { return ax*by - ay*bx; }
+
+// makes room for n more elements in the contour
+static int strokeRoom(SVGstroker* k, int n) {
+    double* e;
+    int capacity;
+    if (k->size + n <= k->ecapacity) return 1;
+    capacity = k->ecapacity ? 2*k->ecapacity : 256;
+    while (capacity < k->size + n) capacity *= 2;
+    if ((e = (double*)realloc(k->e, capacity*sizeof(double))) == NULL) return 0;
+    k->e = e;
+    k->ecapacity = capacity;
+    return 1;
+}
+
+static int strokeStart(SVGstroker* k, double x, double y) {
+    k->size = 0;
+    if (!strokeRoom(k, 2)) return 0;
+    k->e[0] = x;
+    k->e[1] = y;
+    k->size = 2;
+    return 1;
+}
+
+//  Appends a line to (x, y), which extends the previous line when it goes on in the
+//  same direction.
+static int strokeLine(SVGstroker* k, double x, double y) {
+    double* e = k->e + k->size - 3;
+    double ux, uy, vx, vy;
+    if (e[1] == x && e[2] == y) return 1;
+    if (k->size >= 5 && *command(e) == LINETO) {
+        ux = e[1] - e[-2]; uy = e[2] - e[-1];
+        vx = x - e[1]; vy = y - e[2];
+        if (ux*vx + uy*vy > 0.0 && fabs(crossProduct(ux, uy, vx, vy)) <= 1e-12 * norm(ux, uy) * norm(vx, vy)) {
+            e[1] = x;
+            e[2] = y;
+            return 1;
+        }
+    }
+    if (!strokeRoom(k, 3)) return 0;
+    *command(k->e + k->size) = LINETO;
+    k->e[k->size+1] = x;
+    k->e[k->size+2] = y;
+    k->size += 3;
+    return 1;
+}
+
+static int strokeCurve(SVGstroker* k, double* c) {
+    double* e;
+    if (!strokeRoom(k, 7)) return 0;
+    e = k->e + k->size;
+    *command(e) = CURVETO;
+    memcpy(e + 1, c, 6*sizeof(double));
+    k->size += 7;
+    return 1;
+}
+
+static int strokeArc(SVGstroker* k, double r, int large, int sweep, double x, double y) {
+    double* e;
+    if (k->e[k->size-2] == x && k->e[k->size-1] == y) return 1;
+    if (!strokeRoom(k, 8)) return 0;
+    e = k->e + k->size;
+    *command(e) = ARCTO;
+    e[1] = e[2] = r;
+    e[3] = 0.0;
+    e[4] = large;
+    e[5] = sweep;
+    e[6] = x;
+    e[7] = y;
+    k->size += 8;
+    return 1;
+}
+
+// closes the contour and appends it to the outline
+static int strokeClose(SVGstroker* k) {
+    double bounds[4] = { 0.0, 0.0, 0.0, 0.0 };
+    SVGpath* p;
+    if (k->size <= 2) return 1;
+    if (!strokeLine(k, k->e[0], k->e[1])) return 0;
+    if ((p = appendPath(k->outline, k->e, k->size, PRECISION_DOUBLE, 1, bounds)) == NULL) return 0;
+    clipBounds(p);
+    k->size = 0;
+    return 1;
+}
+
+static SVGstrokePiece* addPiece(SVGstroker* k, int32_t type, double* p, int n) {
+    SVGstrokePiece* q;
+    int capacity;
+    if (k->npieces == k->capacity) {
+        capacity = k->capacity ? 2*k->capacity : 64;
+        if ((q = (SVGstrokePiece*)realloc(k->pieces, capacity*sizeof(SVGstrokePiece))) == NULL) return NULL;
+        k->pieces = q;
+        k->capacity = capacity;
+    }
+    q = k->pieces + k->npieces++;
+    q->type = type;
+    memcpy(q->p, p, n*sizeof(double));
+    return q;
+}
+
+// curvature of cubic curve c at t, infinite at a cusp
+static double cubicCurvature(double* c, double t) {
+    double it = 1.0 - t, dx, dy, ddx, ddy, n;
+    dx = 3*it*it*(c[2]-c[0]) + 6*it*t*(c[4]-c[2]) + 3*t*t*(c[6]-c[4]);
+    dy = 3*it*it*(c[3]-c[1]) + 6*it*t*(c[5]-c[3]) + 3*t*t*(c[7]-c[5]);
+    ddx = 6*it*(c[4] - 2*c[2] + c[0]) + 6*t*(c[6] - 2*c[4] + c[2]);
+    ddy = 6*it*(c[5] - 2*c[3] + c[1]) + 6*t*(c[7] - 2*c[5] + c[3]);
+    if ((n = norm(dx, dy)) < 1e-12) return INFINITY;
+    return fabs(crossProduct(dx, dy, ddx, ddy)) / (n*n*n);
+}
+
+// appends a disc of radius r centered on (x, y) to the outline, as a contour of its own
+static int strokeDisc(SVGstroker* k, double x, double y, double r) {
+    k->size = 0;
+    return strokeStart(k, x + r, y) && strokeArc(k, r, 0, 0, x - r, y) && strokeArc(k, r, 0, 0, x + r, y) &&
+           strokeClose(k);
+}
+
+//  Adds cubic curve c as pieces split where its curvature is at a maximum sharper
+//  than the half width (a cusp, at worst). The offset of the inner side turns back
+//  there, and its loop would cancel the outer side: a disc covers the point of the
+//  maximum, as a contour of its own.
+static int addCubicPieces(SVGstroker* k, double* c) {
+    double t[3], u[STROKE_SAMPLES + 1], h[8], a, b, x, y, t0 = 0.0, d = k->d;
+    int i, j;
+    for (i = 0; i <= STROKE_SAMPLES; i++) u[i] = cubicCurvature(c, (double)i / STROKE_SAMPLES);
+    for (i = 0; i <= STROKE_SAMPLES; i++) {
+        if (u[i] * d <= 1.0 || (i > 0 && u[i] < u[i-1]) || (i < STROKE_SAMPLES && u[i] < u[i+1])) continue;
+        // golden section search of the maximum around sample i
+        a = (double)((i > 0) ? i - 1 : i) / STROKE_SAMPLES;
+        b = (double)((i < STROKE_SAMPLES) ? i + 1 : i) / STROKE_SAMPLES;
+        for (j = 0; j < 40; j++) {
+            x = b - (b - a)*0.618033988749895;
+            y = a + (b - a)*0.618033988749895;
+            if (cubicCurvature(c, x) < cubicCurvature(c, y)) a = x;
+            else b = y;
+        }
+        x = (a + b)*0.5;
+        if (!strokeDisc(k, bezierCoordinate(x, c[0], c[2], c[4], c[6]), bezierCoordinate(x, c[1], c[3], c[5], c[7]), d))
+            return 0;
+        if (x < 1e-6 || x > 1.0 - 1e-6 || x <= t0 + 1e-6) continue;
+        t[0] = t[1] = t[2] = t0;
+        blossomPoint(c, 3, t, h, h+1);
+        t[2] = x;
+        blossomPoint(c, 3, t, h+2, h+3);
+        t[1] = x;
+        blossomPoint(c, 3, t, h+4, h+5);
+        t[0] = x;
+        blossomPoint(c, 3, t, h+6, h+7);
+        if (addPiece(k, CURVETO, h, 8) == NULL) return 0;
+        t0 = x;
+    }
+    t[0] = t[1] = t[2] = t0;
+    blossomPoint(c, 3, t, h, h+1);
+    t[2] = 1.0;
+    blossomPoint(c, 3, t, h+2, h+3);
+    t[1] = 1.0;
+    blossomPoint(c, 3, t, h+4, h+5);
+    h[6] = c[6]; h[7] = c[7];
+    return addPiece(k, CURVETO, h, 8) != NULL;
+}
+
+//  Converts the segments of subpath path to pieces, skipping those of null length:
+//  quadratic curves are elevated to cubic curves, and elliptical arcs are converted
+//  to cubic curves of at most 90 degrees each, split where their curvature peaks.
+static int collectPieces(SVGstroker* k, SVGpath* path) {
+    SVGsegmentIterator it;
+    SVGsegment s;
+    SVGstrokePiece* q;
+    double* p = s.p;
+    double c[8], cs, sn, a, da, h, ca, sa;
+    int i, n;
+    k->npieces = 0;
+    beginSegments(&it, path);
+    while (nextSegment(&it, &s)) {
+        switch (s.type) {
+            case LINETO:
+                if (p[0] == p[2] && p[1] == p[3]) continue;
+                if (addPiece(k, LINETO, p, 4) == NULL) return 0;
+                continue;
+            case QUADTO:
+                if (p[0] == p[4] && p[1] == p[5] && p[0] == p[2] && p[1] == p[3]) continue;
+                c[0] = p[0]; c[1] = p[1];
+                c[2] = p[0] + (p[2]-p[0])*2.0/3.0; c[3] = p[1] + (p[3]-p[1])*2.0/3.0;
+                c[4] = p[4] + (p[2]-p[4])*2.0/3.0; c[5] = p[5] + (p[3]-p[5])*2.0/3.0;
+                c[6] = p[4]; c[7] = p[5];
+                if (!addCubicPieces(k, c)) return 0;
+                continue;
+            case CURVETO:
+                if (p[0] == p[6] && p[1] == p[7] && p[0] == p[2] && p[1] == p[3] && p[0] == p[4] && p[1] == p[5])
+                    continue;
+                if (!addCubicPieces(k, p)) return 0;
+                continue;
+        }
+        if (fabs(s.arc[2] - s.arc[3]) <= 1e-9 * s.arc[2]) {
+            if ((q = addPiece(k, ARCTO, p, 4)) == NULL) return 0;
+            q->arc[0] = s.arc[0];
+            q->arc[1] = s.arc[1];
+            q->arc[2] = s.arc[2];
+            q->arc[3] = s.arc[5] + s.arc[4];
+            q->arc[4] = s.arc[6];
+            // the offset of the inner side is on the other side of the center
+            if (s.arc[2] < k->d && !strokeDisc(k, s.arc[0], s.arc[1], k->d - s.arc[2])) return 0;
+            continue;
+        }
+        // as addArcCubics does
+        cs = cos(s.arc[4]); sn = sin(s.arc[4]);
+        n = (int)ceil(fabs(s.arc[6]) / (NSVG_PI*0.5) - 1e-9);
+        if (n < 1) n = 1;
+        da = s.arc[6] / n;
+        h = 4.0/3.0 * tan(da*0.25);
+        c[6] = p[0]; c[7] = p[1];
+        a = s.arc[5];
+        ca = cos(a); sa = sin(a);
+        for (i = 1; i <= n; i++) {
+            c[0] = c[6]; c[1] = c[7];
+            c[2] = c[0] + h*(-s.arc[2]*cs*sa - s.arc[3]*sn*ca);
+            c[3] = c[1] + h*(-s.arc[2]*sn*sa + s.arc[3]*cs*ca);
+            a = s.arc[5] + da*i;
+            ca = cos(a); sa = sin(a);
+            if (i == n) { c[6] = p[2]; c[7] = p[3]; }
+            else {
+                c[6] = s.arc[0] + s.arc[2]*cs*ca - s.arc[3]*sn*sa;
+                c[7] = s.arc[1] + s.arc[2]*sn*ca + s.arc[3]*cs*sa;
+            }
+            c[4] = c[6] - h*(-s.arc[2]*cs*sa - s.arc[3]*sn*ca);
+            c[5] = c[7] - h*(-s.arc[2]*sn*sa + s.arc[3]*cs*ca);
+            if (!addCubicPieces(k, c)) return 0;
+        }
+    }
+    return 1;
+}
+
+//  Unit tangent of a cubic curve at its start, or at its end, from its first distinct
+//  point: a handle shorter than the rounding errors of a split at a cusp is ignored.
+static void cubicTangent(double* c, int end, double* t) {
+    double dx, dy, n, eps;
+    int i;
+    eps = 1e-9 * (norm(c[2]-c[0], c[3]-c[1]) + norm(c[4]-c[2], c[5]-c[3]) + norm(c[6]-c[4], c[7]-c[5])) + 1e-12;
+    for (i = 1; i <= 3; i++) {
+        dx = end ? c[6] - c[6 - 2*i] : c[2*i] - c[0];
+        dy = end ? c[7] - c[7 - 2*i] : c[2*i + 1] - c[1];
+        if ((n = norm(dx, dy)) > eps) { t[0] = dx/n; t[1] = dy/n; return; }
+    }
+    t[0] = 1.0;
+    t[1] = 0.0;
+}
+
+// unit tangent of piece q at its start, or at its end
+static void pieceTangent(SVGstrokePiece* q, int end, double* t) {
+    double a, n;
+    if (q->type == CURVETO) { cubicTangent(q->p, end, t); return; }
+    if (q->type == LINETO) {
+        n = norm(q->p[2] - q->p[0], q->p[3] - q->p[1]);
+        t[0] = (q->p[2] - q->p[0]) / n;
+        t[1] = (q->p[3] - q->p[1]) / n;
+        return;
+    }
+    a = q->arc[3] + (end ? q->arc[4] : 0.0);
+    n = (q->arc[4] > 0.0) ? 1.0 : -1.0;
+    t[0] = -n*sin(a);
+    t[1] = n*cos(a);
+}
+
+static void reversePiece(SVGstrokePiece* q, SVGstrokePiece* r) {
+    int i;
+    r->type = q->type;
+    if (q->type == CURVETO) {
+        for (i = 0; i < 8; i += 2) { r->p[i] = q->p[6-i]; r->p[i+1] = q->p[7-i]; }
+        return;
+    }
+    r->p[0] = q->p[2]; r->p[1] = q->p[3];
+    r->p[2] = q->p[0]; r->p[3] = q->p[1];
+    memcpy(r->arc, q->arc, 3*sizeof(double));
+    r->arc[3] = q->arc[3] + q->arc[4];
+    r->arc[4] = -q->arc[4];
+}
+
+//  Appends the offset at distance d on the left of cubic curve c, the contour being
+//  at its start. The handles are scaled by 1 - d k, k being the curvature at their
+//  end, as the speed of the offset curve is. The curve is split in two halves while
+//  the offset is farther than the tolerance from the exact offset at 1/4, 1/2, 3/4,
+//  down to STROKE_DEPTH times.
+static int offsetCubic(SVGstroker* k, double* c, int depth) {
+    double d = k->d, t0[2], t3[2], q[8], h[14], l0, l3, a, b, u, iu, x, y, dx, dy, n, err = 0.0;
+    double o[6];
+    int i;
+    cubicTangent(c, 0, t0);
+    cubicTangent(c, 1, t3);
+    q[0] = c[0] - d*t0[1]; q[1] = c[1] + d*t0[0];
+    q[6] = c[6] - d*t3[1]; q[7] = c[7] + d*t3[0];
+    l0 = norm(c[2]-c[0], c[3]-c[1]);
+    l3 = norm(c[6]-c[4], c[7]-c[5]);
+    a = (l0 > 1e-12) ? l0 - d * 2.0/3.0 * crossProduct(c[2]-c[0], c[3]-c[1], c[4]-c[2], c[5]-c[3]) / (l0*l0) : 0.0;
+    b = (l3 > 1e-12) ? l3 - d * 2.0/3.0 * crossProduct(c[4]-c[2], c[5]-c[3], c[6]-c[4], c[7]-c[5]) / (l3*l3) : 0.0;
+    q[2] = q[0] + a*t0[0]; q[3] = q[1] + a*t0[1];
+    q[4] = q[6] - b*t3[0]; q[5] = q[7] - b*t3[1];
+    for (i = 1; i <= 3; i++) {
+        u = 0.25*i;
+        iu = 1.0 - u;
+        dx = 3*iu*iu*(c[2]-c[0]) + 6*iu*u*(c[4]-c[2]) + 3*u*u*(c[6]-c[4]);
+        dy = 3*iu*iu*(c[3]-c[1]) + 6*iu*u*(c[5]-c[3]) + 3*u*u*(c[7]-c[5]);
+        x = bezierCoordinate(u, c[0], c[2], c[4], c[6]);
+        y = bezierCoordinate(u, c[1], c[3], c[5], c[7]);
+        if ((n = norm(dx, dy)) >= 1e-12) { x -= d*dy/n; y += d*dx/n; }
+        o[2*i-2] = x;
+        o[2*i-1] = y;
+        err = nsvg__maxf(err, norm(bezierCoordinate(u, q[0], q[2], q[4], q[6]) - x,
+                                   bezierCoordinate(u, q[1], q[3], q[5], q[7]) - y));
+    }
+    if (err <= k->style->tolerance) return strokeCurve(k, q + 2);
+    // where the curvature is too sharp for a cubic curve, lines through the exact offset
+    if (depth == STROKE_DEPTH)
+        return strokeLine(k, o[0], o[1]) && strokeLine(k, o[2], o[3]) && strokeLine(k, o[4], o[5]) && strokeLine(k, q[6], q[7]);
+    // de Casteljau at 1/2: the halves are h[0..7] and h[6..13]
+    h[0] = c[0]; h[1] = c[1]; h[12] = c[6]; h[13] = c[7];
+    h[2] = (c[0] + c[2])*0.5; h[3] = (c[1] + c[3])*0.5;
+    h[10] = (c[4] + c[6])*0.5; h[11] = (c[5] + c[7])*0.5;
+    x = (c[2] + c[4])*0.5; y = (c[3] + c[5])*0.5;
+    h[4] = (h[2] + x)*0.5; h[5] = (h[3] + y)*0.5;
+    h[8] = (x + h[10])*0.5; h[9] = (y + h[11])*0.5;
+    h[6] = (h[4] + h[8])*0.5; h[7] = (h[5] + h[9])*0.5;
+    return offsetCubic(k, h, depth + 1) && offsetCubic(k, h + 6, depth + 1);
+}
+
+//  Appends the offset at distance d on the left of piece q, the contour being at its
+//  start. The offset of an arc of radius r is an arc of radius r - d (counterclockwise)
+//  or r + d (clockwise), on the other side of the center when it is negative, split
+//  in arcs of at most 90 degrees so that their flags are unambiguous.
+static int offsetPiece(SVGstroker* k, SVGstrokePiece* q) {
+    double t[2], r, a, da;
+    int i, n;
+    if (q->type == CURVETO) return offsetCubic(k, q->p, 0);
+    if (q->type == LINETO) {
+        pieceTangent(q, 0, t);
+        return strokeLine(k, q->p[2] - k->d*t[1], q->p[3] + k->d*t[0]);
+    }
+    r = q->arc[2] - ((q->arc[4] > 0.0) ? k->d : -k->d);
+    if (fabs(r) < 1e-9 * q->arc[2]) return strokeLine(k, q->arc[0], q->arc[1]);
+    n = (int)ceil(fabs(q->arc[4]) / (NSVG_PI*0.5) - 1e-9);
+    if (n < 1) n = 1;
+    da = q->arc[4] / n;
+    for (i = 1; i <= n; i++) {
+        a = q->arc[3] + da*i;
+        if (!strokeArc(k, fabs(r), 0, da > 0.0, q->arc[0] + r*cos(a), q->arc[1] + r*sin(a))) return 0;
+    }
+    return 1;
+}
+
+//  Appends the join at the end of piece a with piece b on the left side, the contour
+//  being at the end of the offset of a.
+static int strokeJoin(SVGstroker* k, SVGstrokePiece* a, SVGstrokePiece* b) {
+    double ta[2], tb[2], x, y, bx, by, s, c, m, d = k->d;
+    double* p = a->p + ((a->type == CURVETO) ? 6 : 2);
+    pieceTangent(a, 1, ta);
+    pieceTangent(b, 0, tb);
+    s = crossProduct(ta[0], ta[1], tb[0], tb[1]);
+    c = ta[0]*tb[0] + ta[1]*tb[1];
+    bx = p[0] - d*tb[1];
+    by = p[1] + d*tb[0];
+    if (c > 0.0 && fabs(s) < STROKE_SMOOTH) return strokeLine(k, bx, by);
+    // inner side
+    if (s > 0.0) return strokeLine(k, p[0], p[1]) && strokeLine(k, bx, by);
+    switch (k->style->join) {
+        case JOIN_ROUND:
+            return strokeArc(k, d, 0, 0, bx, by);
+        case JOIN_MITER:
+            // the miter is 1 / cos(turn/2) = sqrt(2 / (1 + cos(turn))) widths long
+            if (1.0 + c > 1e-12 && 2.0 <= sqr(k->style->miterLimit) * (1.0 + c)) {
+                m = d / (1.0 + c);
+                x = p[0] + m*(-ta[1] - tb[1]);
+                y = p[1] + m*(ta[0] + tb[0]);
+                if (!strokeLine(k, x, y)) return 0;
+            }
+            return strokeLine(k, bx, by);
+    }
+    return strokeLine(k, bx, by);
+}
+
+//  Appends the cap at point (x, y) of tangent t, from the left side to the right side,
+//  the contour being on the left side.
+static int strokeCap(SVGstroker* k, double x, double y, double* t) {
+    double d = k->d, nx = -d*t[1], ny = d*t[0];
+    switch (k->style->cap) {
+        case CAP_ROUND:
+            return strokeArc(k, d, 0, 0, x + d*t[0], y + d*t[1]) && strokeArc(k, d, 0, 0, x - nx, y - ny);
+        case CAP_SQUARE:
+            return strokeLine(k, x + nx + d*t[0], y + ny + d*t[1]) &&
+                   strokeLine(k, x - nx + d*t[0], y - ny + d*t[1]) && strokeLine(k, x - nx, y - ny);
+    }
+    return strokeLine(k, x - nx, y - ny);
+}
+
+//  Strokes the pieces on their left side from first to last (in reversed order, each
+//  piece reversed, if backwards), joining the last to the first if closed.
+static int strokeSide(SVGstroker* k, int backwards, int closed) {
+    SVGstrokePiece q, next;
+    int n = k->npieces, i;
+    double t[2];
+    if (backwards) reversePiece(k->pieces + n - 1, &q);
+    else q = k->pieces[0];
+    pieceTangent(&q, 0, t);
+    if (k->size == 0 && !strokeStart(k, q.p[0] - k->d*t[1], q.p[1] + k->d*t[0])) return 0;
+    for (i = 0; i < n; i++) {
+        if (!offsetPiece(k, &q)) return 0;
+        if (i == n - 1 && !closed) break;
+        if (backwards) reversePiece(k->pieces + (n - 2 - i + n) % n, &next);
+        else next = k->pieces[(i + 1) % n];
+        if (!strokeJoin(k, &q, &next)) return 0;
+        q = next;
+    }
+    return 1;
+}
+
+// appends the outline of the stroke of subpath path
+static int strokeSubpath(SVGstroker* k, SVGpath* path) {
+    SVGstrokePiece* q;
+    double t[2] = { 1.0, 0.0 }, x = pathElement(path,0), y = pathElement(path,1);
+    if (!collectPieces(k, path)) return 0;
+    k->size = 0;
+    if (k->npieces == 0) {
+        // a subpath of null length only shows its caps, facing the x axis
+        if (k->style->cap == CAP_BUTT) return 1;
+        if (!strokeStart(k, x, y + k->d)) return 0;
+        if (!strokeCap(k, x, y, t)) return 0;
+        t[0] = -1.0;
+        return strokeCap(k, x, y, t) && strokeClose(k);
+    }
+    if (path->closed)
+        return strokeSide(k, 0, 1) && strokeClose(k) && strokeSide(k, 1, 1) && strokeClose(k);
+    q = k->pieces + k->npieces - 1;
+    pieceTangent(q, 1, t);
+    if (!strokeSide(k, 0, 0) || !strokeCap(k, q->p[(q->type == CURVETO) ? 6 : 2], q->p[(q->type == CURVETO) ? 7 : 3], t))
+        return 0;
+    if (!strokeSide(k, 1, 0)) return 0;
+    pieceTangent(k->pieces, 0, t);
+    t[0] = -t[0];
+    t[1] = -t[1];
+    return strokeCap(k, x, y, t) && strokeClose(k);
+}
+
+//  Appends to outline the outline of the stroke of the subpaths of plist with style,
+//  to be filled with the nonzero rule. Returns 0 on allocation error.
+static int strokePaths(SVGpaths* plist, SVGstrokeStyle* style, SVGpaths* outline) {
+    SVGstroker k;
+    SVGpath* p;
+    int ok = 1;
+    memset(&k, 0, sizeof(SVGstroker));
+    k.style = style;
+    k.d = style->width * 0.5;
+    k.outline = outline;
+    if (k.d > 0.0)
+        for (p = firstPath(plist); ok && p != endPath(plist); p++) ok = strokeSubpath(&k, p);
+    free(k.pieces);
+    free(k.e);
+    return ok;
+}
+
+/* tessellation */
+
+//  The fill of the subpaths is tessellated into triangles by a sweep of horizontal
+//  slabs. The subpaths are flattened and their edges are cut by horizontal lines
+//  through every vertex and every crossing of two edges, so that no edges cross inside
+//  a slab. In each slab the edges are sorted by x and the winding number is summed
+//  from left to right, each span inside the fill (for the fill rule) giving a
+//  trapezoid of 2 triangles. The vertices shared by the trapezoids are merged into an
+//  indexed mesh. Horizontal, zero-length and coincident edges, and self-intersections,
+//  need no special case.
+
+#define MESH_MAGIC "SVGM"
+
+typedef struct SVGedge {
+    double x0, y0, x1, y1;  // ends with y0 < y1
+    int dir;                // 1 if the edge goes down in the subpath, -1 if it goes up
+    double xa, xb;          // x at the top and at the bottom of the current slab
+} SVGedge;
+
+typedef struct SVGmesh {
+    float* vertices;        // x, y of each vertex
+    int nvertices, vcapacity;
+    unsigned int* indices;  // 3 vertices for each triangle, all with the same orientation
+    int nindices, icapacity;
+    int* table;             // hash table of the vertices, -1 where empty
+    int tcapacity;          // power of 2
+} SVGmesh;
+
+static void freeMesh(SVGmesh* mesh) {
+    free(mesh->vertices);
+    free(mesh->indices);
+    free(mesh->table);
+    memset(mesh, 0, sizeof(SVGmesh));
+}
+
+static unsigned int hashVertex(float* v) {
+    uint32_t a, b;
+    memcpy(&a, v, sizeof(a));
+    memcpy(&b, v + 1, sizeof(b));
+    return (a * 0x9E3779B1u) ^ (b * 0x85EBCA77u) ^ (a >> 15);
+}
+
+//  Index of the vertex (x, y) of mesh, added if not already there. Vertices equal once
+//  rounded to floats are the same. Returns -1 on allocation error.
+static int meshVertex(SVGmesh* mesh, double x, double y) {
+    float v[2], *vertices;
+    unsigned int h, mask;
+    int i, k, *table;
+    v[0] = (float)x; v[1] = (float)y;
+    if (2*(mesh->nvertices + 1) > mesh->tcapacity) {
+        // grows and rebuilds the hash table
+        k = mesh->tcapacity ? (mesh->tcapacity << 1) : 1024;
+        table = (int*)malloc(k*sizeof(int));
+        if (table == NULL) return -1;
+        memset(table, -1, k*sizeof(int));
+        for (i = 0; i < mesh->nvertices; i++) {
+            for (h = hashVertex(mesh->vertices + 2*i) & (k - 1); table[h] >= 0; h = (h + 1) & (k - 1));
+            table[h] = i;
+        }
+        free(mesh->table);
+        mesh->table = table;
+        mesh->tcapacity = k;
+    }
+    mask = mesh->tcapacity - 1;
+    for (h = hashVertex(v) & mask; (i = mesh->table[h]) >= 0; h = (h + 1) & mask)
+        if (mesh->vertices[2*i] == v[0] && mesh->vertices[2*i+1] == v[1]) return i;
+    if (mesh->nvertices + 1 > mesh->vcapacity) {
+        mesh->vcapacity = mesh->vcapacity ? (mesh->vcapacity << 1) : 256;
+        vertices = (float*)realloc(mesh->vertices, mesh->vcapacity*2*sizeof(float));
+        if (vertices == NULL) return -1;
+        mesh->vertices = vertices;
+    }
+    mesh->table[h] = mesh->nvertices;
+    mesh->vertices[2*mesh->nvertices] = v[0];
+    mesh->vertices[2*mesh->nvertices+1] = v[1];
+    return mesh->nvertices++;
+}
+
+// adds the triangle a, b, c to mesh, unless two of its vertices are the same
+static int meshTriangle(SVGmesh* mesh, int a, int b, int c) {
+    unsigned int* indices;
+    if (a < 0 || b < 0 || c < 0) return 0;
+    if (a == b || b == c || c == a) return 1;
+    if (mesh->nindices + 3 > mesh->icapacity) {
+        mesh->icapacity = mesh->icapacity ? (mesh->icapacity << 1) : 768;
+        indices = (unsigned int*)realloc(mesh->indices, mesh->icapacity*sizeof(unsigned int));
+        if (indices == NULL) return 0;
+        mesh->indices = indices;
+    }
+    mesh->indices[mesh->nindices++] = a;
+    mesh->indices[mesh->nindices++] = b;
+    mesh->indices[mesh->nindices++] = c;
+    return 1;
+}
+
+static double edgeX(SVGedge* e, double y) {
+    if (y <= e->y0) return e->x0;
+    if (y >= e->y1) return e->x1;
+    return e->x0 + (e->x1 - e->x0) * (y - e->y0) / (e->y1 - e->y0);
+}
+
+//  Order of the edges in a slab: by x at the top of the slab, then at its bottom. The
+//  edges crossing at the top may have their x at the top rounded in the wrong order,
+//  thus x that close are taken as equal.
+static int edgeBefore(SVGedge* a, SVGedge* b) {
+    double eps = 1e-9 * (fabs(a->xa) + fabs(b->xa) + 1.0);
+    if (a->xa < b->xa - eps) return 1;
+    if (a->xa > b->xa + eps) return 0;
+    return a->xb < b->xb;
+}
+
+static int compareEdges(const void* a, const void* b) {
+    double d = ((SVGedge*)a)->y0 - ((SVGedge*)b)->y0;
+    return (d < 0) ? -1 : (d > 0) ? 1 : 0;
+}
+
+static int compareDoubles(const void* a, const void* b) {
+    double d = *(double*)a - *(double*)b;
+    return (d < 0) ? -1 : (d > 0) ? 1 : 0;
+}
+
+//  Tessellates the fill of the subpaths of plist, flattened within tol, with fill
+//  rule rule into mesh. Returns 0 on allocation error.
+static int tessellatePaths(SVGpaths* plist, double tol, int rule, SVGmesh* mesh) {
+    SVGpolyline poly;
+    SVGedge *edges = NULL, *e, **active = NULL;
+    double *ys = NULL, *p, *q, *r, ya, yb, yc, da, db;
+    double identity[6];
+    int nedges = 0, nys = 0, nactive = 0, next = 0, i, j, k, w, left = 0, inside, ok = 0;
+    memset(&poly, 0, sizeof(SVGpolyline));
+    identityMatrix(identity);
+    if (!flattenPaths(plist, identity, tol, &poly)) goto done;
+    edges = (SVGedge*)malloc((poly.npoints + 1)*sizeof(SVGedge));
+    ys = (double*)malloc((2*poly.npoints + 1)*sizeof(double));
+    active = (SVGedge**)malloc((poly.npoints + 1)*sizeof(SVGedge*));
+    if (edges == NULL || ys == NULL || active == NULL) goto done;
+    for (k = 0; k < poly.ncontours; k++) {
+        for (i = poly.contours[k]; i < poly.contours[k+1]; i++) {
+            p = poly.points + 2*i;
+            q = poly.points + 2*((i + 1 < poly.contours[k+1]) ? i + 1 : poly.contours[k]);
+            if (p[1] == q[1] || !isfinite(p[0]) || !isfinite(p[1]) || !isfinite(q[0]) || !isfinite(q[1]))
+                continue;   // horizontal edges don't change the winding
+            e = edges + nedges++;
+            e->dir = (p[1] < q[1]) ? 1 : -1;
+            if (e->dir < 0) { r = p; p = q; q = r; }
+            e->x0 = p[0]; e->y0 = p[1];
+            e->x1 = q[0]; e->y1 = q[1];
+            ys[nys++] = p[1];
+            ys[nys++] = q[1];
+        }
+    }
+    qsort(edges, nedges, sizeof(SVGedge), compareEdges);
+    qsort(ys, nys, sizeof(double), compareDoubles);
+    for (i = j = 0; i < nys; i++) if (j == 0 || ys[i] != ys[j-1]) ys[j++] = ys[i];
+    nys = j;
+    for (k = 1, ya = (nys > 0) ? ys[0] : 0.0; k < nys; ya = yb) {
+        yb = ys[k];
+        // edges starting at ya enter, edges ending at ya leave
+        for (i = j = 0; i < nactive; i++) if (active[i]->y1 > ya) active[j++] = active[i];
+        nactive = j;
+        while (next < nedges && edges[next].y0 <= ya) active[nactive++] = edges + next++;
+        for (i = 0; i < nactive; i++) {
+            active[i]->xa = edgeX(active[i], ya);
+            active[i]->xb = edgeX(active[i], yb);
+        }
+        // insertion sort, fast since the order changes little from a slab to the next
+        for (i = 1; i < nactive; i++) {
+            e = active[i];
+            for (j = i; j > 0 && edgeBefore(e, active[j-1]); j--)
+                active[j] = active[j-1];
+            active[j] = e;
+        }
+        // the first crossing in the slab is between neighbors at ya: the slab ends there
+        for (i = 1; i < nactive; i++) {
+            da = active[i]->xa - active[i-1]->xa;
+            db = active[i-1]->xb - active[i]->xb;
+            if (db <= 1e-9 * (fabs(active[i]->xb) + 1.0)) continue;
+            yc = ya + (ys[k] - ya) * da / (da + db);   // xb is still at ys[k]
+            if (yc > ya + 1e-12 * (fabs(ya) + 1.0) && yc < yb) yb = yc;
+        }
+        if (yb != ys[k])
+            for (i = 0; i < nactive; i++) active[i]->xb = edgeX(active[i], yb);
+        else k++;
+        // spans inside the fill
+        for (i = 0, w = 0; i < nactive; i++) {
+            inside = (rule == FILL_EVENODD) ? (w & 1) : (w != 0);
+            w += active[i]->dir;
+            if (inside == ((rule == FILL_EVENODD) ? (w & 1) : (w != 0))) continue;
+            if (!inside) { left = i; continue; }
+            j = meshVertex(mesh, active[left]->xa, ya);
+            if (!meshTriangle(mesh, j, meshVertex(mesh, active[i]->xa, ya), meshVertex(mesh, active[i]->xb, yb)) ||
+                !meshTriangle(mesh, j, meshVertex(mesh, active[i]->xb, yb), meshVertex(mesh, active[left]->xb, yb)))
+                goto done;
+        }
+    }
+    ok = 1;
+
+done:
+    freePolyline(&poly);
+    free(edges);
+    free(ys);
+    free(active);
+    return ok;
+}
+
+//  Writes mesh in file name: "SVGM", the numbers of vertices and indices and the size
+//  of the indices (2 or 4 bytes) as 32 bits integers, then the vertices as pairs of
+//  floats and the indices, in the byte order of the machine. Returns 0 on error.
+static int writeMesh(SVGmesh* mesh, char* name) {
+    FILE* f = fopen(name, "wb");
+    uint32_t header[3];
+    uint16_t index;
+    int i, ok;
+    if (f == NULL) return 0;
+    header[0] = mesh->nvertices;
+    header[1] = mesh->nindices;
+    header[2] = (mesh->nvertices <= 65536) ? 2 : 4;
+    ok = fwrite(MESH_MAGIC, 1, 4, f) == 4 && fwrite(header, sizeof(uint32_t), 3, f) == 3 &&
+         fwrite(mesh->vertices, sizeof(float), 2*mesh->nvertices, f) == (size_t)(2*mesh->nvertices);
+    if (header[2] == 4)
+        ok = ok && fwrite(mesh->indices, sizeof(uint32_t), mesh->nindices, f) == (size_t)mesh->nindices;
+    else
+        for (i = 0; ok && i < mesh->nindices; i++) {
+            index = (uint16_t)mesh->indices[i];
+            ok = fwrite(&index, sizeof(uint16_t), 1, f) == 1;
+        }
+    return fclose(f) == 0 && ok;
+}
+
+/* threads */
+
+#ifdef _WIN32
+typedef HANDLE SVGthread;
+typedef LPTHREAD_START_ROUTINE SVGthreadFunction;
+#define THREAD_FUNCTION(name) static DWORD WINAPI name(LPVOID arg)
+#define THREAD_RETURN return 0
+
+static int startThread(SVGthread* thread, SVGthreadFunction f, void* arg) {
+    *thread = CreateThread(NULL, 0, f, arg, 0, NULL);
+    return *thread != NULL;
+}
+
+static void joinThread(SVGthread thread) {
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+}
+
+static void yieldThread(void) {
+    SwitchToThread();
+}
+
+//  Event counting its signals, so that a thread waiting for a signal after having
+//  read the count cannot miss it.
+typedef struct SVGevent {
+    CRITICAL_SECTION lock;
+    CONDITION_VARIABLE signaled;
+    unsigned count;
+} SVGevent;
+
+static void initEvent(SVGevent* e) {
+    InitializeCriticalSection(&e->lock);
+    InitializeConditionVariable(&e->signaled);
+    e->count = 0;
+}
+
+static void deleteEvent(SVGevent* e) {
+    DeleteCriticalSection(&e->lock);
+}
+
+static unsigned eventCount(SVGevent* e) {
+    unsigned count;
+    EnterCriticalSection(&e->lock);
+    count = e->count;
+    LeaveCriticalSection(&e->lock);
+    return count;
+}
+
+// waits until e is signaled after it counted count, and returns its new count
+static unsigned waitEvent(SVGevent* e, unsigned count) {
+    EnterCriticalSection(&e->lock);
+    while (e->count == count) SleepConditionVariableCS(&e->signaled, &e->lock, INFINITE);
+    count = e->count;
+    LeaveCriticalSection(&e->lock);
+    return count;
+}
+
+static void signalEvent(SVGevent* e) {
+    EnterCriticalSection(&e->lock);
+    e->count++;
+    WakeAllConditionVariable(&e->signaled);
+    LeaveCriticalSection(&e->lock);
+}
+
+static int processors(void) {
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+}
+#else
+typedef pthread_t SVGthread;
+typedef void* (*SVGthreadFunction)(void*);
+#define THREAD_FUNCTION(name) static void* name(void* arg)
+#define THREAD_RETURN return NULL
+
+static int startThread(SVGthread* thread, SVGthreadFunction f, void* arg) {
+    return pthread_create(thread, NULL, f, arg) == 0;
+}
+
+static void joinThread(SVGthread thread) {
+    pthread_join(thread, NULL);
+}
+
+static void yieldThread(void) {
+    sched_yield();
+}
+
+//  Event counting its signals, so that a thread waiting for a signal after having
+//  read the count cannot miss it.
+typedef struct SVGevent {
+    pthread_mutex_t lock;
+    pthread_cond_t signaled;
+    unsigned count;
+} SVGevent;
+
+static void initEvent(SVGevent* e) {
+    pthread_mutex_init(&e->lock, NULL);
+    pthread_cond_init(&e->signaled, NULL);
+    e->count = 0;
+}
+
+static void deleteEvent(SVGevent* e) {
+    pthread_cond_destroy(&e->signaled);
+    pthread_mutex_destroy(&e->lock);
+}
+
+static unsigned eventCount(SVGevent* e) {
+    unsigned count;
+    pthread_mutex_lock(&e->lock);
+    count = e->count;
+    pthread_mutex_unlock(&e->lock);
+    return count;
+}
+
+// waits until e is signaled after it counted count, and returns its new count
+static unsigned waitEvent(SVGevent* e, unsigned count) {
+    pthread_mutex_lock(&e->lock);
+    while (e->count == count) pthread_cond_wait(&e->signaled, &e->lock);
+    count = e->count;
+    pthread_mutex_unlock(&e->lock);
+    return count;
+}
+
+static void signalEvent(SVGevent* e) {
+    pthread_mutex_lock(&e->lock);
+    e->count++;
+    pthread_cond_broadcast(&e->signaled);
+    pthread_mutex_unlock(&e->lock);
+}
+
+static int processors(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return (n < 1) ? 1 : (int)n;
+}
+#endif
+
+/* rasterizer */
+
+#define RASTER_TILE 32      // height of the bands of the image rendered in parallel
+
+//  SVGraster is an 8 bits coverage (1 channel) or RGBA (4 channels) image.
+//  The coverage of a pixel is computed exactly from the area of the fill inside it
+//  (analytic anti-aliasing): each line of the flattened path adds to an accumulation
+//  buffer the signed area it covers in each pixel it crosses, and the winding
+//  number of each pixel is the sum of the accumulation buffer along its row.
+typedef struct SVGraster {
+    int width;
+    int height;
+    int channels;
+    unsigned char* pixels;
+} SVGraster;
+
+// job of one thread: it renders the bands tile, tile + step, tile + 2*step, ...
+typedef struct SVGrasterJob {
+    SVGraster* raster;
+    SVGpolyline* poly;
+    int rule;
+    int tile;
+    int step;
+    unsigned char color[4];
+} SVGrasterJob;
+
+//  Adds to the accumulation buffer acc of the rows [y0, y0+rows) the signed area
+//  covered by the line (x0, y0) (x1, y1) in the pixels it crosses. Rows have
+//  width+2 cells, the line being clamped horizontally to [0, width].
+static void accumulateLine(float* acc, int width, int top, int rows,
+                           double x0, double y0, double x1, double y1) {
+    double dir = 1.0, dxdy, x, xnext, dy, d, xa, xb, s, a0, a1, a2, am, x0f, x1f, ya, yb, t;
+    int y, ystart, yend, x0i, x1i, xi, stride = width + 2;
+    float* row;
+    if (y0 == y1) return;
+    if (y0 > y1) { t = x0; x0 = x1; x1 = t; t = y0; y0 = y1; y1 = t; dir = -1.0; }
+    ya = nsvg__maxf(y0, top);
+    yb = nsvg__minf(y1, top + rows);
+    if (ya >= yb) return;
+    dxdy = (x1 - x0) / (y1 - y0);
+    x = x0 + (ya - y0) * dxdy;
+    ystart = (int)floor(ya);
+    yend = (int)ceil(yb);
+    for (y = ystart; y < yend; y++) {
+        dy = nsvg__minf(y + 1, yb) - nsvg__maxf(y, ya);
+        xnext = x + dxdy * dy;
+        d = dy * dir;
+        row = acc + (y - top) * stride;
+        xa = nsvg__maxf(0.0, nsvg__minf(width, nsvg__minf(x, xnext)));
+        xb = nsvg__maxf(0.0, nsvg__minf(width, nsvg__maxf(x, xnext)));
+        x0i = (int)floor(xa);
+        x1i = (int)ceil(xb);
+        if (x1i <= x0i + 1) {
+            am = 0.5 * (xa + xb) - x0i;
+            row[x0i] += (float)(d - d * am);
+            row[x0i+1] += (float)(d * am);
+        } else {
+            s = 1.0 / (xb - xa);
+            x0f = xa - x0i;
+            a0 = 0.5 * s * (1.0 - x0f) * (1.0 - x0f);
+            x1f = xb - x1i + 1.0;
+            am = 0.5 * s * x1f * x1f;
+            row[x0i] += (float)(d * a0);
+            if (x1i == x0i + 2) {
+                row[x0i+1] += (float)(d * (1.0 - a0 - am));
+            } else {
+                a1 = s * (1.5 - x0f);
+                row[x0i+1] += (float)(d * (a1 - a0));
+                for (xi = x0i + 2; xi < x1i - 1; xi++)
+                    row[xi] += (float)(d * s);
+                a2 = a1 + (x1i - x0i - 3) * s;
+                row[x1i-1] += (float)(d * (1.0 - a2 - am));
+            }
+            row[x1i] += (float)(d * am);
+        }
+        x = xnext;
+    }
+}
+
+//  Sums the accumulation buffer of a row into the coverages of its pixels, applying
+//  the fill rule to the winding numbers. With SSE2 the prefix sum is done 4 cells
+//  at a time.
+static void accumulateRow(float* acc, unsigned char* coverage, int width, int rule) {
+    float sum = 0.0f, w;
+    int x = 0;
+#ifdef __SSE2__
+    __m128 offset = _mm_setzero_ps(), v, one = _mm_set1_ps(1.0f), two = _mm_set1_ps(2.0f);
+    __m128 mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff)), scale = _mm_set1_ps(255.0f);
+    __m128 half = _mm_set1_ps(0.5f);
+    __m128i c;
+    int32_t packed;
+    for (; x + 4 <= width; x += 4) {
+        v = _mm_loadu_ps(acc + x);
+        v = _mm_add_ps(v, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(v), 4)));
+        v = _mm_add_ps(v, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(v), 8)));
+        v = _mm_add_ps(v, offset);
+        offset = _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3));
+        v = _mm_and_ps(v, mask);                                      // |winding|
+        if (rule == FILL_EVENODD) {
+            // w - 2*trunc(w/2) folded to 0..1..0
+            v = _mm_sub_ps(v, _mm_mul_ps(two, _mm_cvtepi32_ps(_mm_cvttps_epi32(_mm_mul_ps(v, _mm_set1_ps(0.5f))))));
+            v = _mm_min_ps(v, _mm_sub_ps(two, v));
+        }
+        v = _mm_min_ps(v, one);
+        // rounded as the scalar loop does, by truncating after adding 0.5
+        c = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(v, scale), half));
+        c = _mm_packs_epi32(c, c);
+        c = _mm_packus_epi16(c, c);
+        packed = _mm_cvtsi128_si32(c);
+        memcpy(coverage + x, &packed, 4);   // coverage + x is not aligned
+    }
+    _mm_store_ss(&sum, offset);
+#endif
+    for (; x < width; x++) {
+        sum += acc[x];
+        w = fabsf(sum);
+        if (rule == FILL_EVENODD) {
+            w -= 2.0f * (float)(int)(w * 0.5f);
+            if (w > 1.0f) w = 2.0f - w;
+        }
+        if (w > 1.0f) w = 1.0f;
+        coverage[x] = (unsigned char)(w * 255.0f + 0.5f);
+    }
+}
+
+THREAD_FUNCTION(rasterWorker) {
+    SVGrasterJob* job = (SVGrasterJob*)arg;
+    SVGraster* r = job->raster;
+    SVGpolyline* poly = job->poly;
+    int stride = r->width + 2, tile, rows, k, c, i, last, y, x;
+    unsigned char* coverage = (unsigned char*)malloc(r->width);
+    float* acc = (float*)malloc(RASTER_TILE * stride * sizeof(float));
+    unsigned char* px;
+    double* pt;
+    if (acc == NULL || coverage == NULL) goto done;
+    for (tile = job->tile * RASTER_TILE; tile < r->height; tile += job->step * RASTER_TILE) {
+        rows = (tile + RASTER_TILE <= r->height) ? RASTER_TILE : r->height - tile;
+        memset(acc, 0, rows * stride * sizeof(float));
+        for (c = 0; c < poly->ncontours; c++) {
+            last = poly->contours[c+1] - 1;
+            for (i = poly->contours[c]; i <= last; i++) {
+                pt = poly->points + 2*i;
+                k = (i == last) ? poly->contours[c] : i + 1;   // closes the contour
+                accumulateLine(acc, r->width, tile, rows, pt[0], pt[1],
+                               poly->points[2*k], poly->points[2*k+1]);
+            }
+        }
+        for (y = 0; y < rows; y++) {
+            px = r->pixels + (size_t)(tile + y) * r->width * r->channels;
+            if (r->channels == 1) {
+                accumulateRow(acc + y*stride, px, r->width, job->rule);
+                continue;
+            }
+            accumulateRow(acc + y*stride, coverage, r->width, job->rule);
+            for (x = 0; x < r->width; x++, px += 4) {  // premultiplied RGBA
+                px[0] = (unsigned char)((job->color[0] * coverage[x] + 127) / 255);
+                px[1] = (unsigned char)((job->color[1] * coverage[x] + 127) / 255);
+                px[2] = (unsigned char)((job->color[2] * coverage[x] + 127) / 255);
+                px[3] = coverage[x];
+            }
+        }
+    }
+done:
+    free(acc);
+    free(coverage);
+    THREAD_RETURN;
+}
+
+//  Renders the path transformed by matrix t into raster r with fill rule and color,
+//  in bands of RASTER_TILE rows shared by nthreads threads. Returns 0 on error.
+static int rasterizePaths(SVGraster* r, SVGpaths* plist, double* t, int rule,
+                          unsigned char* color, int nthreads) {
+    SVGpolyline poly;
+    SVGrasterJob jobs[64];
+    SVGthread threads[64];
+    char started[64];
+    int k, tiles = (r->height + RASTER_TILE - 1) / RASTER_TILE;
+    memset(&poly, 0, sizeof(SVGpolyline));
+    if (!flattenPaths(plist, t, 0.1, &poly)) {
+        freePolyline(&poly);
+        printf("allocation error: rasterizePaths\n");
+        return 0;
+    }
+    if (nthreads > tiles) nthreads = tiles;
+    if (nthreads > 64) nthreads = 64;
+    if (nthreads < 1) nthreads = 1;
+    for (k = 0; k < nthreads; k++) {
+        jobs[k].raster = r;
+        jobs[k].poly = &poly;
+        jobs[k].rule = rule;
+        jobs[k].tile = k;
+        jobs[k].step = nthreads;
+        memcpy(jobs[k].color, color, 4);
+    }
+    // the calling thread renders the first bands and the jobs of the threads not started
+    for (k = 1; k < nthreads; k++)
+        started[k] = startThread(&threads[k], rasterWorker, &jobs[k]);
+    rasterWorker(&jobs[0]);
+    for (k = 1; k < nthreads; k++)
+        if (started[k]) joinThread(threads[k]);
+        else rasterWorker(&jobs[k]);
+    freePolyline(&poly);
+    return 1;
+}
+
+//  Writes raster r in a binary PGM file (coverage) or PPM file (RGBA composed over
+//  a white background). Returns 0 on error.
+static int writeRaster(SVGraster* r, const char* filename) {
+    FILE* f = fopen(filename, "wb");
+    unsigned char* px = r->pixels;
+    unsigned char rgb[3];
+    int k, n = r->width * r->height;
+    if (f == NULL) return 0;
+    fprintf(f, "P%c\n%d %d\n255\n", (r->channels == 1) ? '5' : '6', r->width, r->height);
+    if (r->channels == 1) fwrite(px, 1, n, f);
+    else for (k = 0; k < n; k++, px += 4) {
+        rgb[0] = (unsigned char)(px[0] + 255 - px[3]);
+        rgb[1] = (unsigned char)(px[1] + 255 - px[3]);
+        rgb[2] = (unsigned char)(px[2] + 255 - px[3]);
+        fwrite(rgb, 1, 3, f);
+    }
+    return fclose(f) == 0;
+}
+
+//  Matrix fitting the bounds of all the subpaths in a width x height image, with
+//  a margin of one pixel and the same scale in both directions.
+static void fitMatrix(SVGpaths* plist, int width, int height, double* t) {
+    double b[4], s, w, h;
+    if (plist == NULL || plist->npaths == 0) { identityMatrix(t); return; }
+    pathsBounds(plist, b);
+    w = nsvg__maxf(b[2] - b[0], 1e-12);
+    h = nsvg__maxf(b[3] - b[1], 1e-12);
+    s = nsvg__minf((width - 2) / w, (height - 2) / h);
+    setScaleInMatrix(t, s, s);
+    t[4] = (width - s*w) * 0.5 - s*b[0];
+    t[5] = (height - s*h) * 0.5 - s*b[1];
+}
+
+/* compressed output */
+
+#define GZIP_LEVEL 6            // default level of compression, from 0 (stored) to 9
+#define GZIP_CHUNK 65536        // text buffered by SVGoutput before it is compressed
+
+#define GZIP_NONE 0             // the compressor may keep the data until more comes
+#define GZIP_SYNC 1             // all the data is emitted and the output ends on a byte
+#define GZIP_FINISH 2           // all the data is emitted in the last block of the stream
+
+#ifdef HAVE_ZLIB
+
+//  SVGgzip compresses text into a raw deflate stream, whose gzip header and trailer
+//  are written by the caller. The compressed bytes accumulate in out until the
+//  caller takes them.
+typedef struct SVGgzip {
+    z_stream strm;
+    int level;
+    unsigned char* out;
+    size_t size;
+    size_t capacity;
+    uint32_t crc;           // CRC-32 and length of the text compressed since the last reset
+    uint32_t length;
+} SVGgzip;
+
+#else
+
+#define DEFLATE_WINDOW 32768    // distance of the farthest match
+#define DEFLATE_BLOCK 65536     // text compressed at once when no flush is requested
+#define DEFLATE_HASH (1 << 15)
+#define DEFLATE_FAR 4096        // farthest match of 3 bytes, longer codes than 3 literals
+
+#define deflateHash(s) ((((unsigned)(s)[0] << 10) ^ ((unsigned)(s)[1] << 5) ^ (unsigned)(s)[2]) & (DEFLATE_HASH - 1))
+
+//  SVGgzip compresses text into a raw deflate stream (RFC 1951), whose gzip header and
+//  trailer are written by the caller. The matches are searched in hash chains of 3
+//  bytes, and each block is written with dynamic or fixed Huffman codes or stored,
+//  whichever is the shortest. The compressed bytes accumulate in out until the
+//  caller takes them.
+typedef struct SVGgzip {
+    int level;
+    unsigned char* out;
+    size_t size;
+    size_t capacity;
+    uint32_t crc;               // CRC-32 and length of the text compressed since the last reset
+    uint32_t length;
+    uint32_t table[256];        // of the CRC-32
+    unsigned char* window;      // DEFLATE_WINDOW bytes of history, then the text not compressed yet
+    int fill;                   // bytes in window
+    int start;                  // first byte of window not compressed yet
+    int hashed;                 // first position of window not inserted in the hash chains
+    int* head;                  // last position of each hash, -1 if none
+    int* prev;                  // previous position with the same hash, for each position
+    unsigned short* literals;   // literal bytes of the block, or 256 + length for the matches
+    unsigned short* distances;  // distances of the matches, 0 for the literals
+    int nsymbols;
+    uint64_t bits;              // bits not written yet to out, the first in the lowest bit
+    int nbits;
+} SVGgzip;
+
+static const unsigned short lengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const unsigned char lengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const unsigned short distanceBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const unsigned char distanceExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+static const unsigned char codeLengthOrder[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+//  Parameters of each level, those of zlib: a match of good bytes shortens the search
+//  for a longer match at the next byte, which is only tried below lazy bytes (from
+//  level 4), a match of nice bytes ends the search, and at most chain positions are
+//  tried in a hash chain.
+static const struct { unsigned short good, lazy, nice, chain; } deflateLevels[10] = {
+    { 0, 0, 0, 0 }, { 4, 4, 8, 4 }, { 4, 5, 16, 8 }, { 4, 6, 32, 32 }, { 4, 4, 16, 16 },
+    { 8, 16, 32, 32 }, { 8, 16, 128, 128 }, { 8, 32, 128, 256 }, { 32, 128, 258, 1024 }, { 32, 258, 258, 4096 }
+};
+
+#endif
+
+static void gzipRoom(SVGgzip* z, size_t n) {
+    unsigned char* out;
+    if (z->size + n <= z->capacity) return;
+    z->capacity = (z->size + n) << 1;
+    out = (unsigned char*)realloc(z->out, z->capacity);
+    if (out == NULL) {
+        printf("allocation error: gzip\n");
+        exit(1);
+    }
+    z->out = out;
+}
+
+static void gzipHeader(unsigned char* h) {
+    static const unsigned char header[10] = { 0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 255 };
+    memcpy(h, header, 10);
+}
+
+static void gzipTrailer(unsigned char* t, uint32_t crc, uint32_t length) {
+    int k;
+    for (k = 0; k < 4; k++) {
+        t[k] = (unsigned char)(crc >> (8*k));
+        t[k+4] = (unsigned char)(length >> (8*k));
+    }
+}
+
+#ifdef HAVE_ZLIB
+
+static SVGgzip* createGzip(int level) {
+    SVGgzip* z = (SVGgzip*)calloc(1, sizeof(SVGgzip));
+    if (z == NULL) return NULL;
+    z->level = (level < 0 || level > 9) ? GZIP_LEVEL : level;
+    if (deflateInit2(&z->strm, z->level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        free(z);
+        return NULL;
+    }
+    return z;
+}
+
+// starts a new sequence of blocks, whose matches do not refer to the previous text
+static void resetGzip(SVGgzip* z) {
+    deflateReset(&z->strm);
+    z->crc = 0;
+    z->length = 0;
+}
+
+static void deleteGzip(SVGgzip* z) {
+    deflateEnd(&z->strm);
+    free(z->out);
+    free(z);
+}
+
+static void compressText(SVGgzip* z, const char* s, size_t n, int flush) {
+    int mode = (flush == GZIP_SYNC) ? Z_SYNC_FLUSH : (flush == GZIP_FINISH) ? Z_FINISH : Z_NO_FLUSH, r;
+    if (n > 0) z->crc = (uint32_t)crc32(z->crc, (const Bytef*)s, (uInt)n);
+    z->length += (uint32_t)n;
+    z->strm.next_in = (Bytef*)s;
+    z->strm.avail_in = (uInt)n;
+    do {
+        gzipRoom(z, GZIP_CHUNK);
+        z->strm.next_out = z->out + z->size;
+        z->strm.avail_out = (uInt)(z->capacity - z->size);
+        r = deflate(&z->strm, mode);
+        z->size = z->capacity - z->strm.avail_out;
+    } while (z->strm.avail_out == 0 || (mode == Z_FINISH && r != Z_STREAM_END));
+}
+
+//  CRC-32 of the concatenation of a text of CRC crc1 and a text of length length2
+//  and CRC crc2.
+static uint32_t combineCrc(uint32_t crc1, uint32_t crc2, uint32_t length2) {
+    return (uint32_t)crc32_combine(crc1, crc2, (z_off_t)length2);
+}
+
+#else
+
+static SVGgzip* createGzip(int level) {
+    SVGgzip* z = (SVGgzip*)calloc(1, sizeof(SVGgzip));
+    uint32_t c;
+    int k, j;
+    if (z == NULL) return NULL;
+    z->level = (level < 0 || level > 9) ? GZIP_LEVEL : level;
+    for (k = 0; k < 256; k++) {
+        for (c = (uint32_t)k, j = 0; j < 8; j++) c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+        z->table[k] = c;
+    }
+    z->window = (unsigned char*)malloc(DEFLATE_WINDOW + DEFLATE_BLOCK);
+    z->head = (int*)malloc(DEFLATE_HASH * sizeof(int));
+    z->prev = (int*)malloc((DEFLATE_WINDOW + DEFLATE_BLOCK) * sizeof(int));
+    z->literals = (unsigned short*)malloc((DEFLATE_WINDOW + DEFLATE_BLOCK) * sizeof(unsigned short));
+    z->distances = (unsigned short*)malloc((DEFLATE_WINDOW + DEFLATE_BLOCK) * sizeof(unsigned short));
+    if (!z->window || !z->head || !z->prev || !z->literals || !z->distances) {
+        free(z->window); free(z->head); free(z->prev); free(z->literals); free(z->distances);
+        free(z);
+        return NULL;
+    }
+    for (k = 0; k < DEFLATE_HASH; k++) z->head[k] = -1;
+    return z;
+}
+
+// starts a new sequence of blocks, whose matches do not refer to the previous text
+static void resetGzip(SVGgzip* z) {
+    int k;
+    for (k = 0; k < DEFLATE_HASH; k++) z->head[k] = -1;
+    z->fill = z->start = z->hashed = 0;
+    z->bits = 0;
+    z->nbits = 0;
+    z->crc = 0;
+    z->length = 0;
+}
+
+static void deleteGzip(SVGgzip* z) {
+    free(z->window);
+    free(z->head);
+    free(z->prev);
+    free(z->literals);
+    free(z->distances);
+    free(z->out);
+    free(z);
+}
+
+static void putBits(SVGgzip* z, uint32_t value, int n) {
+    int k;
+    z->bits |= (uint64_t)value << z->nbits;
+    z->nbits += n;
+    if (z->nbits >= 32) {
+        gzipRoom(z, 4);
+        for (k = 0; k < 4; k++) z->out[z->size++] = (unsigned char)(z->bits >> (8*k));
+        z->bits >>= 32;
+        z->nbits -= 32;
+    }
+}
+
+// writes the pending bits, completing the last byte with zeros
+static void alignBits(SVGgzip* z) {
+    gzipRoom(z, 8);
+    for (; z->nbits > 0; z->nbits -= 8) {
+        z->out[z->size++] = (unsigned char)z->bits;
+        z->bits >>= 8;
+    }
+    z->bits = 0;
+    z->nbits = 0;
+}
+
+//  Lengths of the Huffman codes of the n symbols of frequencies freq, at most limit
+//  bits: the depths in the Huffman tree, those deeper than the limit being moved up
+//  as zlib does, then given back to the symbols from the least frequent. At least two
+//  symbols get a code, so that the code is complete.
+static void huffmanLengths(const unsigned* freq, int n, int limit, unsigned char* lengths) {
+    int order[288], parent[576], depth[576], count[16];
+    unsigned weight[576];
+    int m = 0, i, j, k, a, b, leaf, node, overflow = 0;
+    for (i = 0; i < n; i++) {
+        lengths[i] = 0;
+        if (freq[i]) order[m++] = i;
+    }
+    for (i = 0; m < 2 && i < n; i++) if (!freq[i]) order[m++] = i;
+    for (i = 1; i < m; i++) {
+        k = order[i];
+        for (j = i; j > 0 && freq[order[j-1]] > freq[k]; j--) order[j] = order[j-1];
+        order[j] = k;
+    }
+    // leaves 0 to m-1 by increasing frequency, then the nodes in order of creation
+    for (i = 0; i < m; i++) weight[i] = freq[order[i]];
+    for (leaf = 0, node = m, k = m; k < 2*m - 1; k++) {
+        a = (leaf < m && (node >= k || weight[leaf] <= weight[node])) ? leaf++ : node++;
+        b = (leaf < m && (node >= k || weight[leaf] <= weight[node])) ? leaf++ : node++;
+        weight[k] = weight[a] + weight[b];
+        parent[a] = parent[b] = k;
+    }
+    memset(count, 0, sizeof(count));
+    depth[2*m - 2] = 0;
+    for (k = 2*m - 3; k >= 0; k--) {
+        depth[k] = depth[parent[k]] + 1;
+        if (depth[k] > limit) { depth[k] = limit; overflow++; }
+        if (k < m) count[depth[k]]++;
+    }
+    while (overflow > 0) {
+        // a leaf above the limit goes one level down, with a leaf of the limit as brother
+        for (j = limit - 1; count[j] == 0; j--);
+        count[j]--;
+        count[j+1] += 2;
+        count[limit]--;
+        overflow -= 2;
+    }
+    for (i = 0, j = limit; j > 0; j--)
+        for (k = count[j]; k > 0; k--) lengths[order[i++]] = (unsigned char)j;
+}
+
+// canonical codes of the lengths, with their bits reversed as deflate writes them
+static void huffmanCodes(const unsigned char* lengths, int n, unsigned short* codes) {
+    int count[16], next[16], i, len, code = 0, c, r;
+    memset(count, 0, sizeof(count));
+    for (i = 0; i < n; i++) count[lengths[i]]++;
+    count[0] = 0;
+    for (len = 1; len < 16; len++) {
+        code = (code + count[len-1]) << 1;
+        next[len] = code;
+    }
+    for (i = 0; i < n; i++) {
+        if (!lengths[i]) continue;
+        for (c = next[lengths[i]]++, r = 0, len = 0; len < lengths[i]; len++, c >>= 1) r = (r << 1) | (c & 1);
+        codes[i] = (unsigned short)r;
+    }
+}
+
+static int lengthCode(int length) {
+    int l = length - 3, n;
+    if (l < 8) return 257 + l;
+    if (l == 255) return 285;
+    for (n = 3; (l >> (n+1)) != 0; n++);
+    return 257 + 4*(n-1) + ((l >> (n-2)) & 3);
+}
+
+static int distanceCode(int distance) {
+    int d = distance - 1, n;
+    if (d < 4) return d;
+    for (n = 2; (d >> (n+1)) != 0; n++);
+    return 2*n + ((d >> (n-1)) & 1);
+}
+
+static void insertHashes(SVGgzip* z, int end) {
+    int h;
+    for (; z->hashed < end && z->hashed + 2 < z->fill; z->hashed++) {
+        h = deflateHash(z->window + z->hashed);
+        z->prev[z->hashed] = z->head[h];
+        z->head[h] = z->hashed;
+    }
+}
+
+//  Length of the longest match of the text at pos with the previous text, 0 if none,
+//  and its distance, trying at most chain positions. The positions up to pos are
+//  inserted in the hash chains.
+static int longestMatch(SVGgzip* z, int pos, int chain, int* distance) {
+    unsigned char* w = z->window;
+    int limit = z->fill - pos, nice = deflateLevels[z->level].nice;
+    int best = 2, cur, len;
+    insertHashes(z, pos);
+    if (limit < 3) return 0;
+    if (limit > 258) limit = 258;
+    cur = z->head[deflateHash(w + pos)];
+    insertHashes(z, pos + 1);
+    for (; cur >= 0 && pos - cur <= DEFLATE_WINDOW && chain > 0; cur = z->prev[cur], chain--) {
+        if (w[cur + best] != w[pos + best] || w[cur + best - 1] != w[pos + best - 1] ||
+            w[cur] != w[pos] || w[cur + 1] != w[pos + 1]) continue;
+        for (len = 2; len < limit && w[cur + len] == w[pos + len]; len++);
+        if (len > best) {
+            best = len;
+            *distance = pos - cur;
+            if (len >= nice || len == limit) break;
+        }
+    }
+    if (best < 3 || (best == 3 && *distance > DEFLATE_FAR)) return 0;
+    return best;
+}
+
+// literals and matches of the text not compressed yet, with lazy matching from level 4
+static void findMatches(SVGgzip* z) {
+    int pos = z->start, len, next, distance = 0, d = 0;
+    int chain = deflateLevels[z->level].chain, good = deflateLevels[z->level].good;
+    int lazy = (z->level >= 4) ? deflateLevels[z->level].lazy : 0;
+    z->nsymbols = 0;
+    len = longestMatch(z, pos, chain, &distance);
+    while (pos < z->fill) {
+        if (len > 0 && len < lazy) {
+            next = longestMatch(z, pos + 1, (len >= good) ? chain >> 2 : chain, &d);
+            if (next > len) {
+                z->literals[z->nsymbols] = z->window[pos++];
+                z->distances[z->nsymbols++] = 0;
+                len = next;
+                distance = d;
+                continue;
+            }
+        }
+        if (len > 0) {
+            z->literals[z->nsymbols] = (unsigned short)(256 + len);
+            z->distances[z->nsymbols++] = (unsigned short)distance;
+            pos += len;
+        } else {
+            z->literals[z->nsymbols] = z->window[pos++];
+            z->distances[z->nsymbols++] = 0;
+        }
+        len = (pos < z->fill) ? longestMatch(z, pos, chain, &distance) : 0;
+    }
+}
+
+static void writeStored(SVGgzip* z, int last) {
+    int pos = z->start, n;
+    do {
+        n = (z->fill - pos > 65535) ? 65535 : z->fill - pos;
+        putBits(z, (last && pos + n == z->fill) ? 1 : 0, 3);
+        alignBits(z);
+        gzipRoom(z, n + 4);
+        z->out[z->size++] = (unsigned char)n;
+        z->out[z->size++] = (unsigned char)(n >> 8);
+        z->out[z->size++] = (unsigned char)~n;
+        z->out[z->size++] = (unsigned char)(~n >> 8);
+        memcpy(z->out + z->size, z->window + pos, n);
+        z->size += n;
+        pos += n;
+    } while (pos < z->fill);
+}
+
+static void writeSymbols(SVGgzip* z, const unsigned char* litLengths, const unsigned short* litCodes,
+                         const unsigned char* distLengths, const unsigned short* distCodes) {
+    int s, c, len, distance;
+    for (s = 0; s < z->nsymbols; s++) {
+        if (z->literals[s] < 256) {
+            putBits(z, litCodes[z->literals[s]], litLengths[z->literals[s]]);
+            continue;
+        }
+        len = z->literals[s] - 256;
+        c = lengthCode(len);
+        putBits(z, litCodes[c], litLengths[c]);
+        if (lengthExtra[c-257]) putBits(z, (uint32_t)(len - lengthBase[c-257]), lengthExtra[c-257]);
+        distance = z->distances[s];
+        c = distanceCode(distance);
+        putBits(z, distCodes[c], distLengths[c]);
+        if (distanceExtra[c]) putBits(z, (uint32_t)(distance - distanceBase[c]), distanceExtra[c]);
+    }
+    putBits(z, litCodes[256], litLengths[256]);
+}
+
+//  Compresses the text not compressed yet in one block, or in several stored blocks,
+//  with the codes giving the shortest block. Writes nothing if there is no text,
+//  unless the block is the last.
+static void compressBlock(SVGgzip* z, int last) {
+    unsigned litFreq[286], distFreq[30], clFreq[19];
+    unsigned char litLengths[288], distLengths[30], clLengths[19], all[316];
+    unsigned short litCodes[288], distCodes[30], clCodes[19];
+    unsigned char rle[316], rleExtra[316];
+    int s, c, i, run, nlit, ndist, nrle = 0, ncl;
+    size_t extra = 0, dynamic, fixed, stored, data = (size_t)(z->fill - z->start);
+    if (data == 0 && !last) return;
+    if (z->level == 0) {
+        writeStored(z, last);
+        z->start = z->hashed = z->fill;
+        return;
+    }
+    findMatches(z);
+    z->start = z->fill;
+    memset(litFreq, 0, sizeof(litFreq));
+    memset(distFreq, 0, sizeof(distFreq));
+    for (s = 0; s < z->nsymbols; s++) {
+        if (z->literals[s] < 256) { litFreq[z->literals[s]]++; continue; }
+        c = lengthCode(z->literals[s] - 256);
+        litFreq[c]++;
+        extra += lengthExtra[c-257];
+        c = distanceCode(z->distances[s]);
+        distFreq[c]++;
+        extra += distanceExtra[c];
+    }
+    litFreq[256] = 1;
+    huffmanLengths(litFreq, 286, 15, litLengths);
+    huffmanLengths(distFreq, 30, 15, distLengths);
+    for (nlit = 286; nlit > 257 && !litLengths[nlit-1]; nlit--);
+    for (ndist = 30; ndist > 1 && !distLengths[ndist-1]; ndist--);
+    // code lengths of both codes with runs of repeated lengths (16) and of zeros (17, 18)
+    memcpy(all, litLengths, nlit);
+    memcpy(all + nlit, distLengths, ndist);
+    memset(clFreq, 0, sizeof(clFreq));
+    for (i = 0; i < nlit + ndist; i += run) {
+        for (run = 1; i + run < nlit + ndist && all[i+run] == all[i]; run++);
+        if (all[i] == 0 && run >= 3) {
+            if (run > 138) run = 138;
+            rle[nrle] = (run >= 11) ? 18 : 17;
+            rleExtra[nrle++] = (unsigned char)((run >= 11) ? run - 11 : run - 3);
+            continue;
+        }
+        rle[nrle] = all[i];
+        rleExtra[nrle++] = 0;
+        if (all[i] == 0 || run < 4) { run = 1; continue; }
+        if (run > 7) run = 7;
+        rle[nrle] = 16;
+        rleExtra[nrle++] = (unsigned char)(run - 4);
+    }
+    for (i = 0; i < nrle; i++) clFreq[rle[i]]++;
+    huffmanLengths(clFreq, 19, 7, clLengths);
+    for (ncl = 19; ncl > 4 && !clLengths[codeLengthOrder[ncl-1]]; ncl--);
+    dynamic = 3 + 14 + 3*ncl;
+    for (i = 0; i < nrle; i++) dynamic += clLengths[rle[i]] + (rle[i] == 16 ? 2 : rle[i] == 17 ? 3 : rle[i] == 18 ? 7 : 0);
+    fixed = 3;
+    for (i = 0; i < 286; i++) {
+        dynamic += (size_t)litFreq[i] * litLengths[i];
+        fixed += (size_t)litFreq[i] * ((i < 144) ? 8 : (i < 256) ? 9 : (i < 280) ? 7 : 8);
+    }
+    for (i = 0; i < 30; i++) {
+        dynamic += (size_t)distFreq[i] * distLengths[i];
+        fixed += (size_t)distFreq[i] * 5;
+    }
+    dynamic += extra;
+    fixed += extra;
+    stored = (data / 65535 + 1) * 48 + 8 * data;
+    if (stored < dynamic && stored < fixed) {
+        z->start -= (int)data;
+        writeStored(z, last);
+        z->start = z->fill;
+    } else if (fixed <= dynamic) {
+        for (i = 0; i < 288; i++) litLengths[i] = (i < 144) ? 8 : (i < 256) ? 9 : (i < 280) ? 7 : 8;
+        for (i = 0; i < 30; i++) distLengths[i] = 5;
+        huffmanCodes(litLengths, 288, litCodes);
+        huffmanCodes(distLengths, 30, distCodes);
+        putBits(z, last ? 3 : 2, 3);
+        writeSymbols(z, litLengths, litCodes, distLengths, distCodes);
+    } else {
+        huffmanCodes(litLengths, nlit, litCodes);
+        huffmanCodes(distLengths, ndist, distCodes);
+        huffmanCodes(clLengths, 19, clCodes);
+        putBits(z, last ? 5 : 4, 3);
+        putBits(z, (uint32_t)(nlit - 257), 5);
+        putBits(z, (uint32_t)(ndist - 1), 5);
+        putBits(z, (uint32_t)(ncl - 4), 4);
+        for (i = 0; i < ncl; i++) putBits(z, clLengths[codeLengthOrder[i]], 3);
+        for (i = 0; i < nrle; i++) {
+            putBits(z, clCodes[rle[i]], clLengths[rle[i]]);
+            if (rle[i] >= 16) putBits(z, rleExtra[i], rle[i] == 16 ? 2 : rle[i] == 17 ? 3 : 7);
+        }
+        writeSymbols(z, litLengths, litCodes, distLengths, distCodes);
+    }
+}
+
+// keeps the last DEFLATE_WINDOW bytes of the window, already compressed, as history
+static void slideWindow(SVGgzip* z) {
+    int shift = z->fill - DEFLATE_WINDOW, k;
+    if (shift <= 0) return;
+    memmove(z->window, z->window + shift, DEFLATE_WINDOW);
+    for (k = 0; k < DEFLATE_HASH; k++) z->head[k] = (z->head[k] >= shift) ? z->head[k] - shift : -1;
+    for (k = 0; k < DEFLATE_WINDOW; k++) z->prev[k] = (z->prev[k+shift] >= shift) ? z->prev[k+shift] - shift : -1;
+    z->fill -= shift;
+    z->start -= shift;
+    z->hashed -= shift;
+}
+
+static void compressText(SVGgzip* z, const char* s, size_t n, int flush) {
+    const unsigned char* u = (const unsigned char*)s;
+    uint32_t c = ~z->crc;
+    size_t k, room;
+    for (k = 0; k < n; k++) c = z->table[(c ^ u[k]) & 0xff] ^ (c >> 8);
+    z->crc = ~c;
+    z->length += (uint32_t)n;
+    while (n > 0) {
+        room = (size_t)(DEFLATE_WINDOW + DEFLATE_BLOCK - z->fill);
+        if (room == 0) {
+            compressBlock(z, 0);
+            slideWindow(z);
+            continue;
+        }
+        k = (n < room) ? n : room;
+        memcpy(z->window + z->fill, u, k);
+        z->fill += (int)k;
+        u += k;
+        n -= k;
+    }
+    if (flush == GZIP_SYNC) {
+        // an empty stored block ends the output on a byte
+        compressBlock(z, 0);
+        putBits(z, 0, 3);
+        alignBits(z);
+        gzipRoom(z, 4);
+        z->out[z->size++] = 0;
+        z->out[z->size++] = 0;
+        z->out[z->size++] = 0xff;
+        z->out[z->size++] = 0xff;
+    } else if (flush == GZIP_FINISH) {
+        compressBlock(z, 1);
+        alignBits(z);
+    }
+}
+
+static uint32_t gf2Times(const uint32_t* m, uint32_t v) {
+    uint32_t sum = 0;
+    for (; v; v >>= 1, m++) if (v & 1) sum ^= *m;
+    return sum;
+}
+
+//  CRC-32 of the concatenation of a text of CRC crc1 and a text of length length2
+//  and CRC crc2: crc1 goes through length2 zero bytes by squaring the matrix of the
+//  CRC of one zero bit over GF(2), as zlib does.
+static uint32_t combineCrc(uint32_t crc1, uint32_t crc2, uint32_t length2) {
+    uint32_t odd[32], even[32], row = 1;
+    int k;
+    if (length2 == 0) return crc1;
+    odd[0] = 0xedb88320u;
+    for (k = 1; k < 32; k++, row <<= 1) odd[k] = row;
+    for (k = 0; k < 32; k++) even[k] = gf2Times(odd, odd[k]);     // 2 zero bits
+    for (k = 0; k < 32; k++) odd[k] = gf2Times(even, even[k]);    // 4 zero bits
+    do {
+        for (k = 0; k < 32; k++) even[k] = gf2Times(odd, odd[k]);
+        if (length2 & 1) crc1 = gf2Times(even, crc1);
+        length2 >>= 1;
+        if (length2 == 0) break;
+        for (k = 0; k < 32; k++) odd[k] = gf2Times(even, even[k]);
+        if (length2 & 1) crc1 = gf2Times(odd, crc1);
+        length2 >>= 1;
+    } while (length2 != 0);
+    return crc1 ^ crc2;
+}
+
+#endif
+
+/* output */
+
+//  SVGoutput receives the generated text, either directly in a file, either in a
+//  buffer growing as needed when file is NULL. When gzip is not NULL the text is
+//  buffered and written compressed to file each GZIP_CHUNK bytes. When arguments is
+//  not zero, the buffer receives the format and the arguments of each output instead
+//  of the text, which tells cheaply if a generation would give the same text.
+typedef struct SVGoutput {
+    FILE* file;
+    char* buffer;
+    size_t size;
+    size_t capacity;
+    SVGgzip* gzip;
+    int arguments;
+} SVGoutput;
+
+static void flushOutput(SVGoutput* out, int flush);
+static void outputText(SVGoutput* out, const char* s, size_t n);
+
+//  Appends to out the format and the arguments of an output, the format having only
+//  conversions of doubles (e, f, g), of ints (c, d) and of strings (s).
+static void outputArguments(SVGoutput* out, const char* format, va_list args) {
+    const char* f;
+    double v;
+    char* s;
+    int i;
+    outputText(out, (const char*)&format, sizeof(format));
+    for (f = format; *f; f++) {
+        if (*f != '%') continue;
+        while (*++f && strchr("0123456789.-+ #", *f)) ;
+        if (*f == 'c' || *f == 'd') {
+            i = va_arg(args, int);
+            outputText(out, (const char*)&i, sizeof(i));
+        } else if (*f == 's') {
+            s = va_arg(args, char*);
+            outputText(out, s, strlen(s) + 1);
+        } else if (*f != '%') {
+            v = va_arg(args, double);
+            outputText(out, (const char*)&v, sizeof(v));
+        }
+        if (!*f) break;
+    }
+}
+
+static void output(SVGoutput* out, const char* format, ...) {
+    va_list args;
+    int n;
+    char* buffer;
+    if (out->arguments) {
+        va_start(args, format);
+        outputArguments(out, format, args);
+        va_end(args);
+        return;
+    }
+    if (out->file && !out->gzip) {
+        va_start(args, format);
+        vfprintf(out->file, format, args);
+        va_end(args);
+        return;
+    }
+    for (;;) {
+        va_start(args, format);
+        n = vsnprintf(out->buffer + out->size, out->capacity - out->size, format, args);
+        va_end(args);
+        if (n < 0) return;
+        if (out->size + n < out->capacity) break;
+        out->capacity = (out->capacity + n + 1) << 1;
+        buffer = (char*)realloc(out->buffer, out->capacity);
+        if (buffer == NULL) {
+            printf("allocation error: output\n");
+            exit(1);
+        }
+        out->buffer = buffer;
+    }
+    out->size += n;
+    if (out->gzip && out->size >= GZIP_CHUNK) flushOutput(out, GZIP_NONE);
+}
+
+// appends the n characters of s to out
+static void outputText(SVGoutput* out, const char* s, size_t n) {
+    char* buffer;
+    if (out->file && !out->gzip) {
+        fwrite(s, 1, n, out->file);
+        return;
+    }
+    if (out->size + n >= out->capacity) {
+        out->capacity = (out->capacity + n + 1) << 1;
+        buffer = (char*)realloc(out->buffer, out->capacity);
+        if (buffer == NULL) {
+            printf("allocation error: output\n");
+            exit(1);
+        }
+        out->buffer = buffer;
+    }
+    memcpy(out->buffer + out->size, s, n);
+    out->size += n;
+    out->buffer[out->size] = '\0';
+    if (out->gzip && out->size >= GZIP_CHUNK) flushOutput(out, GZIP_NONE);
+}
+
+// compresses the text buffered in out and writes what the compressor emitted
+static void flushOutput(SVGoutput* out, int flush) {
+    compressText(out->gzip, out->buffer, out->size, flush);
+    if (out->gzip->size) fwrite(out->gzip->out, 1, out->gzip->size, out->file);
+    out->gzip->size = 0;
+    out->size = 0;
+}
+
+//  Makes out write to file the text compressed at level, in gzip format (.svgz).
+//  Returns 0 if the compressor cannot be created.
+static int compressOutput(SVGoutput* out, FILE* file, int level) {
+    unsigned char header[10];
+    if ((out->gzip = createGzip(level)) == NULL) return 0;
+    out->file = file;
+    gzipHeader(header);
+    fwrite(header, 1, 10, file);
+    return 1;
+}
+
+// ends the compressed stream of out, if any, and closes its file if not stdout
+static void closeOutput(SVGoutput* out) {
+    unsigned char trailer[8];
+    if (out->gzip == NULL) return;
+    flushOutput(out, GZIP_FINISH);
+    gzipTrailer(trailer, out->gzip->crc, out->gzip->length);
+    fwrite(trailer, 1, 8, out->file);
+    deleteGzip(out->gzip);
+    out->gzip = NULL;
+    free(out->buffer);
+    out->buffer = NULL;
+    out->capacity = 0;
+    if (out->file != stdout) fclose(out->file);
+    else fflush(out->file);
+}
+
+//
+//  Prints the commands of subpath p following its initial moveto, with absolute or
+//  relative coordinates, substituting linetos by hlinetos or vlinetos when appropriate.
+//  (cpx, cpy) is the current point, that is the initial point of p, and it is updated
+//  to the last point of p.
+//
+
+static void generateCommands(SVGoutput* out, SVGpath* p, int absolute, double* pcpx, double* pcpy) {
+    int size = p->size;
+    int i, j, nargs;
+    int32_t cmd;
+    double cpx = *pcpx, cpy = *pcpy, x, y;
+    for (i = 2; i < size; ) {
+        cmd = pathCommand(p,i);
+        if (cmd == LINETO) {
+            x = pathElement(p,i+1); y = pathElement(p,i+2);
+            if ( trnc(x) == trnc(cpx) ) {
+                if ( trnc(y) != trnc(cpy)) {
+                    if ( absolute ) output(out, V_format, trnc(y));
+                    else output(out, v_format, trnc(y - cpy));
+                    cpy = y;
+                }
+               i+=3;
+               continue;
+            }
+            if ( trnc(y) == trnc(cpy) ) {
+               // trnc(x) != trnc(cpx), otherwise we wouldn't be here
+               if ( absolute ) output(out, H_format, trnc(x));
+               else output(out, h_format, trnc(x - cpx));
+               cpx = x;
+               i+=3;
+               continue;
+            }
+            if ( absolute ) output(out, L_format, trnc(x), trnc(y));
+            else output(out, l_format, trnc(x - cpx), trnc(y - cpy));
+            cpx = x; cpy = y;
+            i+=3;
+            continue;
+        }
+        output(out, "%c", (( absolute ) ? commands[cmd & 0xff] : relative[cmd & 0xff]));
+        nargs = cmd >> 8;    // get number of argments from command code
+        if (nargs < 7) { // for every one except arcs
+          if ( absolute )
+            for (j = 1; ;  ) { 
+              if ((j += 2) >= nargs) {
+                output(out, last_pt, trnc(pathElement(p,i+j-2)), trnc(pathElement(p,i+j-1)));
+                break; 
+              }
+              output(out, pt_format, trnc(pathElement(p,i+j-2)), trnc(pathElement(p,i+j-1)));
+            }
+          else
+            for (j = 1; ;  ) { 
+              if ((j += 2) >= nargs) {
+                output(out, last_pt, trnc(pathElement(p,i+j-2) - cpx), trnc(pathElement(p,i+j-1) - cpy));
+                break;
+              }
+              output(out, pt_format, trnc(pathElement(p,i+j-2) - cpx), trnc(pathElement(p,i+j-1) - cpy));
+            }
+          i += j;
+          cpx = pathElement(p,i-2); cpy = pathElement(p,i-1);
+          continue;
+        }
+        // this is an arc
+        if ( absolute )
+            output(out, a_format, 
+                trnc(pathElement(p,i+1)), trnc(pathElement(p,i+2)), // radii
+                trnc(pathElement(p,i+3)), trnc(pathElement(p,i+4)), trnc(pathElement(p,i+5)), 
+                trnc(pathElement(p,i+6)), trnc(pathElement(p,i+7)) // last coordinates
+            );                
+        else
+            output(out, a_format, 
+                trnc(pathElement(p,i+1)), trnc(pathElement(p,i+2)), // radii
+                trnc(pathElement(p,i+3)), trnc(pathElement(p,i+4)), trnc(pathElement(p,i+5)), // angle, etc.
+                trnc(pathElement(p,i+6) - cpx), trnc(pathElement(p,i+7) - cpy) // last coordinates
+            );
+        cpx = pathElement(p,i+6); cpy = pathElement(p,i+7);        
+        i += 8;            
+    }
+    *pcpx = cpx;
+    *pcpy = cpy;
+}
+
+//
+//  Prints the subpaths of path following the initial moveto of the first one, with
+//  absolute or relative coordinates. The movetos of the next subpaths are relative
+//  to the end of the previous subpath in relative coordinates.
+//
+
+static void generateSubpaths(SVGoutput* out, SVGpaths* plist, int absolute) {
+    SVGpath* p;
+    double cpx, cpy;
+    if (plist == NULL || plist->npaths == 0) return;
+    cpx = pathElement(plist->paths,0); cpy = pathElement(plist->paths,1);
+    for (p = plist->paths; p != endPath(plist); p++) {
+        if ( p != plist->paths ) {
+            if ( absolute ) output(out, M_format, trnc(pathElement(p,0)), trnc(pathElement(p,1)));
+            else output(out, m_format, trnc(pathElement(p,0)-cpx), trnc(pathElement(p,1)-cpy));
+        }
+        cpx = pathElement(p,0); cpy = pathElement(p,1);
+        generateCommands(out, p, absolute, &cpx, &cpy);
+    }
+}
+
+//
+//  Prints an SVG path with absolute or relative coordinates
+//    Input:  (1) the output where the path is printed
+//            (2) the table of SVG subpaths (SVGpaths)
+//            (3) a zero for relative coordinates or a 1 for absolute coordinates
+//    Output: prints the svg path by using the internal path representation, and
+//            substuting linetos by hlinetos or vlinetos when appropriate.
+//
+
+static void generateSVG(SVGoutput* out, SVGpaths* plist, int absolute) {
+    if (plist == NULL || plist->npaths == 0) return;
+    output(out, M_format, trnc(pathElement(plist->paths,0)), trnc(pathElement(plist->paths,1)));
+    generateSubpaths(out, plist, absolute);
+}
+
+//
+//  Prints element v minus base, as the source text of the element when its lexeme l
+//  (which may be NULL) has the same base, and formatted otherwise.
+//
+static void passValue(SVGoutput* out, SVGlexeme* l, double v, double base) {
+    if (l && l->start && l->base == base) outputText(out, l->start, l->length);
+    else output(out, n_format, trnc(v - base));
+}
+
+static void passPoint(SVGoutput* out, SVGlexeme* l, double x, double y, double bx, double by) {
+    passValue(out, l, x, bx);
+    outputText(out, ",", 1);
+    passValue(out, l ? l + 1 : NULL, y, by);
+}
+
+//
+//  Prints the path like generateSVG, with the same commands, but copying the source
+//  text of the coordinates whose value is unchanged instead of formatting them. Only
+//  the coordinates changing, like relative coordinates made absolute, are formatted.
+//  The subpaths must have been parsed in double precision with an identity matrix,
+//  recording their lexemes, otherwise every coordinate is formatted.
+//
+
+static void generatePassthrough(SVGoutput* out, SVGpaths* plist, int absolute) {
+    SVGpath* p;
+    SVGlexeme* l = NULL;
+    double* e;
+    double cpx, cpy, bx = 0.0, by = 0.0, x, y;
+    int32_t cmd;
+    int i, j, nargs;
+    char c;
+    if (plist == NULL || plist->npaths == 0) return;
+    cpx = pathElement(plist->paths,0); cpy = pathElement(plist->paths,1);
+    for (p = plist->paths; p != endPath(plist); p++) {
+        if (p->precision != PRECISION_DOUBLE) {
+            // no lexemes, this subpath is generated as usual
+            if (p == plist->paths) output(out, M_format, trnc(cpx), trnc(cpy));
+            else if (absolute) output(out, M_format, trnc(pathElement(p,0)), trnc(pathElement(p,1)));
+            else output(out, m_format, trnc(pathElement(p,0)-cpx), trnc(pathElement(p,1)-cpy));
+            cpx = pathElement(p,0); cpy = pathElement(p,1);
+            generateCommands(out, p, absolute, &cpx, &cpy);
+            continue;
+        }
+        e = (double*)p->elements;
+        if (plist->lexemes) l = plist->lexemes + p->offset / sizeof(double);
+        // the path starts with an absolute moveto
+        if (!absolute && p != plist->paths) { bx = cpx; by = cpy; }
+        outputText(out, (absolute || p == plist->paths) ? "M" : "m", 1);
+        passPoint(out, l, e[0], e[1], bx, by);
+        cpx = e[0]; cpy = e[1];
+        for (i = 2; i < p->size; i += nargs + 1) {
+            cmd = *command(e+i);
+            nargs = cmd >> 8;
+            if (!absolute) { bx = cpx; by = cpy; }
+            if (cmd == LINETO) {
+                x = e[i+1]; y = e[i+2];
+                if (trnc(x) == trnc(cpx)) {
+                    if (trnc(y) != trnc(cpy)) {
+                        outputText(out, absolute ? "V" : "v", 1);
+                        passValue(out, l ? l + i + 2 : NULL, y, by);
+                        cpy = y;
+                    }
+                    continue;
+                }
+                if (trnc(y) == trnc(cpy)) {
+                    outputText(out, absolute ? "H" : "h", 1);
+                    passValue(out, l ? l + i + 1 : NULL, x, bx);
+                    cpx = x;
+                    continue;
+                }
+            }
+            c = absolute ? commands[cmd & 0xff] : relative[cmd & 0xff];
+            outputText(out, &c, 1);
+            j = 1;
+            if (nargs == 7) {
+                // radii, angle and flags of an arc
+                for (; j <= 5; j++) {
+                    passValue(out, l ? l + i + j : NULL, e[i+j], 0.0);
+                    outputText(out, (j == 1) ? "," : " ", 1);
+                }
+            }
+            for (; j < nargs; j += 2) {
+                if (j > 1 && nargs != 7) outputText(out, " ", 1);
+                passPoint(out, l ? l + i + j : NULL, e[i+j], e[i+j+1], bx, by);
+            }
+            cpx = e[i+nargs-1]; cpy = e[i+nargs];
+        }
+    }
+}
+
+//  Writes metrics m on one line: the area, the centroid, the winding direction and the
+//  length. An area vanishing compared to the square of the length has no centroid.
+static void outputMetrics(SVGoutput* out, SVGmetrics* m) {
+    if (fabs(m->area) <= 1e-12*sqr(m->length))
+        output(out, "area 0, centroid none, no winding, length %.15g", trnc(m->length));
+    else output(out, "area %.15g, centroid %.15g,%.15g, %s, length %.15g", trnc(m->area),
+                trnc(m->moments[0]/m->area), trnc(m->moments[1]/m->area),
+                (m->area > 0.0) ? "clockwise" : "counterclockwise", trnc(m->length));
+}
+
+/* subpath deduplication */
+
+#define DEDUP_MIN_SIZE 32   // bodies smaller than this are not worth a <use>
+
+//  Entry of the table of subpath bodies. A body is the text of the commands of a
+//  subpath following its moveto in relative coordinates, which is the same for all
+//  the translated copies of the subpath.
+typedef struct SVGbody {
+    uint64_t hash;
+    size_t offset;          // offset of the body in the buffer of bodies
+    size_t size;
+    int count;              // number of subpaths with this body
+    int copies;             // number of them which can be printed as a <use>
+    int id;                 // number of the definition, -1 if not defined
+} SVGbody;
+
+static uint64_t hashText(const char* s, size_t n) {
+    uint64_t h = 14695981039346656037ull;   // FNV-1a
+    while (n--) {
+        h ^= (unsigned char)*s++;
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+static int compareLeft(const void* a, const void* b) {
+    double xa = **(const double**)a, xb = **(const double**)b;
+    return (xa < xb) ? -1 : (xa > xb) ? 1 : 0;
+}
+
+//  Sets isolated[k] to 1 if the bounds of the segments of subpath k overlap (or
+//  touch) the ones of no other subpath, and to 0 otherwise. Such a subpath fills the
+//  same pixels in a path of its own. The bounds sorted by left side are swept from
+//  left to right. Returns 0 on allocation error.
+static int isolateSubpaths(SVGpaths* plist, char* isolated) {
+    SVGsegmentIterator it;
+    SVGsegment s;
+    SVGpath* p;
+    double *bounds, **sorted, sb[4], *a, *b;
+    int n = plist ? plist->npaths : 0, i, j;
+    bounds = (double*)malloc((n ? n : 1)*4*sizeof(double));
+    sorted = (double**)malloc((n ? n : 1)*sizeof(double*));
+    if (bounds == NULL || sorted == NULL) {
+        free(bounds); free(sorted);
+        return 0;
+    }
+    for (p = firstPath(plist), i = 0; p != endPath(plist); p++, i++) {
+        a = bounds + 4*i;
+        a[0] = a[2] = pathElement(p,0);
+        a[1] = a[3] = pathElement(p,1);
+        beginSegments(&it, p);
+        while (nextSegment(&it, &s)) {
+            segmentBounds(&s, sb);
+            a[0] = nsvg__minf(a[0], sb[0]); a[1] = nsvg__minf(a[1], sb[1]);
+            a[2] = nsvg__maxf(a[2], sb[2]); a[3] = nsvg__maxf(a[3], sb[3]);
+        }
+        sorted[i] = a;
+        isolated[i] = 1;
+    }
+    qsort(sorted, n, sizeof(double*), compareLeft);
+    for (i = 0; i < n; i++)
+        for (a = sorted[i], j = i + 1; j < n && sorted[j][0] <= a[2]; j++) {
+            b = sorted[j];
+            if (b[1] <= a[3] && a[1] <= b[3])
+                isolated[(a - bounds)/4] = isolated[(b - bounds)/4] = 0;
+        }
+    free(bounds);
+    free(sorted);
+    return 1;
+}
+
+//
+//  Prints the path like generateSVG, but subpaths repeated at different positions
+//  are printed only once in <defs> with id <prefix><number>, relative to the origin,
+//  and each copy is printed as a <use> translated to its initial point. The other
+//  subpaths are printed in a single path. Since a <use> is filled on its own, a copy
+//  is only printed as a <use> when it overlaps no other subpath, so that it cannot
+//  be a hole or cover one, unless the path is not filled (fill="none" in pars).
+//  pars are the attributes given to the group of all the elements and end is
+//  printed at the end of each path.
+//
+static void generateDeduplicated(SVGoutput* out, SVGpaths* plist, int absolute,
+                                 char* pars, char* end, char* prefix) {
+    SVGoutput bodies;
+    SVGbody* table;
+    SVGpath* p;
+    int* entries;           // entry of the table of each subpath
+    char* isolated;         // flag of each subpath which can be printed as a <use>
+    int n = 0, k, e, capacity, mask, ndefs = 0, first = 1;
+    double cpx, cpy;
+    uint64_t h;
+    memset(&bodies, 0, sizeof(SVGoutput));
+    n = plist ? plist->npaths : 0;
+    for (capacity = 16; capacity < 2*n; capacity <<= 1);
+    mask = capacity - 1;
+    table = (SVGbody*)malloc(capacity*sizeof(SVGbody));
+    entries = (int*)malloc((n ? n : 1)*sizeof(int));
+    isolated = (char*)malloc(n ? n : 1);
+    if (table == NULL || entries == NULL || isolated == NULL) goto error;
+    if (pars && strstr(pars, "fill=\"none\"")) memset(isolated, 1, n);
+    else if (!isolateSubpaths(plist, isolated)) goto error;
+    for (e = 0; e < capacity; e++) table[e].count = 0;
+    // hashes the bodies, keeping only the first occurrence of each one
+    for (p = firstPath(plist), k = 0; p != endPath(plist); p++, k++) {
+        size_t offset = bodies.size;
+        cpx = pathElement(p,0); cpy = pathElement(p,1);
+        generateCommands(&bodies, p, 0, &cpx, &cpy);
+        h = hashText(bodies.buffer + offset, bodies.size - offset);
+        for (e = (int)(h & mask); table[e].count; e = (e + 1) & mask)
+            if (table[e].hash == h && table[e].size == bodies.size - offset &&
+                memcmp(bodies.buffer + table[e].offset, bodies.buffer + offset, table[e].size) == 0)
+                break;
+        if (table[e].count) bodies.size = offset;
+        else {
+            table[e].hash = h;
+            table[e].offset = offset;
+            table[e].size = bodies.size - offset;
+            table[e].copies = 0;
+            table[e].id = -1;
+        }
+        table[e].count++;
+        table[e].copies += isolated[k];
+        entries[k] = e;
+    }
+    if (!end) end = "";
+    for (k = 0; k < n; k++) {
+        e = entries[k];
+        if (table[e].copies < 2 || table[e].size < DEDUP_MIN_SIZE || table[e].id >= 0) continue;
+        if (ndefs++ == 0) output(out, "<defs>\n");
+        table[e].id = ndefs - 1;
+        output(out, "<path id=\"%s%d\" d=\"M0,0%.*s%s\"/>\n", prefix, table[e].id,
+               (int)table[e].size, bodies.buffer + table[e].offset, end);
+    }
+    if (ndefs) output(out, "</defs>\n");
+    if (pars) output(out, "<g %s>\n", pars);
+    else output(out, "<g>\n");
+    // subpaths printed once in a single path, chaining relative movetos
+    for (p = firstPath(plist), k = 0; p != endPath(plist); p++, k++) {
+        if (table[entries[k]].id >= 0 && isolated[k]) continue;
+        if (first) output(out, "<path d=\"");
+        if (absolute || first) output(out, M_format, trnc(pathElement(p,0)), trnc(pathElement(p,1)));
+        else output(out, m_format, trnc(pathElement(p,0)-cpx), trnc(pathElement(p,1)-cpy));
+        first = 0;
+        cpx = pathElement(p,0); cpy = pathElement(p,1);
+        generateCommands(out, p, absolute, &cpx, &cpy);
+    }
+    if (!first) output(out, "%s\"/>\n", end);
+    for (p = firstPath(plist), k = 0; p != endPath(plist); p++, k++) {
+        if ((e = table[entries[k]].id) < 0 || !isolated[k]) continue;
+        output(out, "<use href=\"#%s%d\" x=\"%.15g\" y=\"%.15g\"/>\n", prefix, e,
+               trnc(pathElement(p,0)), trnc(pathElement(p,1)));
+    }
+    output(out, "</g>\n");
+    free(bodies.buffer);
+    free(table);
+    free(entries);
+    free(isolated);
+    return;
+
+error:
+    free(table);
+    free(entries);
+    free(isolated);
+    output(out, "allocation error: generateDeduplicated\n");
+}
+
+/* cubic normalization */
+
+//  SVGcubics holds a path normalized to cubic Bezier curves only: lines, quadratic
+//  curves, smooth curves and arcs are all converted to plain cubic segments. The
+//  segments of all the subpaths are contiguous with a fixed stride of 6 floats
+//  (x1, y1, x2, y2, x, y), their start point being the end of the previous segment
+//  or the initial point of the subpath. Segments first[k] to first[k+1]-1 belong to
+//  subpath k, whose initial point is starts[2k], starts[2k+1].
+typedef struct SVGcubics {
+    float* segments;        // 6 floats per segment
+    int nsegments;
+    int capacity;           // capacity of segments, in segments
+    float* starts;          // initial point of each subpath
+    int* first;             // first segment of each subpath, and nsegments at index nsubpaths
+    char* closed;           // closed flag of each subpath
+    int nsubpaths;
+    int scapacity;          // capacity of starts, first and closed, in subpaths
+} SVGcubics;
+
+static void freeCubics(SVGcubics* c) {
+    free(c->segments);
+    free(c->starts);
+    free(c->first);
+    free(c->closed);
+    memset(c, 0, sizeof(SVGcubics));
+}
+
+static int addCubicSubpath(SVGcubics* c, double x, double y, char closed) {
+    float* starts;
+    int* first;
+    char* flags;
+    int n;
+    if (c->nsubpaths + 1 >= c->scapacity) {
+        n = c->scapacity ? 2*c->scapacity : 16;
+        if ((starts = (float*)realloc(c->starts, 2*n*sizeof(float))) != NULL) c->starts = starts;
+        if ((first = (int*)realloc(c->first, (n+1)*sizeof(int))) != NULL) c->first = first;
+        if ((flags = (char*)realloc(c->closed, n)) != NULL) c->closed = flags;
+        if (!starts || !first || !flags) return 0;
+        c->scapacity = n;
+    }
+    c->starts[2*c->nsubpaths] = (float)x;
+    c->starts[2*c->nsubpaths+1] = (float)y;
+    c->closed[c->nsubpaths] = closed;
+    c->first[c->nsubpaths++] = c->nsegments;
+    c->first[c->nsubpaths] = c->nsegments;
+    return 1;
+}
+
+static int addCubic(SVGcubics* c, double x1, double y1, double x2, double y2, double x, double y) {
+    float* s;
+    int n;
+    if (c->nsegments == c->capacity) {
+        n = c->capacity ? 2*c->capacity : 64;
+        s = (float*)realloc(c->segments, 6*n*sizeof(float));
+        if (s == NULL) return 0;
+        c->segments = s;
+        c->capacity = n;
+    }
+    s = c->segments + 6*c->nsegments++;
+    s[0] = (float)x1; s[1] = (float)y1;
+    s[2] = (float)x2; s[3] = (float)y2;
+    s[4] = (float)x;  s[5] = (float)y;
+    c->first[c->nsubpaths] = c->nsegments;
+    return 1;
+}
+
+//  Adds the arc of segment s as cubic curves of at most 90 degrees each. The handles
+//  of a piece of angle d are 4/3 tan(d/4) times the tangent at its ends, which keeps
+//  the error under 3e-4 times the radius. The last piece ends exactly on the end point.
+static int addArcCubics(SVGcubics* c, SVGsegment* s) {
+    double* arc = s->arc;
+    double cs = cos(arc[4]), sn = sin(arc[4]);
+    double a, da, k, x0, y0, dx0, dy0, x1, y1, dx1, dy1, ca, sa;
+    int i, n = (int)ceil(fabs(arc[6]) / (NSVG_PI*0.5) - 1e-9);
+    if (n < 1) n = 1;
+    da = arc[6] / n;
+    k = 4.0/3.0 * tan(da*0.25);
+    a = arc[5];
+    ca = cos(a); sa = sin(a);
+    x0 = s->p[0]; y0 = s->p[1];
+    dx0 = -arc[2]*cs*sa - arc[3]*sn*ca;
+    dy0 = -arc[2]*sn*sa + arc[3]*cs*ca;
+    for (i = 1; i <= n; i++) {
+        a = arc[5] + da*i;
+        ca = cos(a); sa = sin(a);
+        if (i == n) { x1 = s->p[2]; y1 = s->p[3]; }
+        else {
+            x1 = arc[0] + arc[2]*cs*ca - arc[3]*sn*sa;
+            y1 = arc[1] + arc[2]*sn*ca + arc[3]*cs*sa;
+        }
+        dx1 = -arc[2]*cs*sa - arc[3]*sn*ca;
+        dy1 = -arc[2]*sn*sa + arc[3]*cs*ca;
+        if (!addCubic(c, x0 + k*dx0, y0 + k*dy0, x1 - k*dx1, y1 - k*dy1, x1, y1)) return 0;
+        x0 = x1; y0 = y1;
+        dx0 = dx1; dy0 = dy1;
+    }
+    return 1;
+}
+
+//  Normalizes all the subpaths of plist to cubic curves in c, which should be empty
+//  or have been filled by a previous call. Returns 0 on allocation error.
+static int normalizeCubics(SVGpaths* plist, SVGcubics* c) {
+    SVGsegmentIterator it;
+    SVGsegment s;
+    SVGpath* path;
+    double* p = s.p;
+    c->nsegments = 0;
+    c->nsubpaths = 0;
+    for (path = firstPath(plist); path != endPath(plist); path++) {
+        if (!addCubicSubpath(c, pathElement(path,0), pathElement(path,1), path->closed)) return 0;
+        beginSegments(&it, path);
+        while (nextSegment(&it, &s)) {
+            switch (s.type) {
+                case LINETO:
+                    if (!addCubic(c, p[0] + (p[2]-p[0])/3.0, p[1] + (p[3]-p[1])/3.0,
+                                  p[2] + (p[0]-p[2])/3.0, p[3] + (p[1]-p[3])/3.0, p[2], p[3])) return 0;
+                    break;
+                case QUADTO:        // degree elevation
+                    if (!addCubic(c, p[0] + (p[2]-p[0])*2.0/3.0, p[1] + (p[3]-p[1])*2.0/3.0,
+                                  p[4] + (p[2]-p[4])*2.0/3.0, p[5] + (p[3]-p[5])*2.0/3.0, p[4], p[5])) return 0;
+                    break;
+                case CURVETO:
+                    if (!addCubic(c, p[2], p[3], p[4], p[5], p[6], p[7])) return 0;
+                    break;
+                default:
+                    if (!addArcCubics(c, &s)) return 0;
+                    break;
+            }
+        }
+    }
+    return 1;
+}
+
+//
+//  Prints the normalized path with a single C command per subpath, whose segments
+//  follow each other as implicit repetitions, in absolute or relative coordinates.
+//  In relative coordinates, movetos are relative to the end of the previous subpath.
+//
+
+static void generateCubics(SVGoutput* out, SVGcubics* c, int absolute) {
+    float* s;
+    double cpx = 0.0, cpy = 0.0, x, y;
+    int k, i;
+    for (k = 0; k < c->nsubpaths; k++) {
+        x = c->starts[2*k]; y = c->starts[2*k+1];
+        if (absolute || k == 0) output(out, M_format, trnc(x), trnc(y));
+        else output(out, m_format, trnc(x - cpx), trnc(y - cpy));
+        cpx = x; cpy = y;
+        for (i = c->first[k]; i < c->first[k+1]; i++) {
+            s = c->segments + 6*i;
+            output(out, (i == c->first[k]) ? (absolute ? "C" : "c") : " ");
+            if (absolute) {
+                output(out, pt_format, trnc(s[0]), trnc(s[1]));
+                output(out, pt_format, trnc(s[2]), trnc(s[3]));
+                output(out, last_pt, trnc(s[4]), trnc(s[5]));
+            } else {
+                output(out, pt_format, trnc(s[0] - cpx), trnc(s[1] - cpy));
+                output(out, pt_format, trnc(s[2] - cpx), trnc(s[3] - cpy));
+                output(out, last_pt, trnc(s[4] - cpx), trnc(s[5] - cpy));
+            }
+            cpx = s[4]; cpy = s[5];
+        }
+    }
+}
+
+/* morphing */
+
+//  A morph blends two keyframe paths into frames. Both are normalized to cubic curves,
+//  and their subpaths are paired in order, a subpath missing in one keyframe being a
+//  point at the start of its pair, so that it grows from there. Within a pair the
+//  subpath with fewer segments has its longest segments cut into pieces of equal
+//  parameter, which leaves its shape unchanged, until both have the same number of
+//  segments. The keyframes then have the same layout of floats, and a frame at t is
+//  from + t*(to - from) over the whole arrays, 4 floats at a time with SSE2. The
+//  parsing and the pairing are done once for all the frames.
+
+typedef struct SVGmorph {
+    SVGcubics from;         // first keyframe, resampled
+    SVGcubics frame;        // last frame blended, sharing first and closed with from
+    float* delta;           // second keyframe minus the first: starts, then segments
+} SVGmorph;
+
+static void freeMorph(SVGmorph* m) {
+    freeCubics(&m->from);
+    free(m->frame.starts);
+    free(m->frame.segments);
+    free(m->delta);
+    memset(m, 0, sizeof(SVGmorph));
+}
+
+//  Adds subpath k of c with its segments cut into n pieces in total, n being at least
+//  the number of its segments. A segment gets pieces in proportion to the length of
+//  its control polygon.
+static int addResampledSubpath(SVGcubics* dst, SVGcubics* c, int k, int n) {
+    double q[8], t[3], x[3], y[3], best, *lengths;
+    float* s;
+    int first = c->first[k], count = c->first[k+1] - first, i, j, m, *pieces;
+    if (!addCubicSubpath(dst, c->starts[2*k], c->starts[2*k+1], c->closed[k])) return 0;
+    if (count == 0) {       // a point
+        for (i = 0; i < n; i++)
+            if (!addCubic(dst, c->starts[2*k], c->starts[2*k+1], c->starts[2*k], c->starts[2*k+1],
+                          c->starts[2*k], c->starts[2*k+1])) return 0;
+        return 1;
+    }
+    lengths = (double*)malloc(count*sizeof(double));
+    pieces = (int*)malloc(count*sizeof(int));
+    if (lengths == NULL || pieces == NULL) goto error;
+    for (i = 0; i < count; i++) {
+        s = c->segments + 6*(first + i);
+        x[0] = (i == 0) ? c->starts[2*k] : s[-2];
+        y[0] = (i == 0) ? c->starts[2*k+1] : s[-1];
+        lengths[i] = norm(s[0] - x[0], s[1] - y[0]) + norm(s[2] - s[0], s[3] - s[1]) + norm(s[4] - s[2], s[5] - s[3]);
+        pieces[i] = 1;
+    }
+    for (m = count; m < n; m++) {   // a piece more for the segment with the longest pieces
+        for (best = -1.0, j = 0, i = 0; i < count; i++)
+            if (lengths[i] / pieces[i] > best) { best = lengths[i] / pieces[i]; j = i; }
+        pieces[j]++;
+    }
+    for (i = 0; i < count; i++) {
+        s = c->segments + 6*(first + i);
+        q[0] = (i == 0) ? c->starts[2*k] : s[-2];
+        q[1] = (i == 0) ? c->starts[2*k+1] : s[-1];
+        for (j = 0; j < 6; j++) q[j+2] = s[j];
+        if (pieces[i] == 1) {
+            if (!addCubic(dst, q[2], q[3], q[4], q[5], q[6], q[7])) goto error;
+            continue;
+        }
+        // the control points of the piece [a, b] are the blossoms (a,a,b), (a,b,b), (b,b,b)
+        for (j = 0; j < pieces[i]; j++) {
+            t[0] = t[1] = (double)j/pieces[i];
+            t[2] = (double)(j+1)/pieces[i];
+            blossomPoint(q, 3, t, &x[0], &y[0]);
+            t[1] = t[2];
+            blossomPoint(q, 3, t, &x[1], &y[1]);
+            t[0] = t[2];
+            blossomPoint(q, 3, t, &x[2], &y[2]);
+            if (!addCubic(dst, x[0], y[0], x[1], y[1], x[2], y[2])) goto error;
+        }
+    }
+    free(lengths);
+    free(pieces);
+    return 1;
+
+error:
+    free(lengths);
+    free(pieces);
+    return 0;
+}
+
+//  out = a + t*d over n floats.
+static void lerpFloats(float* out, const float* a, const float* d, float t, int n) {
+    int i = 0;
+#ifdef __SSE2__
+    __m128 vt = _mm_set1_ps(t);
+    for (; i + 4 <= n; i += 4)
+        _mm_storeu_ps(out + i, _mm_add_ps(_mm_loadu_ps(a + i), _mm_mul_ps(vt, _mm_loadu_ps(d + i))));
+#endif
+    for (; i < n; i++) out[i] = a[i] + t*d[i];
+}
+
+//  Pairs keyframes a and b in m, ready for morphFrame, adding to them the subpaths they
+//  miss. Returns 0 on allocation error.
+static int createMorph(SVGmorph* m, SVGcubics* a, SVGcubics* b) {
+    SVGcubics to;
+    int k, n, na, nb;
+    memset(m, 0, sizeof(SVGmorph));
+    memset(&to, 0, sizeof(SVGcubics));
+    for (k = 0; k < a->nsubpaths || k < b->nsubpaths; k++) {
+        na = (k < a->nsubpaths) ? a->first[k+1] - a->first[k] : 0;
+        nb = (k < b->nsubpaths) ? b->first[k+1] - b->first[k] : 0;
+        n = (na > nb) ? na : nb;
+        // a missing subpath is the start point of its pair, without segments
+        if (k >= a->nsubpaths && !addCubicSubpath(a, b->starts[2*k], b->starts[2*k+1], b->closed[k])) goto error;
+        if (k >= b->nsubpaths && !addCubicSubpath(b, a->starts[2*k], a->starts[2*k+1], a->closed[k])) goto error;
+        if (!addResampledSubpath(&m->from, a, k, n) || !addResampledSubpath(&to, b, k, n)) goto error;
+    }
+    n = 2*m->from.nsubpaths + 6*m->from.nsegments;
+    m->delta = (float*)malloc((n ? n : 1)*sizeof(float));
+    m->frame.starts = (float*)malloc((2*m->from.nsubpaths + 1)*sizeof(float));
+    m->frame.segments = (float*)malloc((6*m->from.nsegments + 1)*sizeof(float));
+    if (!m->delta || !m->frame.starts || !m->frame.segments) goto error;
+    for (k = 0; k < 2*m->from.nsubpaths; k++) m->delta[k] = to.starts[k] - m->from.starts[k];
+    for (k = 0; k < 6*m->from.nsegments; k++) m->delta[2*m->from.nsubpaths + k] = to.segments[k] - m->from.segments[k];
+    m->frame.nsubpaths = m->from.nsubpaths;
+    m->frame.nsegments = m->from.nsegments;
+    m->frame.first = m->from.first;
+    m->frame.closed = m->from.closed;
+    freeCubics(&to);
+    return 1;
+
+error:
+    freeCubics(&to);
+    freeMorph(m);
+    return 0;
+}
+
+// blends the frame at t of morph m in m->frame, from 0 for the first keyframe to 1
+static void morphFrame(SVGmorph* m, double t) {
+    int n = 2*m->from.nsubpaths;
+    lerpFloats(m->frame.starts, m->from.starts, m->delta, (float)t, n);
+    lerpFloats(m->frame.segments, m->from.segments, m->delta + n, (float)t, 6*m->from.nsegments);
+}
+
+/* code generation */
+
+//  Emitters write the subpaths as code in another language, so that the application
+//  using them has nothing to parse at startup. The subpaths are walked as a list of
+//  operations with their arguments, the smooth commands being resolved to full
+//  curves and the arcs to their center parameterization, and each emitter writes
+//  them either as a list of calls, either as an array of opcodes and an array of
+//  coordinates.
+
+#define EMIT_MOVETO 0       // x, y
+#define EMIT_LINETO 1       // x, y
+#define EMIT_QUADTO 2       // x1, y1, x, y
+#define EMIT_CURVETO 3      // x1, y1, x2, y2, x, y
+#define EMIT_ELLIPSE 4      // cx, cy, rx, ry, rotation, start angle, end angle (radians)
+#define EMIT_CLOSE 5        // no arguments
+
+static int emitArguments[6] = { 2, 2, 4, 6, 7, 0 };
+
+typedef struct SVGemitter {
+    void (*begin)(struct SVGemitter* e);
+    void (*operation)(struct SVGemitter* e, int op, double* v);
+    void (*end)(struct SVGemitter* e);
+    SVGoutput* out;
+    const char* name;       // identifier of the path in the generated code
+    int typescript;         // flag to indicate TypeScript instead of JavaScript
+    SVGoutput ops;          // opcodes, for the emitters of arrays
+    SVGoutput data;         // coordinates, for the emitters of arrays
+    int nops, ndata;
+} SVGemitter;
+
+// calls of the CanvasPath interface, implemented by CanvasRenderingContext2D and Path2D
+
+static void beginCalls(SVGemitter* e) {
+    output(e->out, "// path generated by SVGparser, drawn in a CanvasRenderingContext2D or a Path2D\n");
+    if (e->typescript) output(e->out, "function %s(p: CanvasPath): void {\n", e->name);
+    else output(e->out, "function %s(p) {\n", e->name);
+}
+
+static void callOperation(SVGemitter* e, int op, double* v) {
+    switch (op) {
+        case EMIT_MOVETO:
+            output(e->out, "    p.moveTo(%.15g, %.15g);\n", trnc(v[0]), trnc(v[1]));
+            break;
+        case EMIT_LINETO:
+            output(e->out, "    p.lineTo(%.15g, %.15g);\n", trnc(v[0]), trnc(v[1]));
+            break;
+        case EMIT_QUADTO:
+            output(e->out, "    p.quadraticCurveTo(%.15g, %.15g, %.15g, %.15g);\n",
+                   trnc(v[0]), trnc(v[1]), trnc(v[2]), trnc(v[3]));
+            break;
+        case EMIT_CURVETO:
+            output(e->out, "    p.bezierCurveTo(%.15g, %.15g, %.15g, %.15g, %.15g, %.15g);\n",
+                   trnc(v[0]), trnc(v[1]), trnc(v[2]), trnc(v[3]), trnc(v[4]), trnc(v[5]));
+            break;
+        case EMIT_ELLIPSE:
+            // angles need more digits than coordinates
+            output(e->out, "    p.ellipse(%.15g, %.15g, %.15g, %.15g, %.9g, %.9g, %.9g, %s);\n",
+                   trnc(v[0]), trnc(v[1]), trnc(v[2]), trnc(v[3]), v[4], v[5], v[6],
+                   (v[6] < v[5]) ? "true" : "false");
+            break;
+        case EMIT_CLOSE:
+            output(e->out, "    p.closePath();\n");
+            break;
+    }
+}
+
+static void endCalls(SVGemitter* e) {
+    output(e->out, "}\n");
+}
+
+// arrays of opcodes and coordinates, printed once all the operations are known
+
+static void beginArrays(SVGemitter* e) {
+    memset(&e->ops, 0, sizeof(SVGoutput));
+    memset(&e->data, 0, sizeof(SVGoutput));
+    e->nops = e->ndata = 0;
+}
+
+static void arrayOperation(SVGemitter* e, int op, double* v) {
+    int i;
+    output(&e->ops, (e->nops % 16) ? " %d," : "\n    %d,", op);
+    e->nops++;
+    for (i = 0; i < emitArguments[op]; i++, e->ndata++)
+        output(&e->data, (e->ndata % 8) ? " %.9g," : "\n    %.9g,", (op == EMIT_ELLIPSE && i > 3) ? v[i] : trnc(v[i]));
+}
+
+static void endCHeader(SVGemitter* e) {
+    output(e->out, "/* path generated by SVGparser: commands and their coordinates */\n"
+                   "#ifndef SVG_MOVETO\n"
+                   "#define SVG_MOVETO 0   /* x, y */\n"
+                   "#define SVG_LINETO 1   /* x, y */\n"
+                   "#define SVG_QUADTO 2   /* x1, y1, x, y */\n"
+                   "#define SVG_CURVETO 3  /* x1, y1, x2, y2, x, y */\n"
+                   "#define SVG_ELLIPSE 4  /* cx, cy, rx, ry, rotation, start angle, end angle (radians) */\n"
+                   "#define SVG_CLOSE 5\n"
+                   "#endif\n\n");
+    // C has no empty arrays, thus the numbers of commands and coordinates are given apart
+    output(e->out, "static const int %s_ncommands = %d;\n", e->name, e->nops);
+    output(e->out, "static const unsigned char %s_commands[%d] = {%s\n};\n\n", e->name,
+           e->nops ? e->nops : 1, e->nops ? e->ops.buffer : " SVG_CLOSE");
+    output(e->out, "static const int %s_ncoordinates = %d;\n", e->name, e->ndata);
+    output(e->out, "static const float %s_coordinates[%d] = {%s\n};\n", e->name,
+           e->ndata ? e->ndata : 1, e->ndata ? e->data.buffer : " 0");
+    free(e->ops.buffer);
+    free(e->data.buffer);
+}
+
+static void endTypedArrays(SVGemitter* e) {
+    output(e->out, "// path generated by SVGparser: opcodes and their coordinates\n"
+                   "// 0 moveTo x y, 1 lineTo x y, 2 quadraticCurveTo x1 y1 x y, 3 bezierCurveTo x1 y1 x2 y2 x y,\n"
+                   "// 4 ellipse cx cy rx ry rotation startAngle endAngle (counterclockwise if endAngle < startAngle),\n"
+                   "// 5 closePath\n");
+    output(e->out, "const %sOps = new Uint8Array([%s\n]);\n", e->name, e->ops.buffer ? e->ops.buffer : "");
+    output(e->out, "const %sData = new Float32Array([%s\n]);\n", e->name, e->data.buffer ? e->data.buffer : "");
+    free(e->ops.buffer);
+    free(e->data.buffer);
+}
+
+//
+//  Initializes the emitter of language (c, js, ts or array) writing to out the path
+//  named name. Returns 0 if the language is unknown.
+//
+
+static int createEmitter(SVGemitter* e, const char* language, const char* name, SVGoutput* out) {
+    memset(e, 0, sizeof(SVGemitter));
+    e->out = out;
+    e->name = name;
+    if (strcmp(language, "c") == 0) {
+        e->begin = beginArrays; e->operation = arrayOperation; e->end = endCHeader;
+    } else if (strcmp(language, "js") == 0 || strcmp(language, "ts") == 0) {
+        e->begin = beginCalls; e->operation = callOperation; e->end = endCalls;
+        e->typescript = (language[0] == 't');
+    } else if (strcmp(language, "array") == 0) {
+        e->begin = beginArrays; e->operation = arrayOperation; e->end = endTypedArrays;
+    } else return 0;
+    return 1;
+}
+
+// walks the subpaths of plist through emitter e
+static void emitPaths(SVGemitter* e, SVGpaths* plist) {
+    SVGsegmentIterator it;
+    SVGsegment s;
+    SVGpath* path;
+    double v[7];
+    int k;
+    e->begin(e);
+    for (path = firstPath(plist); path != endPath(plist); path++) {
+        v[0] = pathElement(path,0); v[1] = pathElement(path,1);
+        e->operation(e, EMIT_MOVETO, v);
+        beginSegments(&it, path);
+        while (nextSegment(&it, &s)) {
+            switch (s.type) {
+                case LINETO:
+                    e->operation(e, EMIT_LINETO, s.p + 2);
+                    break;
+                case QUADTO:
+                    e->operation(e, EMIT_QUADTO, s.p + 2);
+                    break;
+                case CURVETO:
+                    e->operation(e, EMIT_CURVETO, s.p + 2);
+                    break;
+                case ARCTO:
+                    for (k = 0; k < 6; k++) v[k] = s.arc[k];
+                    v[6] = s.arc[5] + s.arc[6];
+                    e->operation(e, EMIT_ELLIPSE, v);
+                    break;
+            }
+        }
+        if (path->closed) e->operation(e, EMIT_CLOSE, v);
+    }
+    e->end(e);
+}
+
+static SVGPathparser* nsvg__createParser(void){
+    SVGPathparser* p;
+    p = (SVGPathparser*)malloc(sizeof(SVGPathparser));
+    if (p == NULL) goto error;
+    memset(p, 0, sizeof(SVGPathparser));
+    p->matrix = (double*) malloc(sizeof(double)*6);
+    if (p->matrix == NULL) goto error;
+    identityMatrix(p->matrix);
+    p->angle = 0;
+    p->precision = PRECISION_AUTO;
+    return p;
+
+error:
+    if (p) {
+        if (p->matrix) free(p->matrix);
+        free(p);
+    }
+    printf("allocation error: nsvg__createParser\n");
+    return NULL;
+}
+
+/* transform cache */
+
+//  SVGpathCache keeps a path parsed once without transformation, so that it can be
+//  generated again for another matrix without tokenizing it again, as when a shape
+//  is dragged in an editor. In relative coordinates, the text following the initial
+//  moveto (movetos of the next subpaths included) depends on the translation only
+//  through the rounding of the coordinates, which chooses between the commands and
+//  gives the differences. The cache keeps the subpaths transformed by the linear part
+//  of the matrix, and on a change of translation only translates them and records the
+//  arguments the text would be formatted from: when they are the same, only the
+//  initial moveto is formatted again. A change of the linear part transforms and
+//  formats the subpaths again from the untransformed ones. In absolute coordinates,
+//  every change transforms and formats the subpaths again. The subpaths are kept in
+//  double precision, so that the path generated is the same as the one generated
+//  with -d. The workers of a stream converted with -c -d keep their last path in a
+//  cache, for the records repeating it with another transform.
+typedef struct SVGpathCache {
+    char* text;             // path data parsed
+    SVGpaths* source;       // subpaths parsed with the identity matrix
+    SVGpaths* linear;       // subpaths transformed by the linear part of matrix
+    SVGpaths* plist;        // subpaths transformed by matrix
+    int absolute;
+    int valid;              // 0 until plist and tail are generated for matrix
+    double matrix[6];       // matrix of plist and head
+    double angle;           // angle added to the arcs of plist
+    char head[ITEM_SIZE];   // initial moveto
+    SVGoutput tail;         // text following the initial moveto
+    SVGoutput arguments;    // arguments of the tail in relative coordinates, empty until needed
+    SVGoutput check;        // arguments of the tail for a new translation
+} SVGpathCache;
+
+static void deletePathCache(SVGpathCache* c) {
+    if (c == NULL) return;
+    free(c->text);
+    nsvg__deletePaths(c->source);
+    nsvg__deletePaths(c->linear);
+    nsvg__deletePaths(c->plist);
+    free(c->tail.buffer);
+    free(c->arguments.buffer);
+    free(c->check.buffer);
+    free(c);
+}
+
+// copy of the subpaths of source, to be transformed
+static SVGpaths* copyPaths(SVGpaths* source) {
+    SVGpaths* plist = createPaths();
+    SVGpath* s;
+    if (plist == NULL) return NULL;
+    for (s = firstPath(source); s != endPath(source); s++)
+        if (!appendPath(plist, (double*)s->elements, s->size, PRECISION_DOUBLE, s->closed, s->bounds)) {
+            nsvg__deletePaths(plist);
+            return NULL;
+        }
+    return plist;
+}
+
+static SVGpathCache* createPathCache(char* d, int absolute) {
+    SVGPathparser* p = nsvg__createParser();
+    SVGpathCache* c = (SVGpathCache*)malloc(sizeof(SVGpathCache));
+    if (p == NULL || c == NULL) goto error;
+    memset(c, 0, sizeof(SVGpathCache));
+    c->absolute = absolute;
+    c->arguments.arguments = c->check.arguments = 1;
+    if ((c->text = (char*)malloc(strlen(d) + 1)) == NULL) goto error;
+    strcpy(c->text, d);
+    p->precision = PRECISION_DOUBLE;
+    nsvg__parsePath(p, d);
+    c->source = p->plist;
+    if (c->source && ((c->linear = copyPaths(c->source)) == NULL || (c->plist = copyPaths(c->source)) == NULL))
+        goto error;
+    free(p->elements);
+    free(p->matrix);
+    free(p);
+    return c;
+
+error:
+    printf("allocation error: createPathCache\n");
+    exit(1);
+}
+
+// transforms the subpaths of source by t into plist, which is a copy of source
+static void transformCopy(SVGpaths* plist, SVGpaths* source, double* t, double angle) {
+    SVGpath *s, *path;
+    for (s = source->paths, path = plist->paths; s != endPath(source); s++, path++) {
+        memcpy(path->elements, s->elements, s->size*sizeof(double));
+        transformElements((double*)path->elements, path->size, t, angle, path->bounds);
+    }
+}
+
+//
+//  Updates the cached path for matrix t, whose rotation angle is angle, redoing only
+//  the stages affected by the change of the matrix.
+//
+
+static void updatePathCache(SVGpathCache* c, double* t, double angle) {
+    double m[6];
+    SVGoutput swap;
+    int changed = !c->valid || angle != c->angle ||
+                  t[0] != c->matrix[0] || t[1] != c->matrix[1] ||
+                  t[2] != c->matrix[2] || t[3] != c->matrix[3];
+    int moved = t[4] != c->matrix[4] || t[5] != c->matrix[5];
+    copyMatrix(c->matrix, t);
+    c->angle = angle;
+    c->valid = 1;
+    if (c->plist == NULL) return;
+    if (c->absolute) {
+        transformCopy(c->plist, c->source, t, angle);
+        c->tail.size = 0;
+        generateSubpaths(&c->tail, c->plist, 1);
+    } else if (changed || moved) {
+        if (changed) {
+            copyMatrix(m, t);
+            m[4] = m[5] = 0.0;
+            transformCopy(c->linear, c->source, m, angle);
+        } else if (c->arguments.size == 0)    // recorded for the previous translation
+            generateSubpaths(&c->arguments, c->plist, 0);
+        // the same sums as pointMatrixMultiply, thus the points transformed by t
+        identityMatrix(m);
+        m[4] = t[4];
+        m[5] = t[5];
+        transformCopy(c->plist, c->linear, m, 0.0);
+        if (!changed) {
+            c->check.size = 0;
+            generateSubpaths(&c->check, c->plist, 0);
+            if (c->check.size == c->arguments.size && memcmp(c->check.buffer, c->arguments.buffer, c->check.size) == 0)
+                goto head;
+            swap = c->arguments;
+            c->arguments = c->check;
+            c->check = swap;
+        } else c->arguments.size = 0;
+        c->tail.size = 0;
+        generateSubpaths(&c->tail, c->plist, 0);
+    }
+head:
+    snprintf(c->head, ITEM_SIZE, M_format, trnc(pathElement(c->plist->paths,0)), trnc(pathElement(c->plist->paths,1)));
+}
+
+// prints the cached path, updated by updatePathCache
+static void generateCached(SVGoutput* out, SVGpathCache* c) {
+    if (c->plist == NULL) return;
+    output(out, "%s", c->head);
+    if (c->tail.size == 0) return;
+    if (out->file) fwrite(c->tail.buffer, 1, c->tail.size, out->file);
+    else output(out, "%s", c->tail.buffer);
+}
+
+// wall clock time in seconds, used to measure throughputs
+static double seconds(void) {
+#ifdef _WIN32
+    LARGE_INTEGER freq, count;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&count);
+    return (double)count.QuadPart / (double)freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+#endif
+}
+
+/* transform lists */
+
+#define TRANSFORM_DEPTH 32  // maximum nesting of the groups of a transform stack
+
+//
+//  Parses an SVG transform list such as "translate(10,20) rotate(30 5 5) scale(2)"
+//  and composes it once in matrix t, the last transform of the list being applied
+//  first as in SVG. Returns 0 on a syntax error, t being then the identity.
+//
+static int parseTransform(const char* list, double* t) {
+    static const char* names[6] = { "matrix", "translate", "scale", "rotate", "skewX", "skewY" };
+    static const int nmin[6] = { 6, 1, 1, 1, 1, 1 };    // numbers of arguments of each transform
+    static const int nmax[6] = { 6, 2, 2, 3, 1, 1 };
+    char item[ITEM_SIZE];
+    char* s = (char*)list;
+    double v[6], m[6];
+    size_t len = 0;
+    int k, n;
+    identityMatrix(t);
+    for (;;) {
+        while (*s && (space(*s) || *s == ',')) s++;
+        if (!*s) return 1;
+        for (k = 0; k < 6; k++) {
+            len = strlen(names[k]);
+            if (strncmp(s, names[k], len) == 0) break;
+        }
+        if (k == 6) break;
+        s += len;
+        while (*s && space(*s)) s++;
+        if (*s++ != '(') break;
+        for (n = 0; ; n++) {
+            while (*s && (space(*s) || *s == ',')) s++;
+            if (*s == ')' || n == nmax[k]) break;
+            s = parseNumber(s, item, ITEM_SIZE);
+            if (!*item) break;
+            v[n] = str2f(item);
+        }
+        if (*s++ != ')' || n < nmin[k] || (k == 3 && n == 2)) break;
+        switch (k) {
+            case 0: copyMatrix(m, v); break;
+            case 1: setTranslationInMatrix(m, v[0], (n > 1) ? v[1] : 0.0); break;
+            case 2: setScaleInMatrix(m, v[0], (n > 1) ? v[1] : v[0]); break;
+            case 3:
+                setRotationInMatrix(m, v[0] * NSVG_PI / 180.0);
+                if (n == 3) {   // translate(cx,cy) rotate(a) translate(-cx,-cy)
+                    m[4] = v[1] - v[1]*m[0] - v[2]*m[2];
+                    m[5] = v[2] - v[1]*m[1] - v[2]*m[3];
+                }
+                break;
+            case 4: setSkewXInMatrix(m, v[0] * NSVG_PI / 180.0); break;
+            default: setSkewYInMatrix(m, v[0] * NSVG_PI / 180.0); break;
+        }
+        matrixPremultiply(t, m);
+    }
+    identityMatrix(t);
+    return 0;
+}
+
+//  Transforms of nested groups. Each level keeps the composition of the transforms
+//  of all the groups entered, so that the paths of a group are transformed by a
+//  single matrix, computed once when the group is entered.
+typedef struct SVGtransformStack {
+    double matrix[TRANSFORM_DEPTH+1][6];    // level 0 is the identity
+    int depth;
+} SVGtransformStack;
+
+static void initTransforms(SVGtransformStack* ts) {
+    identityMatrix(ts->matrix[0]);
+    ts->depth = 0;
+}
+
+//  Enters a group transformed by the transform list. Returns 0 if the list is invalid
+//  or if the groups are nested too deep.
+static int pushTransform(SVGtransformStack* ts, const char* list) {
+    double m[6];
+    if (ts->depth == TRANSFORM_DEPTH || !parseTransform(list, m)) return 0;
+    matrixMultiply(m, ts->matrix[ts->depth]);   // applied before the transforms of the parents
+    ts->depth++;
+    copyMatrix(ts->matrix[ts->depth], m);
+    return 1;
+}
+
+// matrix of the paths of the current group
+static double* currentTransform(SVGtransformStack* ts) {
+    return ts->matrix[ts->depth];
+}
+
+/* record streams */
+
+//  A stream of path records (NDJSON objects with a "d" member, or plain "d" strings,
+//  one per line) is converted by a pipeline of threads: a reader splitting the input
+//  in batches of whole records, workers each parsing and formatting batches with
+//  their own SVGPathparser, and a writer printing the batches in the input order.
+//  The reader hands the batches to the workers in turn through single producer
+//  rings, and the workers hand them to the writer through a multiple producer ring.
+//  All the rings are bounded and a full ring blocks its producer, which bounds the
+//  number of batches in memory. A thread finding its ring empty or full yields a few
+//  times, then sleeps until the thread on the other side signals it.
+
+#define STREAM_BLOCK (1 << 20)  // initial size of the reads of the reader
+#define STREAM_BATCH (1 << 16)  // minimum size of a batch of records
+#define STREAM_RING 8           // capacity of the rings of the workers
+#define STREAM_MAX_WORKERS 64
+#define STREAM_SPIN 64          // attempts on a ring before sleeping
+
+#define atomicLoad(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define atomicStore(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+//  Bounded single producer, single consumer ring of pointers. Capacity is a power
+//  of 2 and head and tail only grow, so that tail - head is the number of items.
+typedef struct SVGring {
+    void** items;
+    unsigned mask;
+    unsigned head;          // next item to be popped, written by the consumer
+    char padding[64];       // keeps head and tail in different cache lines
+    unsigned tail;          // next item to be pushed, written by the producer
+} SVGring;
+
+static int ringPush(SVGring* r, void* item) {
+    unsigned tail = r->tail;
+    if (tail - atomicLoad(&r->head) > r->mask) return 0;
+    r->items[tail & r->mask] = item;
+    atomicStore(&r->tail, tail + 1);
+    return 1;
+}
+
+static void* ringPop(SVGring* r) {
+    unsigned head = r->head;
+    void* item;
+    if (head == atomicLoad(&r->tail)) return NULL;
+    item = r->items[head & r->mask];
+    atomicStore(&r->head, head + 1);
+    return item;
+}
+
+//  Bounded multiple producers, single consumer ring of pointers (Dmitry Vyukov's
+//  bounded queue). Each cell has a sequence number telling if it is free for the
+//  producer claiming position pos (seq == pos) or full for the consumer (seq == pos+1).
+typedef struct SVGcell {
+    size_t seq;
+    void* item;
+} SVGcell;
+
+typedef struct SVGmpscRing {
+    SVGcell* cells;
+    size_t mask;
+    size_t head;            // next cell to be popped, written by the consumer
+    char padding[64];
+    size_t tail;            // next cell to be claimed, shared by the producers
+} SVGmpscRing;
+
+static int mpscPush(SVGmpscRing* r, void* item) {
+    size_t pos = __atomic_load_n(&r->tail, __ATOMIC_RELAXED), seq;
+    SVGcell* cell;
+    for (;;) {
+        cell = r->cells + (pos & r->mask);
+        seq = atomicLoad(&cell->seq);
+        if (seq == pos) {
+            if (__atomic_compare_exchange_n(&r->tail, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        } else if ((intptr_t)(seq - pos) < 0) return 0;     // full
+        else pos = __atomic_load_n(&r->tail, __ATOMIC_RELAXED);
+    }
+    cell->item = item;
+    atomicStore(&cell->seq, pos + 1);
+    return 1;
+}
+
+static void* mpscPop(SVGmpscRing* r) {
+    SVGcell* cell = r->cells + (r->head & r->mask);
+    void* item;
+    if (atomicLoad(&cell->seq) != r->head + 1) return NULL;  // empty
+    item = cell->item;
+    atomicStore(&cell->seq, r->head + r->mask + 1);
+    r->head++;
+    return item;
+}
+
+// batch of whole records, with the text generated for them
+typedef struct SVGbatch {
+    long long number;       // position of the batch in the input, -1 at the end of the input
+    char* text;             // records separated by '\0'
+    size_t size;
+    int nrecords;
+    SVGoutput out;
+    uint32_t crc;           // CRC-32 and length of the text when out is compressed
+    uint32_t length;
+} SVGbatch;
+
+// options of the conversion and state of the pipeline
+typedef struct SVGstream {
+    FILE* in;
+    FILE* out;
+    SVGPathparser* model;   // parser whose matrix, angle and precision are used by the workers
+    int absolute;
+    int validate;           // flag to indicate records are only validated
+    int level;              // level of compression of the output, -1 if not compressed
+    SVGstrokeStyle* stroke; // style of the stroke converted to its outline, if any
+    int metrics;            // flag to indicate the metrics of the records are printed
+    char* pars;
+    char* end;
+    int nworkers;
+    SVGring rings[STREAM_MAX_WORKERS];
+    SVGmpscRing done;
+    SVGevent ready[STREAM_MAX_WORKERS];  // signaled when a batch is pushed to a ring of a worker
+    SVGevent space;         // signaled when a batch is popped from a ring of a worker
+    SVGevent filled;        // signaled when a batch is pushed to done
+    SVGevent drained;       // signaled when a batch is popped from done
+    double time[3];         // time working (not waiting) of reader, workers and writer
+    double bytes[3];        // bytes read, parsed and written
+    long long records;
+} SVGstream;
+
+//  String value of member key of JSON object s, unescaped in place. Only the escapes
+//  that can appear in path data are decoded (\uXXXX above 0x7f gives '?').
+//  Returns NULL if the member is not found.
+static char* jsonMember(char* s, const char* key) {
+    size_t n = strlen(key);
+    char *d, *r;
+    unsigned int u;
+    int k;
+    while ((s = strchr(s, '"')) != NULL) {
+        s++;
+        if (strncmp(s, key, n) == 0 && s[n] == '"') {
+            s += n + 1;
+            while (*s && space(*s)) s++;
+            if (*s != ':') continue;
+            s++;
+            while (*s && space(*s)) s++;
+            if (*s != '"') continue;
+            for (d = r = ++s; *s && *s != '"'; s++) {
+                if (*s != '\\' || !s[1]) { *d++ = *s; continue; }
+                switch (*++s) {
+                    case 'n': case 'r': case 't': case 'b': case 'f': *d++ = ' '; break;
+                    case 'u':
+                        for (u = 0, k = 1; k <= 4 && s[k]; k++)
+                            u = (u << 4) | (unsigned int)(digit(s[k]) ? s[k] - '0' : (s[k] | 0x20) - 'a' + 10);
+                        s += k - 1;
+                        *d++ = (u < 0x80) ? (char)u : '?';
+                        break;
+                    default: *d++ = *s; break;
+                }
+            }
+            *d = '\0';
+            // the rest of the record stays readable from the end of the value
+            while (++d < s) *d = ' ';
+            if (d == s && *s) *s = ' ';
+            return r;
+        }
+        // skips the rest of this string
+        while (*s && *s != '"') s += (*s == '\\' && s[1]) ? 2 : 1;
+        if (*s) s++;
+    }
+    return NULL;
+}
+
+//  Replaces the text of batch b by its compressed blocks, ending on a sync flush
+//  since the records reach the output a batch at a time. The blocks of a batch do
+//  not refer to the previous batches, so that the batches compressed in parallel
+//  join in one deflate stream.
+static void compressBatch(SVGgzip* z, SVGbatch* b) {
+    resetGzip(z);
+    compressText(z, b->out.buffer, b->out.size, GZIP_SYNC);
+    b->crc = z->crc;
+    b->length = z->length;
+    free(b->out.buffer);
+    b->out.buffer = (char*)z->out;
+    b->out.size = z->size;
+    b->out.capacity = z->capacity;
+    z->out = NULL;
+    z->size = z->capacity = 0;
+}
+
+//  Called after a failed attempt on a ring, *spins being the number of failed attempts
+//  and set to 0 before the first one. Yields for the first attempts, then takes the
+//  count of event e before the next attempt, and then sleeps until e is signaled.
+static void idleThread(SVGevent* e, int* spins, unsigned* count) {
+    if (++*spins < STREAM_SPIN) yieldThread();
+    else if (*spins == STREAM_SPIN) *count = eventCount(e);
+    else *count = waitEvent(e, *count);
+}
+
+THREAD_FUNCTION(streamWorker) {
+    SVGstream* st = (SVGstream*)((void**)arg)[0];
+    SVGring* ring = (SVGring*)((void**)arg)[1];
+    SVGevent* ready = (SVGevent*)((void**)arg)[3];
+    SVGPathparser* p = nsvg__createParser();
+    SVGgzip* z = (st->level >= 0) ? createGzip(st->level) : NULL;
+    SVGpaths* outline = createPaths();
+    SVGpathCache* cache = NULL;     // last path generated, when the paths are parsed in double precision
+    SVGmetrics metrics;
+    SVGbatch* b;
+    char *record, *next, *d, *transform;
+    const char* error;
+    double t, time = 0.0, bytes = 0.0, m[6];
+    long offset;
+    unsigned count;
+    int k, spins;
+    if (p == NULL || outline == NULL || (st->level >= 0 && z == NULL)) exit(1);
+    copyMatrix(p->matrix, st->model->matrix);
+    p->angle = st->model->angle;
+    p->precision = st->model->precision;
+    p->passthrough = st->model->passthrough;
+    for (;;) {
+        for (spins = 0; (b = (SVGbatch*)ringPop(ring)) == NULL; ) idleThread(ready, &spins, &count);
+        signalEvent(&st->space);
+        if (b->number < 0) break;
+        t = seconds();
+        memset(&b->out, 0, sizeof(SVGoutput));
+        for (next = b->text, k = 0; k < b->nrecords; k++) {
+            record = next;
+            next += strlen(record) + 1;     // before the record is unescaped in place
+            bytes += (double)(next - record);
+            while (*record && space(*record)) record++;
+            transform = NULL;
+            if (*record == '{') {
+                // the transform of a record is applied before the matrix of the stream
+                transform = jsonMember(record, "transform");
+                d = jsonMember(record, "d");
+                if (d == NULL && transform) d = jsonMember(transform + strlen(transform) + 1, "d");
+            } else d = record;
+            if (st->validate) {
+                if (d == NULL) output(&b->out, "error: no path data\n");
+                else if (transform && !parseTransform(transform, m)) output(&b->out, "error: invalid transform list\n");
+                else if ((offset = validatePath(d, &error)) >= 0) output(&b->out, "error at %ld: %s\n", offset, error);
+                else output(&b->out, "valid\n");
+                continue;
+            }
+            // a record without path, or with an invalid transform, gives an empty path
+            if (d == NULL || (transform && !parseTransform(transform, m))) {
+                d = "";
+                transform = NULL;
+            }
+            if (transform) {
+                matrixMultiply(m, st->model->matrix);
+                copyMatrix(p->matrix, m);
+                p->angle = getRotationAngleFromMatrix(m);
+            } else {
+                copyMatrix(p->matrix, st->model->matrix);
+                p->angle = st->model->angle;
+            }
+            // records repeating a path with other transforms, as when a shape is dragged
+            if (p->precision == PRECISION_DOUBLE && !st->stroke && !st->metrics && !p->passthrough) {
+                if (cache == NULL || strcmp(cache->text, d) != 0) {
+                    deletePathCache(cache);
+                    cache = createPathCache(d, st->absolute);
+                }
+                updatePathCache(cache, p->matrix, p->angle);
+                if (st->pars) output(&b->out, "<path %s d=\"", st->pars);
+                else output(&b->out, "<path d=\"");
+                generateCached(&b->out, cache);
+                output(&b->out, "%s\"/>\n", st->end ? st->end : "");
+                continue;
+            }
+            clearPaths(p->plist);
+            nsvg__parsePath(p, d);
+            if (st->stroke) {
+                clearPaths(outline);
+                if (!strokePaths(p->plist, st->stroke, outline)) exit(1);
+            }
+            if (st->metrics) {
+                pathsMetrics(st->stroke ? outline : p->plist, &metrics, NULL);
+                outputMetrics(&b->out, &metrics);
+                output(&b->out, "\n");
+                continue;
+            }
+            if (st->pars) output(&b->out, "<path %s d=\"", st->pars);
+            else output(&b->out, "<path d=\"");
+            if (st->stroke) generateSVG(&b->out, outline, st->absolute);
+            else if (p->passthrough && !transform) generatePassthrough(&b->out, p->plist, st->absolute);
+            else generateSVG(&b->out, p->plist, st->absolute);
+            output(&b->out, "%s\"/>\n", st->end ? st->end : "");
+        }
+        free(b->text);
+        b->text = NULL;
+        if (z) compressBatch(z, b);
+        time += seconds() - t;
+        for (spins = 0; !mpscPush(&st->done, b); ) idleThread(&st->drained, &spins, &count);
+        signalEvent(&st->filled);
+    }
+    // the end marker goes on to the writer
+    ((double*)((void**)arg)[2])[0] = time;
+    ((double*)((void**)arg)[2])[1] = bytes;
+    for (spins = 0; !mpscPush(&st->done, b); ) idleThread(&st->drained, &spins, &count);
+    signalEvent(&st->filled);
+    nsvg__deletePaths(p->plist);
+    nsvg__deletePaths(outline);
+    deletePathCache(cache);
+    free(p->elements);
+    free(p->lexemes);
+    free(p->matrix);
+    free(p);
+    if (z) deleteGzip(z);
+    THREAD_RETURN;
+}
+
+THREAD_FUNCTION(streamWriter) {
+    SVGstream* st = (SVGstream*)arg;
+    int window = st->nworkers * (STREAM_RING + 2), ended = 0;
+    SVGbatch** pending = (SVGbatch**)calloc(window, sizeof(SVGbatch*));
+    SVGbatch* b;
+    long long next = 0;
+    double t;
+    unsigned char frame[10];
+    uint32_t crc = 0, length = 0;
+    unsigned count;
+    int spins;
+    if (pending == NULL) exit(1);
+    if (st->level >= 0) {
+        gzipHeader(frame);
+        fwrite(frame, 1, 10, st->out);
+    }
+    while (ended < st->nworkers) {
+        for (spins = 0; (b = (SVGbatch*)mpscPop(&st->done)) == NULL; ) idleThread(&st->filled, &spins, &count);
+        signalEvent(&st->drained);
+        if (b->number < 0) { ended++; continue; }  // end markers are freed by the reader
+        pending[b->number % window] = b;
+        while ((b = pending[next % window]) != NULL && b->number == next) {
+            t = seconds();
+            fwrite(b->out.buffer, 1, b->out.size, st->out);
+            if (st->level >= 0) {
+                crc = combineCrc(crc, b->crc, b->length);
+                length += b->length;
+            }
+            st->bytes[2] += (double)b->out.size;
+            st->records += b->nrecords;
+            st->time[2] += seconds() - t;
+            pending[next++ % window] = NULL;
+            free(b->out.buffer);
+            free(b);
+        }
+    }
+    if (st->level >= 0) {
+        // an empty last block with fixed codes, then the trailer
+        frame[0] = 3;
+        frame[1] = 0;
+        fwrite(frame, 1, 2, st->out);
+        gzipTrailer(frame, crc, length);
+        fwrite(frame, 1, 8, st->out);
+    }
+    fflush(st->out);
+    free(pending);
+    THREAD_RETURN;
+}
+
+//  Converts the stream of records st->in to st->out with st->nworkers workers, the
+//  calling thread being the reader. Prints the throughput of each stage on stderr
+//  if report is not zero. On an allocation error, the batches already read are
+//  still converted before the threads are stopped, and 0 is returned.
+static int convertStream(SVGstream* st, int report) {
+    SVGthread workers[STREAM_MAX_WORKERS], writer;
+    void* args[STREAM_MAX_WORKERS][4];
+    double stats[STREAM_MAX_WORKERS][2];
+    SVGbatch* b;
+    SVGbatch* ends[STREAM_MAX_WORKERS];
+    char *block = NULL, *grown;
+    size_t size = 0, capacity = STREAM_BLOCK, n, start, last;
+    long long number = 0;
+    double t, wall = seconds();
+    unsigned count;
+    int k, w = 0, eof = 0, spins, started = 0, writing = 0, status = 0;
+    if (st->nworkers < 1) st->nworkers = 1;
+    if (st->nworkers > STREAM_MAX_WORKERS) st->nworkers = STREAM_MAX_WORKERS;
+    for (k = 0; k < st->nworkers; k++) {
+        st->rings[k].items = NULL;
+        ends[k] = NULL;
+        initEvent(&st->ready[k]);
+    }
+    initEvent(&st->space);
+    initEvent(&st->filled);
+    initEvent(&st->drained);
+    st->done.mask = STREAM_MAX_WORKERS * 2 - 1;
+    st->done.cells = (SVGcell*)malloc((st->done.mask + 1) * sizeof(SVGcell));
+    if (st->done.cells == NULL) goto done;
+    for (n = 0; n <= st->done.mask; n++) st->done.cells[n].seq = n;
+    for (k = 0; k < st->nworkers; k++) {
+        st->rings[k].mask = STREAM_RING - 1;
+        st->rings[k].items = (void**)malloc(STREAM_RING * sizeof(void*));
+        ends[k] = (SVGbatch*)malloc(sizeof(SVGbatch));
+        if (st->rings[k].items == NULL || ends[k] == NULL) goto done;
+        ends[k]->number = -1;
+    }
+    for (k = 0; k < st->nworkers; k++) {
+        args[k][0] = st; args[k][1] = &st->rings[k]; args[k][2] = stats[k]; args[k][3] = &st->ready[k];
+        if (!startThread(&workers[k], streamWorker, args[k])) goto done;
+        started++;
+    }
+    if (!startThread(&writer, streamWriter, st)) goto done;
+    writing = 1;
+    block = (char*)malloc(capacity);
+    if (block == NULL) goto done;
+    while (!eof || size > 0) {
+        t = seconds();
+        if (!eof) {
+            if (size == capacity) {
+                // a line longer than the block
+                if ((grown = (char*)realloc(block, capacity * 2)) == NULL) goto done;
+                block = grown;
+                capacity *= 2;
+            }
+            n = fread(block + size, 1, capacity - size, st->in);
+            if (n == 0) eof = 1;
+            size += n;
+            st->bytes[0] += (double)n;
+        }
+        // cuts batches of whole lines, the last line being complete only at the end
+        for (start = 0; start < size; start = last) {
+            last = (start + STREAM_BATCH < size) ? start + STREAM_BATCH : size;
+            while (last < size && block[last-1] != '\n') last++;
+            if (!eof && block[last-1] != '\n') break;     // incomplete line, kept for the next read
+            b = (SVGbatch*)malloc(sizeof(SVGbatch));
+            if (b == NULL) goto done;
+            b->size = last - start;
+            b->text = (char*)malloc(b->size + 1);
+            if (b->text == NULL) { free(b); goto done; }
+            b->number = number++;
+            memcpy(b->text, block + start, b->size);
+            b->text[b->size] = '\0';
+            for (b->nrecords = 0, n = 0; n < b->size; n++)
+                if (b->text[n] == '\n') { b->text[n] = '\0'; b->nrecords++; }
+            if (b->text[b->size-1] != '\0') b->nrecords++;
+            st->time[0] += seconds() - t;
+            for (spins = 0; !ringPush(&st->rings[w], b); ) idleThread(&st->space, &spins, &count);
+            signalEvent(&st->ready[w]);
+            t = seconds();
+            w = (w + 1) % st->nworkers;
+        }
+        memmove(block, block + start, size - start);
+        size -= start;
+        st->time[0] += seconds() - t;
+    }
+    status = 1;
+done:
+    // the end markers stop the workers started, which pass them on to the writer
+    for (k = 0; k < started; k++) {
+        for (spins = 0; !ringPush(&st->rings[k], ends[k]); ) idleThread(&st->space, &spins, &count);
+        signalEvent(&st->ready[k]);
+    }
+    for (k = 0; k < started; k++) joinThread(workers[k]);
+    if (writing) joinThread(writer);
+    wall = seconds() - wall;
+    for (k = 0; k < st->nworkers; k++) {
+        if (k < started) {
+            st->time[1] += stats[k][0];
+            st->bytes[1] += stats[k][1];
+        }
+        free(ends[k]);
+        free(st->rings[k].items);
+        deleteEvent(&st->ready[k]);
+    }
+    deleteEvent(&st->space);
+    deleteEvent(&st->filled);
+    deleteEvent(&st->drained);
+    free(st->done.cells);
+    free(block);
+    if (report && status) {
+        fprintf(stderr, "records: %lld in %d batches, %.3f s, %.0f records/s\n",
+                st->records, (int)number, wall, st->records / wall);
+        fprintf(stderr, "reader : %10.2f MB/s (%.3f s busy)\n", st->bytes[0] / (st->time[0] * 1e6), st->time[0]);
+        fprintf(stderr, "workers: %10.2f MB/s per worker (%.3f s busy, %d workers)\n",
+                st->bytes[1] / (st->time[1] * 1e6), st->time[1], st->nworkers);
+        fprintf(stderr, "writer : %10.2f MB/s (%.3f s busy)\n", st->bytes[2] / (st->time[2] * 1e6), st->time[2]);
+    }
+    return status;
+}
+
+
+//
+//  Parses the same path n times, storing its subpaths in float and then in double
+//  precision, and prints the throughputs on stderr, so that the cost of storing them
+//  in double precision can be evaluated. The parsing is in double precision both times.
+//
+static void benchmarkPrecision(SVGoutput* err, SVGPathparser* p, char* d, int n) {
+    static const char* names[2] = { "float", "double" };
+    int precision = p->precision;
+    int i, k;
+    double t;
+    SVGpaths* plist = p->plist;
+    size_t len = strlen(d);
+    for (k = PRECISION_FLOAT; k <= PRECISION_DOUBLE; k++) {
+        p->precision = k;
+        t = seconds();
+        for (i = 0; i < n; i++) {
+            p->plist = NULL;
+            nsvg__parsePath(p, d);
+            nsvg__deletePaths(p->plist);
+        }
+        t = seconds() - t;
+        output(err, "%-6s: %10.3f us/path %10.2f MB/s\n", names[k],
+                t*1e6/n, (double)len*n/(t*1e6));
+    }
+    p->precision = precision;
+    p->plist = plist;
+}
+//
+//  Validates the path n times, then parses it n times, and prints the throughputs on
+//  stderr, so that the validation can be compared with a complete parse.
+//
+static void benchmarkValidation(SVGoutput* err, SVGPathparser* p, char* d, int n) {
+    const char* error;
+    size_t len = strlen(d);
+    long check = 0;       // keeps the results alive
+    SVGpaths* plist = p->plist;
+    double t = seconds();
+    int i;
+    for (i = 0; i < n; i++) check += validatePath(d, &error);
+    t = seconds() - t;
+    output(err, "validate: %10.3f us/path %10.2f MB/s (%ld)\n", t*1e6/n, (double)len*n/(t*1e6), check / n);
+    t = seconds();
+    for (i = 0; i < n; i++) {
+        p->plist = NULL;
+        nsvg__parsePath(p, d);
+        nsvg__deletePaths(p->plist);
+    }
+    t = seconds() - t;
+    output(err, "parse   : %10.3f us/path %10.2f MB/s\n", t*1e6/n, (double)len*n/(t*1e6));
+    p->plist = plist;
+}
+//
+//  Parses and generates the path n times as usual, then keeping the source text of
+//  the numbers, and prints the throughputs on stderr. Parser p records the lexemes.
+//
+static void benchmarkPassthrough(SVGoutput* err, SVGPathparser* p, char* d, int absolute, int n) {
+    static const char* names[2] = { "formatted", "passthrough" };
+    SVGoutput out = { NULL, NULL, 0, 0, NULL };
+    SVGpaths* plist = p->plist;
+    size_t len = strlen(d), check = 0;
+    double t;
+    int i, k;
+    for (k = 0; k < 2; k++) {
+        p->passthrough = k;
+        t = seconds();
+        for (i = 0; i < n; i++) {
+            p->plist = NULL;
+            nsvg__parsePath(p, d);
+            out.size = 0;
+            if (k) generatePassthrough(&out, p->plist, absolute);
+            else generateSVG(&out, p->plist, absolute);
+            check += out.size;
+            nsvg__deletePaths(p->plist);
+        }
+        t = seconds() - t;
+        output(err, "%-11s: %10.3f us/path %10.2f MB/s (%u)\n", names[k],
+                t*1e6/n, (double)len*n/(t*1e6), (unsigned)(check & 0xff));
+    }
+    free(out.buffer);
+    p->plist = plist;
+}
+//
+//  Compresses n times the text generated for the subpaths of plist, at some levels
+//  and at the level given, and prints the throughput and the ratio of each on stderr.
+//
+static void benchmarkCompression(SVGoutput* err, SVGpaths* plist, int absolute, int level, int n) {
+    int levels[6] = { 0, 1, 3, 6, 9, -1 };
+    SVGoutput out = { NULL, NULL, 0, 0, NULL };
+    SVGgzip* z;
+    size_t compressed = 0;
+    double t;
+    int i, k;
+    levels[5] = level;
+    generateSVG(&out, plist, absolute);
+    for (k = 0; k < 6; k++) {
+        if (k == 5 && (level == 0 || level == 1 || level == 3 || level == 6 || level == 9)) break;
+        if ((z = createGzip(levels[k])) == NULL) break;
+        t = seconds();
+        for (i = 0; i < n; i++) {
+            resetGzip(z);
+            z->size = 0;
+            compressText(z, out.buffer, out.size, GZIP_FINISH);
+            compressed = z->size;
+        }
+        t = seconds() - t;
+        output(err, "deflate level %d: %10.2f MB/s, %lu -> %lu bytes (%.1f%%)\n", z->level,
+                (double)out.size*n/(t*1e6), (unsigned long)out.size, (unsigned long)compressed,
+                100.0 * compressed / (out.size ? out.size : 1));
+        deleteGzip(z);
+    }
+    free(out.buffer);
+}
+//
+//  Generates the path n times for matrices differing by their translation, then by
+//  their rotation, parsing it each time and with a cache, and prints the time of each
+//  update on stderr. The matrix of parser p is the initial matrix.
+//
+static void benchmarkCache(SVGoutput* err, SVGPathparser* p, char* d, int absolute, int n) {
+    static const char* names[2] = { "translation", "rotation" };
+    SVGPathparser* q = nsvg__createParser();
+    SVGpathCache* c = createPathCache(d, absolute);
+    SVGoutput out = { NULL, NULL, 0, 0, NULL };
+    double m[6], angle = p->angle, t;
+    size_t check = 0;     // keeps the results alive
+    int i, k, cached, same;
+    if (q == NULL) return;
+    q->precision = PRECISION_DOUBLE;
+    updatePathCache(c, p->matrix, p->angle);
+    for (k = 0; k < 2; k++) {
+        for (cached = 0; cached < 2; cached++) {
+            t = seconds();
+            for (i = 0; i < n; i++) {
+                if (k == 0) {
+                    copyMatrix(m, p->matrix);
+                    m[4] += i;
+                } else {
+                    setRotationInMatrix(m, (double)i * NSVG_PI / 180.0);
+                    matrixMultiply(m, p->matrix);
+                    angle = p->angle + i;
+                }
+                if (cached) {
+                    updatePathCache(c, m, angle);
+                    check += c->tail.size + strlen(c->head);
+                    continue;
+                }
+                copyMatrix(q->matrix, m);
+                q->angle = angle;
+                q->plist = NULL;
+                nsvg__parsePath(q, d);
+                out.size = 0;
+                generateSVG(&out, q->plist, absolute);
+                check += out.size;
+                nsvg__deletePaths(q->plist);
+            }
+            t = seconds() - t;
+            output(err, "%-6s %-11s : %10.3f us/update\n", cached ? "cached" : "parsed", names[k], t*1e6/n);
+        }
+    }
+    // the cached path should be the one generated by parsing it, also for translations
+    // off the grid of the rounding, which change the rounding of the coordinates
+    copyMatrix(m, p->matrix);
+    angle = p->angle;
+    for (same = 1, i = 0; i < 8; i++) {
+        m[4] += (i & 1) ? 0.0002 * i : 0.5;
+        m[5] -= (i & 2) ? 0.0005 : 0.0;
+        updatePathCache(c, m, angle);
+        copyMatrix(q->matrix, m);
+        q->angle = angle;
+        q->plist = NULL;
+        nsvg__parsePath(q, d);
+        out.size = 0;
+        generateSVG(&out, q->plist, absolute);
+        nsvg__deletePaths(q->plist);
+        check = out.size;
+        generateCached(&out, c);
+        if (out.size != 2*check || memcmp(out.buffer, out.buffer + check, check) != 0) same = 0;
+    }
+    output(err, "cached path        : %s\n", same ? "identical" : "different");
+    free(out.buffer);
+    deletePathCache(c);
+    free(q->elements);
+    free(q->matrix);
+    free(q);
+}
+
+
+//  Reads the whole stream f in a string allocated with malloc, for paths too long
+//  to be passed as arguments. Returns NULL on allocation error.
+static char* readStream(FILE* f) {
+    size_t size = 0, capacity = 1 << 16, n;
+    char* s = (char*)malloc(capacity);
+    char* t;
+    if (s == NULL) return NULL;
+    while ((n = fread(s + size, 1, capacity - size - 1, f)) > 0) {
+        size += n;
+        if (capacity - size - 1 == 0) {
+            t = (char*)realloc(s, capacity <<= 1);
+            if (t == NULL) { free(s); return NULL; }
+            s = t;
+        }
+    }
+    s[size] = '\0';
+    return s;
+}
+
+//  Reads at most n numbers separated by spaces or commas from s into v.
+//  Returns the number of numbers read.
+static int parseNumbers(char* s, double* v, int n) {
+    char item[ITEM_SIZE];
+    int k;
+    for (k = 0; k < n; k++) {
+        while (*s && (space(*s) || *s == ',')) s++;
+        s = parseNumber(s, item, ITEM_SIZE);
+        if (!*item) break;
+        v[k] = str2f(item);
+    }
+    return k;
+}
+
+// pointInPath and nearestPoint scanning all the segments, for the benchmark of the index
+static int pointInPathLinear(SVGspatialIndex* index, double px, double py, int rule) {
+    double ts[4], x, y;
+    int dirs[4], winding = 0, crossings = 0, k, n, c;
+    for (k = 0; k < index->nitems; k++) {
+        n = segmentCrossings(&index->items[k].segment, 1, py, ts, dirs);
+        for (c = 0; c < n; c++) {
+            segmentPoint(&index->items[k].segment, ts[c], &x, &y);
+            if (x > px) { winding += dirs[c]; crossings++; }
+        }
+    }
+    return (rule == FILL_EVENODD) ? (crossings & 1) : (winding != 0);
+}
+
+static double nearestDistanceLinear(SVGspatialIndex* index, double px, double py) {
+    double d, t, best = DBL_MAX;
+    int k;
+    for (k = 0; k < index->nitems; k++)
+        if (!index->items[k].closing && (d = segmentNearest(&index->items[k].segment, px, py, &t)) < best)
+            best = d;
+    return sqrt(best);
+}
+
+//
+//  Builds the spatial index of the path and measures point in path and nearest point
+//  queries at n pseudo random points of its bounds, with the index and by scanning all
+//  the segments. Prints the results on stderr.
+//
+static void benchmarkSpatial(SVGoutput* err, SVGpaths* plist, int n) {
+    SVGspatialIndex* index;
+    double t, tl, x, y, d, *b, *px, *py;
+    int i, hits = 0, hitsl = 0;
+    unsigned int seed = 12345;
+    t = seconds();
+    index = spatialIndex(plist);
+    t = seconds() - t;
+    if (index == NULL || index->nitems == 0) { deleteSpatialIndex(index); return; }
+    output(err, "index build   : %10.3f us for %d segments\n", t*1e6, index->nitems);
+    b = index->nodes[0].bounds;
+    px = (double*)malloc(n*sizeof(double));
+    py = (double*)malloc(n*sizeof(double));
+    if (!px || !py) { free(px); free(py); deleteSpatialIndex(index); return; }
+    for (i = 0; i < n; i++) {
+        seed = seed*1103515245u + 12345u;
+        px[i] = b[0] + (b[2] - b[0]) * ((seed >> 8) & 0xffff) / 65535.0;
+        seed = seed*1103515245u + 12345u;
+        py[i] = b[1] + (b[3] - b[1]) * ((seed >> 8) & 0xffff) / 65535.0;
+    }
+    t = seconds();
+    for (i = 0; i < n; i++) hits += pointInPath(index, px[i], py[i], FILL_NONZERO);
+    t = seconds() - t;
+    tl = seconds();
+    for (i = 0; i < n; i++) hitsl += pointInPathLinear(index, px[i], py[i], FILL_NONZERO);
+    tl = seconds() - tl;
+    output(err, "point in path : %10.3f us indexed %10.3f us linear (%d/%d inside)\n",
+            t*1e6/n, tl*1e6/n, hits, hitsl);
+    t = seconds();
+    for (i = 0; i < n; i++) nearestPoint(index, px[i], py[i], &x, &y, &d);
+    t = seconds() - t;
+    tl = seconds();
+    for (i = 0; i < n; i++) nearestDistanceLinear(index, px[i], py[i]);
+    tl = seconds() - tl;
+    output(err, "nearest point : %10.3f us indexed %10.3f us linear\n", t*1e6/n, tl*1e6/n);
+    free(px);
+    free(py);
+    deleteSpatialIndex(index);
+}
+
+//  Fill color and fill rule given in the path attributes pars (-p), if any. Only
+//  hexadecimal colors are recognized, others are taken as black.
+static void fillAttributes(char* pars, unsigned char* color, int* rule) {
+    char* s;
+    unsigned int c = 0;
+    int n = 0;
+    color[0] = color[1] = color[2] = 0; color[3] = 255;
+    *rule = FILL_NONZERO;
+    if (pars == NULL) return;
+    if (strstr(pars, "fill-rule=\"evenodd\"") != NULL) *rule = FILL_EVENODD;
+    if ((s = strstr(pars, "fill=\"#")) == NULL) return;
+    s += 7;
+    while (n < 6 && (digit(*s) || ((*s | 0x20) >= 'a' && (*s | 0x20) <= 'f'))) {
+        c = (c << 4) | (unsigned int)(digit(*s) ? *s - '0' : (*s | 0x20) - 'a' + 10);
+        s++; n++;
+    }
+    if (n == 3) c = ((c & 0xf00) << 12) | ((c & 0xf00) << 8) | ((c & 0xf0) << 8)
+                  | ((c & 0xf0) << 4) | ((c & 0xf) << 4) | (c & 0xf);
+    else if (n != 6) return;
+    color[0] = (unsigned char)(c >> 16);
+    color[1] = (unsigned char)(c >> 8);
+    color[2] = (unsigned char)c;
+}
+
+//  Stroke of the path attributes pars (-p) in style, the width, join, cap and miter
+//  limit having the SVG defaults when they are not given. Returns the attributes of
+//  the filled outline, allocated, where the stroke color and opacity become the fill
+//  ones and the other stroke and fill attributes are dropped, or NULL if none is left.
+static char* strokeAttributes(char* pars, SVGstrokeStyle* style) {
+    char *s, *r, *name, *value, quote;
+    size_t n, size = 0;
+    style->width = 1.0;
+    style->join = JOIN_MITER;
+    style->cap = CAP_BUTT;
+    style->miterLimit = 4.0;
+    if (pars == NULL) return NULL;
+    if ((s = strstr(pars, "stroke-width=\"")) != NULL) parseNumbers(s + 14, &style->width, 1);
+    if ((s = strstr(pars, "stroke-miterlimit=\"")) != NULL) parseNumbers(s + 19, &style->miterLimit, 1);
+    if (strstr(pars, "stroke-linejoin=\"round\"")) style->join = JOIN_ROUND;
+    if (strstr(pars, "stroke-linejoin=\"bevel\"")) style->join = JOIN_BEVEL;
+    if (strstr(pars, "stroke-linecap=\"round\"")) style->cap = CAP_ROUND;
+    if (strstr(pars, "stroke-linecap=\"square\"")) style->cap = CAP_SQUARE;
+    if (style->miterLimit < 1.0) style->miterLimit = 1.0;
+    if ((r = (char*)malloc(strlen(pars) + 16)) == NULL) return NULL;
+    for (s = pars; *s; ) {
+        while (*s && space(*s)) s++;
+        if (!*s) break;
+        for (name = s; *s && *s != '=' && !space(*s); s++);
+        n = s - name;
+        if (*s != '=' || (s[1] != '"' && s[1] != '\'')) {
+            // not an attribute with a quoted value: kept as it is
+            size += sprintf(r + size, "%s%s", size ? " " : "", name);
+            break;
+        }
+        quote = s[1];
+        for (value = s += 2; *s && *s != quote; s++);
+        if (*s) s++;
+        if (n == 6 && strncmp(name, "stroke", 6) == 0)
+            size += sprintf(r + size, "%sfill=%.*s", size ? " " : "", (int)(s - value + 1), value - 1);
+        else if (n == 14 && strncmp(name, "stroke-opacity", 14) == 0)
+            size += sprintf(r + size, "%sfill-opacity=%.*s", size ? " " : "", (int)(s - value + 1), value - 1);
+        else if (strncmp(name, "stroke", 6) != 0 && strncmp(name, "fill", 4) != 0)
+            size += sprintf(r + size, "%s%.*s", size ? " " : "", (int)(s - name), name);
+    }
+    if (size == 0) { free(r); return NULL; }
+    return r;
+}
+
+//
+//  Reorders the subpaths of plist, drawing open ones backwards if reversible, and
+//  reports to err the length of the moves and the size of the generated path before
+//  and after, with the machine time saved at this speed of the moves against the
+//  time of the optimization.
+//
+static int reorderAndReport(SVGoutput* err, SVGpaths* plist, int absolute, double speed, int reversible) {
+    SVGoutput out = { NULL, NULL, 0, 0, NULL };
+    double lengths[3], time;
+    size_t size;
+    generateSVG(&out, plist, absolute);
+    size = out.size;
+    time = seconds();
+    if (!reorderPaths(plist, reversible, lengths)) {
+        free(out.buffer);
+        return 0;
+    }
+    time = seconds() - time;
+    out.size = 0;
+    generateSVG(&out, plist, absolute);
+    output(err, "moves: %.15g -> %.15g (nearest neighbour: %.15g)\n",
+            trnc(lengths[0]), trnc(lengths[2]), trnc(lengths[1]));
+    output(err, "path: %d -> %d bytes\n", (int)size, (int)out.size);
+    output(err, "machine time saved: %.3f s at %.15g units/s, optimization: %.3f ms\n",
+            (lengths[0] - lengths[2]) / speed, speed, time*1e3);
+    free(out.buffer);
+    return 1;
+}
+
+// options of the printing of the tiles by printTile
+typedef struct SVGtilePrinter {
+    SVGoutput* out;
+    int absolute;
+    char* pars;
+    char* end;
+    int grid;               // flag to indicate the tiles are those of a grid
+} SVGtilePrinter;
+
+// prints a tile of a grid as a path, with its column and row in attribute data-tile
+static void printTile(void* data, int column, int row, SVGpaths* plist) {
+    SVGtilePrinter* t = (SVGtilePrinter*)data;
+    output(t->out, "<path ");
+    if (t->grid) output(t->out, "data-tile=\"%d,%d\" ", column, row);
+    if (t->pars) output(t->out, "%s ", t->pars);
+    output(t->out, "d=\"");
+    generateSVG(t->out, plist, t->absolute);
+    output(t->out, "%s\"/>\n", t->end ? t->end : "");
+}
+
+static void countTile(void* data, int column, int row, SVGpaths* plist) {
+    *(size_t*)data += (size_t)plist->npaths + column + row;
+}
+
+//
+//  Clips the path to the tiles of grid g n times, in one pass, then tile by tile, and
+//  prints the time per grid and the throughputs in tiles per second on stderr.
+//
+static void benchmarkTiles(SVGoutput* err, SVGpaths* plist, SVGgrid* g, int n) {
+    SVGgrid grid = *g;
+    SVGpaths* clipped = createPaths();
+    size_t check = 0;     // keeps the results alive
+    double r[4], t;
+    int i, tiles = 0, c, k;
+    if (clipped == NULL) return;
+    grid.tile = countTile;
+    grid.data = &check;
+    t = seconds();
+    for (i = 0; i < n; i++) clipTiles(plist, &grid);
+    t = seconds() - t;
+    output(err, "one pass     : %d tiles, %10.3f ms/grid %12.0f tiles/s\n",
+            grid.tiles, t*1e3/n, (double)grid.columns*grid.rows*n/t);
+    t = seconds();
+    for (i = 0; i < n; i++)
+        for (c = 0, tiles = 0; c < grid.columns; c++)
+            for (k = 0; k < grid.rows; k++) {
+                r[0] = grid.x + c*grid.width;  r[2] = r[0] + grid.width;
+                r[1] = grid.y + k*grid.height; r[3] = r[1] + grid.height;
+                clearPaths(clipped);
+                clipRect(plist, r, clipped);
+                if (clipped->npaths) tiles++;
+                check += clipped->npaths;
+            }
+    t = seconds() - t;
+    output(err, "tile by tile : %d tiles, %10.3f ms/grid %12.0f tiles/s (%u)\n",
+            tiles, t*1e3/n, (double)grid.columns*grid.rows*n/t, (unsigned)(check & 0xff));
+    nsvg__deletePaths(clipped);
+}
+
+//
+//  Normalizes the path to cubic curves n times and prints the time per path and the
+//  throughput in segments per second on stderr.
+//
+static void benchmarkCubics(SVGoutput* err, SVGpaths* plist, int n) {
+    SVGcubics c;
+    double time;
+    int i;
+    memset(&c, 0, sizeof(SVGcubics));
+    time = seconds();
+    for (i = 0; i < n; i++) normalizeCubics(plist, &c);
+    time = seconds() - time;
+    output(err, "normalization: %10.3f us/path %10.0f segments/s (%d segments)\n",
+            time*1e6/n, c.nsegments*n/time, c.nsegments);
+    freeCubics(&c);
+}
+
+//
+//  Tessellates the path n times and prints the time per mesh and the throughput in
+//  triangles per second on stderr.
+//
+static void benchmarkTessellation(SVGoutput* err, SVGpaths* plist, double tol, int rule, int n) {
+    SVGmesh mesh;
+    double time;
+    int i, triangles = 0;
+    time = seconds();
+    for (i = 0; i < n; i++) {
+        memset(&mesh, 0, sizeof(SVGmesh));
+        tessellatePaths(plist, tol, rule, &mesh);
+        triangles = mesh.nindices / 3;
+        freeMesh(&mesh);
+    }
+    time = seconds() - time;
+    output(err, "tessellation: %10.3f ms/mesh %10.0f triangles/s (%d triangles)\n",
+            time*1e3/n, triangles*n/time, triangles);
+}
+
+//
+//  Renders the path n times with one thread and with nthreads threads and prints
+//  the time per image on stderr.
+//
+static void benchmarkRaster(SVGoutput* err, SVGraster* r, SVGpaths* plist, double* t, int rule,
+                            unsigned char* color, int nthreads, int n) {
+    double time;
+    int i, k, threads[2];
+    threads[0] = 1;
+    threads[1] = nthreads;
+    for (k = 0; k < 2; k++) {
+        time = seconds();
+        for (i = 0; i < n; i++) rasterizePaths(r, plist, t, rule, color, threads[k]);
+        time = seconds() - time;
+        output(err, "%dx%d %2d thread(s): %10.3f ms/image\n", r->width, r->height, threads[k], time*1e3/n);
+    }
+}
+
+//
+//  Simplifies the path parsed by p n times within tolerance, and compares the size of
+//  the generated path and the time to render it in a 256x256 image before and after
+//  simplification, printing the results on stderr.
+//
+static void benchmarkSimplify(SVGoutput* err, SVGPathparser* p, char* d, double tolerance, int n) {
+    SVGpaths* plist = p->plist;
+    SVGoutput out = { NULL, NULL, 0, 0, NULL };
+    SVGraster raster;
+    unsigned char color[4] = { 0, 0, 0, 255 };
+    double time, t[6], error;
+    size_t size[2];
+    int i, k, before, after;
+    raster.width = raster.height = 256;
+    raster.channels = 1;
+    raster.pixels = (unsigned char*)malloc(256*256);
+    if (raster.pixels == NULL) return;
+    fitMatrix(plist, raster.width, raster.height, t);
+    time = seconds();
+    for (i = 0; i < n; i++) {
+        p->plist = NULL;
+        nsvg__parsePath(p, d);
+        simplifyPaths(p->plist, tolerance, &error, &before, &after);
+        nsvg__deletePaths(p->plist);
+    }
+    time = seconds() - time;
+    output(err, "parse and simplify: %10.3f us/path\n", time*1e6/n);
+    for (k = 0; k < 2; k++) {
+        p->plist = NULL;
+        nsvg__parsePath(p, d);
+        if (k) simplifyPaths(p->plist, tolerance, &error, &before, &after);
+        out.size = 0;
+        generateSVG(&out, p->plist, 1);
+        size[k] = out.size;
+        time = seconds();
+        for (i = 0; i < n; i++) rasterizePaths(&raster, p->plist, t, FILL_NONZERO, color, 1);
+        time = seconds() - time;
+        output(err, "%-10s: %8d segments %10d bytes %10.3f ms/image\n", k ? "simplified" : "original",
+                k ? after : before, (int)size[k], time*1e3/n);
+        nsvg__deletePaths(p->plist);
+    }
+    free(out.buffer);
+    free(raster.pixels);
+    p->plist = plist;
+}
+
+//
+//  Strokes the subpaths of plist n times with style, and prints on stderr the time of
+//  the stroking, the size of the outline, and the time of rendering the outline in a
+//  256 x 256 image against stroking and rendering each time.
+//
+static void benchmarkStroke(SVGoutput* err, SVGpaths* plist, SVGstrokeStyle* style, int n) {
+    SVGpaths* outline = createPaths();
+    SVGoutput out = { NULL, NULL, 0, 0, NULL };
+    SVGsegmentIterator it;
+    SVGsegment s;
+    SVGpath* p;
+    SVGraster raster;
+    unsigned char color[4] = { 0, 0, 0, 255 };
+    double time, t[6];
+    int i, segments = 0;
+    raster.width = raster.height = 256;
+    raster.channels = 1;
+    raster.pixels = (unsigned char*)malloc(256*256);
+    if (outline == NULL || raster.pixels == NULL) return;
+    for (p = firstPath(plist); p != endPath(plist); p++)
+        for (beginSegments(&it, p); nextSegment(&it, &s); segments++);
+    time = seconds();
+    for (i = 0; i < n; i++) {
+        clearPaths(outline);
+        strokePaths(plist, style, outline);
+    }
+    time = seconds() - time;
+    generateSVG(&out, outline, 1);
+    output(err, "stroke: %10.3f us/path, %10.0f segments/s, %d segments -> %d contours, %d bytes\n",
+            time*1e6/n, segments*n/time, segments, outline->npaths, (int)out.size);
+    fitMatrix(outline, raster.width, raster.height, t);
+    time = seconds();
+    for (i = 0; i < n; i++) rasterizePaths(&raster, outline, t, FILL_NONZERO, color, 1);
+    time = seconds() - time;
+    output(err, "render outline       : %10.3f ms/image\n", time*1e3/n);
+    time = seconds();
+    for (i = 0; i < n; i++) {
+        clearPaths(outline);
+        strokePaths(plist, style, outline);
+        rasterizePaths(&raster, outline, t, FILL_NONZERO, color, 1);
+    }
+    time = seconds() - time;
+    output(err, "stroke and render    : %10.3f ms/image\n", time*1e3/n);
+    free(out.buffer);
+    free(raster.pixels);
+    nsvg__deletePaths(outline);
+}
+
+//
+//  Queries n points spread along the whole path, with the arc length indexes and by
+//  integrating the segments on each query, and prints the throughputs on stderr.
+//
+static void benchmarkLengths(SVGoutput* err, SVGpaths* plist, int n) {
+    SVGpath* p;
+    double total = 0.0, t, x, y, tx, ty, check = 0.0;
+    int i;
+    t = seconds();
+    for (p = firstPath(plist); p != endPath(plist); p++) total += pathLength(p);
+    t = seconds() - t;
+    output(err, "index build: %10.3f us for length %g\n", t*1e6, total);
+    t = seconds();
+    for (i = 0; i < n; i++) {
+        pointAtLength(plist, total*i/n, &x, &y, &tx, &ty);
+        check += x;
+    }
+    t = seconds() - t;
+    output(err, "indexed    : %10.0f queries/s\n", n/t);
+    t = seconds();
+    for (i = 0; i < n; i++) {
+        pointAtLengthNaive(plist, total*i/n, &x, &y, &tx, &ty);
+        check -= x;
+    }
+    t = seconds() - t;
+    output(err, "naive      : %10.0f queries/s (difference %g)\n", n/t, check);
+}
+
+//  Measures the metrics of the subpaths, and their area and centroid from the contours
+//  flattened within 0.01, as computed by tools which flatten paths first.
+static void benchmarkMetrics(SVGoutput* err, SVGpaths* plist, int n) {
+    SVGpolyline poly;
+    SVGmetrics m;
+    double t, identity[6], area = 0.0, moments[2] = { 0.0, 0.0 }, cross, *q;
+    int i, k, j;
+    identityMatrix(identity);
+    t = seconds();
+    for (i = 0; i < n; i++) pathsMetrics(plist, &m, NULL);
+    t = seconds() - t;
+    output(err, "metrics   : %10.3f us/path\n", t*1e6/n);
+    t = seconds();
+    for (i = 0; i < n; i++) {
+        memset(&poly, 0, sizeof(SVGpolyline));
+        if (!flattenPaths(plist, identity, 0.01, &poly)) break;
+        area = moments[0] = moments[1] = 0.0;
+        for (k = 0; k < poly.ncontours; k++)
+            for (j = poly.contours[k]; j < poly.contours[k+1]; j++) {
+                q = poly.points + 2*j;
+                // the next point, the first one closing the contour
+                cross = (j + 1 < poly.contours[k+1]) ? q[0]*q[3] - q[2]*q[1] :
+                        q[0]*poly.points[2*poly.contours[k]+1] - poly.points[2*poly.contours[k]]*q[1];
+                area += cross;
+                moments[0] += cross*(q[0] + ((j + 1 < poly.contours[k+1]) ? q[2] : poly.points[2*poly.contours[k]]));
+                moments[1] += cross*(q[1] + ((j + 1 < poly.contours[k+1]) ? q[3] : poly.points[2*poly.contours[k]+1]));
+            }
+        freePolyline(&poly);
+    }
+    t = seconds() - t;
+    area *= 0.5;
+    output(err, "flattened : %10.3f us/path, area %.15g (error %.3g), centroid %.15g,%.15g\n", t*1e6/n,
+            area, fabs(area - m.area), moments[0]/(6*area), moments[1]/(6*area));
+}
+
+//  Measures the blending of the frames of the morph from path a to path b, and the
+//  frames when both paths are parsed and paired for each frame.
+static void benchmarkMorph(SVGoutput* err, SVGPathparser* p, char* a, char* b, int n) {
+    SVGcubics keyframes[2];
+    SVGmorph m;
+    double t;
+    int i, k;
+    memset(keyframes, 0, sizeof(keyframes));
+    memset(&m, 0, sizeof(SVGmorph));
+    t = seconds();
+    for (i = 0; i < n; i++) {
+        for (k = 0; k < 2; k++) {
+            clearPaths(p->plist);
+            nsvg__parsePath(p, k ? b : a);
+            if (!normalizeCubics(p->plist, keyframes + k)) goto done;
+        }
+        freeMorph(&m);
+        if (!createMorph(&m, keyframes, keyframes + 1)) goto done;
+        morphFrame(&m, (double)i/n);
+    }
+    t = seconds() - t;
+    output(err, "parsed per frame: %10.3f us/frame\n", t*1e6/n);
+    t = seconds();
+    for (i = 0; i < n; i++) morphFrame(&m, (double)i/n);
+    t = seconds() - t;
+    output(err, "blended         : %10.3f us/frame, %d floats\n", t*1e6/n,
+            2*m.frame.nsubpaths + 6*m.frame.nsegments);
+done:
+    freeMorph(&m);
+    freeCubics(keyframes);
+    freeCubics(keyframes + 1);
+}
+
+//  Runs the command given by the arguments argv[1..argc-1], as the command line of the
+//  program, with parser p, writing to out what goes to the standard output. Returns the
+//  exit status. A path given as "-" is read from stdin only if out writes to a file,
+//  and the streams of -c and -h are only written to files.
+static int runCommand(SVGPathparser* p, int argc, char *argv[], SVGoutput* out, SVGoutput* err) {
+    char c, c1, c2;
+    char* d = NULL;
+    char* input = NULL;   // path read from stdin, if any
+    char* n;
+    char item[ITEM_SIZE];
+    char *pars = NULL;
+    char *styled = NULL;  // attributes of the outline of the stroke, allocated
+    char *end = NULL;
+    double t[] = { 1.0, 0.0, 0.0, 1.0, 0.0, 0.0 };
+    int absolute = 1; // generate absolute code by default
+    int angle = 0;    // flag to indicate an angle was given
+    int matrix = 0;   // flag to indicate a matrix was given
+    double a, ang = 0.0;
+    int bench = 0;    // number of iterations of the benchmark, if any
+    double length = -1.0; // length where the point and the tangent are queried, if any
+    double x, y, tx, ty;
+    double inside[2], nearest[2], rect[4]; // points and rectangle of the spatial queries
+    int ninside = 0, nnearest = 0, nrect = 0;
+    SVGspatialIndex* index;
+    char* image = NULL;   // file of the thumbnail to be rendered, if any
+    double size[2] = { 256, 256 };
+    int nthreads = 0;     // number of threads of the rasterizer, 0 for the number of processors
+    char* dedup = NULL;   // prefix of the ids of repeated subpaths, if they are deduplicated
+    int stream = 0;       // flag to indicate records are converted from stdin
+    double tolerance = 0.0; // tolerance of the simplification, if any
+    char* meshFile = NULL;  // file of the triangle mesh of the fill, if any
+    double meshTolerance = 0.25;
+    SVGmesh mesh;
+    char* language = NULL;  // language of the code generated instead of the SVG path, if any
+    char* name = "path";    // name of the path in the generated code
+    int cubics = 0;         // flag to indicate the path is generated with cubic curves only
+    int validate = 0;       // flag to indicate the path is only validated
+    int passthrough = 0;    // flag to indicate the source text of unchanged numbers is kept
+    double tiles[6] = { 0.0, 0.0, 0.0, 0.0, 1.0, 1.0 }; // rectangle of the first tile, columns and rows
+    int ntiles = 0;
+    SVGgrid grid;
+    SVGtilePrinter printer;
+    const char* error;
+    long offset;
+    double speed = 0.0;     // speed of the moves between subpaths, if they are reordered
+    int reverse = 0;        // flag to indicate open subpaths may be drawn backwards when reordered
+    int stroke = 0;         // flag to indicate the stroke is converted to its outline
+    SVGstrokeStyle style;
+    int metrics = 0;        // flag to indicate the metrics are printed instead of the path
+    int frames = 0;         // number of frames of the morph from keyframe to the path, if any
+    char* keyframe = NULL;  // path given before the last one
+    SVGcubics source;
+    SVGmorph morph;
+    SVGmetrics total;
+    SVGmetrics* subpaths = NULL;
+    SVGpaths* outline;
+    char* svgz = NULL;      // file of the compressed output, "-" for stdout, if any
+    double level = GZIP_LEVEL;
+    FILE* file = stdout;
+    SVGtransformStack groups; // transforms of the groups containing the path, outermost first
+    SVGcubics normalized;
+    SVGemitter emitter;
+    int before, after;
+    SVGstream st;
+    SVGraster raster;
+    unsigned char color[4];
+    int rule;
+    int i,j;
+    int status = 0;
+#ifdef DEBUG
+    printf("**start**\n");
+#endif
+    initTransforms(&groups);
+    memset(&mesh, 0, sizeof(SVGmesh));
+    memset(&normalized, 0, sizeof(SVGcubics));
+    memset(&source, 0, sizeof(SVGcubics));
+    memset(&morph, 0, sizeof(SVGmorph));
+    raster.pixels = NULL;
+    for (i = 1; i < argc; i++) {
+#ifdef DEBUG
+        printf("**argument %d\n%s\n", i, argv[i]);
+#endif
+        c1 = *argv[i];
+        if (c1 == '-') {
+            c2 = *(argv[i]+1);
+            n = argv[i]+2;
+            if (c2 == '\0') {
+                if (out->file) {                       // "-" reads the path from stdin
+                    keyframe = d;
+                    d = input = readStream(stdin);
+                }
+                continue;
+            }
+            if (c2 == '-' && strncmp(n, "stroke", 6) == 0) {
+                stroke = 1;                            // outline of the stroke, followed by the tolerance
+                style.tolerance = STROKE_TOLERANCE;
+                parseNumbers(n + 6, &style.tolerance, 1);
+                if (style.tolerance <= 0.0) style.tolerance = STROKE_TOLERANCE;
+                continue;
+            }
+            if (c2 == '-' && strncmp(n, "morph", 5) == 0) {
+                frames = atoi(n + 5);                  // number of frames from the previous path to the path
+                if (frames < 2) frames = 2;
+                continue;
+            }
+            if (c2 == '-' && strcmp(n, "reverse") == 0) {
+                reverse = 1;                           // the direction of open subpaths may change
+                continue;
+            }
+            if (c2 == '-' && strcmp(n, "metrics") == 0) {
+                metrics = 1;                           // area, centroid, winding and length
+                continue;
+            }
+            if (c2 == 'p' || c2 == 'P') {
+                pars = argv[i]+2;                      // extra attributes of the path like color stroke width, etc.
+                continue;
+            }
+            if (c2 == 'e' || c2 == 'E') {
+                end = argv[i]+2;                      // end of path data to be added to the end of a path (ex. 'z')
+                continue;
+            }
+            if (c2 == 'a' || c2 == 'A') {
+                if (angle) continue;                 // if angle already given, ignore new one
+                angle = 1;
+                n = parseNumber(n, item, ITEM_SIZE);
+                if (!*item) continue;                // angle is not anumber or not given. ignore
+                ang = str2f(item);     
+#ifdef DEBUG
+                printf("%f\n",ang);
+#endif          // if it doesn't match matrix, ignore it
+                if (matrix && (trunc(ang) != trunc(a))) continue;
+                p->angle = ang;                      // matches matrix or new angle
+                continue;
+            }
+            if (c2 == 'r' || c2 == 'R') {
+                absolute = 0;
+                continue;
+            }
+            if (c2 == 'f' || c2 == 'F') {
+                p->precision = PRECISION_FLOAT;        // forces float precision
+                continue;
+            }
+            if (c2 == 'd' || c2 == 'D') {
+                p->precision = PRECISION_DOUBLE;       // forces double precision
+                continue;
+            }
+            if (c2 == 'l' || c2 == 'L') {
+                n = parseNumber(n, item, ITEM_SIZE);
+                if (*item) length = str2f(item);       // length along the path to be queried
+                continue;
+            }
+            if (c2 == 'i' || c2 == 'I') {
+                ninside = parseNumbers(n, inside, 2);  // point to be tested inside the path
+                continue;
+            }
+            if (c2 == 'n' || c2 == 'N') {
+                nnearest = parseNumbers(n, nearest, 2); // point whose nearest point is searched
+                continue;
+            }
+            if (c2 == 'o' || c2 == 'O') {
+                nrect = parseNumbers(n, rect, 4);      // rectangle to be tested for overlap
+                continue;
+            }
+            if (c2 == 's' || c2 == 'S') {
+                image = n;                             // file name followed by width and height
+                while (*n && !space(*n)) n++;
+                if (*n) *n++ = '\0';
+                parseNumbers(n, size, 2);
+                continue;
+            }
+            if (c2 == 'u' || c2 == 'U') {
+                dedup = (*n) ? n : "s";                // prefix of the ids of repeated subpaths
+                continue;
+            }
+            if (c2 == 'x' || c2 == 'X') {
+                if (!pushTransform(&groups, n)) {      // transform list of a nested group
+                    output(out, "**Error: invalid transform list %s\n", n);
+                    status = 1;
+                    goto done;
+                }
+                continue;
+            }
+            if (c2 == 'w' || c2 == 'W') {
+                n = parseNumber(n, item, ITEM_SIZE);   // speed of the moves, in units per second
+                speed = (*item) ? str2f(item) : 0.0;
+                if (speed <= 0.0) speed = 100.0;
+                continue;
+            }
+            if (c2 == 'z' || c2 == 'Z') {
+                ntiles = parseNumbers(n, tiles, 6);    // rectangle, or first tile of a grid
+                continue;
+            }
+            if (c2 == 'h' || c2 == 'H') {
+                svgz = (*n) ? n : "-";                 // file name followed by the level
+                while (*n && !space(*n)) n++;
+                if (*n) *n++ = '\0';
+                parseNumbers(n, &level, 1);
+                continue;
+            }
+            if (c2 == 'q' || c2 == 'Q') {
+                passthrough = 1;                       // copies the numbers that do not change
+                continue;
+            }
+            if (c2 == 'y' || c2 == 'Y') {
+                validate = 1;                          // only checks the syntax of the path
+                continue;
+            }
+            if (c2 == 'k' || c2 == 'K') {
+                cubics = 1;                            // generates cubic curves only
+                continue;
+            }
+            if (c2 == 'c' || c2 == 'C') {
+                stream = 1;                            // converts a stream of records from stdin
+                continue;
+            }
+            if (c2 == 'v' || c2 == 'V') {
+                meshFile = n;                          // file name followed by the tolerance
+                while (*n && !space(*n)) n++;
+                if (*n) *n++ = '\0';
+                parseNumbers(n, &meshTolerance, 1);
+                continue;
+            }
+            if (c2 == 'g' || c2 == 'G') {
+                language = n;                          // language followed by the name of the path
+                while (*n && !space(*n)) n++;
+                if (*n) *n++ = '\0';
+                while (*n && space(*n)) n++;
+                if (*n) name = n;
+                continue;
+            }
+            if (c2 == 't' || c2 == 'T') {
+                n = parseNumber(n, item, ITEM_SIZE);
+                if (*item) tolerance = str2f(item);    // tolerance of the simplification
+                continue;
+            }
+            if (c2 == 'j' || c2 == 'J') {
+                nthreads = atoi(n);                    // number of threads
+                continue;
+            }
+            if (c2 == 'b' || c2 == 'B') {
+                bench = atoi(n);                       // number of iterations of the benchmark
+                if (bench <= 0) bench = 1000;
+                continue;
+            }
+            if (c2 == 'm' || c2 == 'M') {
+                if (matrix) continue;                 // if already given, ignore new one
+                matrix = 1;
+                for (j = 0; j < 6; j++) {
+                   while (*n && space(*n)) n++;
+                   n = parseNumber(n, item, ITEM_SIZE);
+                   if (!*item) break;                 // matrix incomplete. exit loop
+                   t[j] = str2f(item);
+                }
+                if (!*item) continue;                 // matrix incomplete. ignore
+                copyMatrix(p->matrix, t);
+                a = getRotationAngleFromMatrix(t);    // mismatch with matrix, take matrix
+                if (trunc(ang) != trunc(a)) p->angle = a;
+#ifdef DEBUG
+                printf("[%f %f %f %f %f %f]\n",t[0],t[1],t[2],t[3],t[4],t[5],t[6]);
+                printf("ang: %f - angle calculated: %f - angle stored: %f\n", ang, a, p->angle);
+#endif
+                continue;
+            }
+            continue;
+        }
+        keyframe = d;
+        d = argv[i]; // it's no a flag, thus, we assume it's the path
+    }
+    if (angle && !matrix) setRotationInMatrix(p->matrix, ang * NSVG_PI / 180.0);
+    if (groups.depth) {     // the groups are inside the matrix given with -m or -a
+        copyMatrix(t, currentTransform(&groups));
+        matrixMultiply(t, p->matrix);
+        copyMatrix(p->matrix, t);
+        p->angle = getRotationAngleFromMatrix(t);
+    }
+    if (stroke) {           // the stroke attributes give the style and become fill attributes
+        pars = styled = strokeAttributes(pars, &style);
+        passthrough = 0;
+    }
+    if (passthrough) {      // only without transformation, the numbers being exact doubles
+        identityMatrix(t);
+        if (memcmp(t, p->matrix, sizeof(t)) == 0) {
+            p->passthrough = 1;
+            p->precision = PRECISION_DOUBLE;
+        }
+    }
+#ifdef DEBUG
+    copyMatrix(t, p->matrix);
+    printf("final matrix: [%f %f %f %f %f %f]\n",t[0],t[1],t[2],t[3],t[4],t[5],t[6]);
+    printf("**parsing*\n");
+#endif
+    if ((stream || svgz) && out->file == NULL) {
+        output(out, "**Error: -c and -h are not served\n");
+        status = 1;
+        goto done;
+    }
+    if (stream && (cubics || frames)) {
+        output(out, "**Error: -k and --morph are not supported with -c\n");
+        status = 1;
+        goto done;
+    }
+    if (svgz && strcmp(svgz, "-") != 0 && (file = fopen(svgz, "wb")) == NULL) {
+        output(out, "**Error: cannot write %s\n", svgz);
+        status = 1;
+        goto done;
+    }
+    if (stream) {
+        memset(&st, 0, sizeof(SVGstream));
+        st.in = stdin;
+        st.out = file;
+        st.level = (svgz) ? (int)level : -1;
+        st.stroke = (stroke) ? &style : NULL;
+        st.metrics = metrics;
+        st.model = p;
+        st.absolute = absolute;
+        st.validate = validate;
+        st.pars = pars;
+        st.end = end;
+        st.nworkers = (nthreads > 0) ? nthreads : processors();
+        i = convertStream(&st, bench);
+        if (file != stdout) fclose(file);
+        status = i ? 0 : 1;
+        goto done;
+    }
+    if (validate) {
+        if (bench && d) benchmarkValidation(err, p, d, bench);
+        if ((offset = validatePath(d ? d : "", &error)) < 0) output(out, "valid\n");
+        else output(out, "error at %ld: %s\n", offset, error);
+        status = (offset < 0) ? 0 : 1;
+        goto done;
+    }
+    if (frames) {
+        if (keyframe == NULL || d == NULL) {
+            output(out, "**Error: --morph needs two paths\n");
+            status = 1;
+            goto done;
+        }
+        if (bench) benchmarkMorph(err, p, keyframe, d, bench);
+        clearPaths(p->plist);
+        nsvg__parsePath(p, keyframe);
+        if (!normalizeCubics(p->plist, &source)) {
+            output(out, "allocation error: normalizeCubics\n");
+            status = 1;
+            goto done;
+        }
+        clearPaths(p->plist);
+        nsvg__parsePath(p, d);
+        if (!normalizeCubics(p->plist, &normalized) || !createMorph(&morph, &source, &normalized)) {
+            output(out, "allocation error: createMorph\n");
+            status = 1;
+            goto done;
+        }
+        for (i = 0; i < frames; i++) {
+            morphFrame(&morph, (double)i/(frames - 1));
+            if (!pars) output(out, "<path d=\"");
+            else output(out, "<path %s d=\"", pars);
+            generateCubics(out, &morph.frame, absolute);
+            output(out, "%s\"/>\n", end ? end : "");
+        }
+        closeOutput(out);
+        goto done;
+    }
+    if (bench && d) benchmarkPrecision(err, p, d, bench);
+    nsvg__parsePath(p,d);
+    if (tolerance > 0.0) {
+        if (bench && d) benchmarkSimplify(err, p, d, tolerance, bench);
+        simplifyPaths(p->plist, tolerance, &x, &before, &after);
+        output(err, "segments: %d -> %d, Hausdorff distance: %.15g\n", before, after, trnc(x));
+    }
+    // drawing a subpath backwards doesn't change an outline, a stroke or an evenodd fill
+    if (stroke || (pars && (strstr(pars, "fill=\"none\"") || strstr(pars, "fill-rule=\"evenodd\"")))) reverse = 1;
+    if (speed > 0.0 && !reorderAndReport(err, p->plist, absolute, speed, reverse)) {
+        output(out, "allocation error: reorderPaths\n");
+        status = 1;
+        goto done;
+    }
+    if (stroke) {
+        if (bench) benchmarkStroke(err, p->plist, &style, bench);
+        if ((outline = createPaths()) == NULL || !strokePaths(p->plist, &style, outline)) {
+            output(out, "allocation error: strokePaths\n");
+            status = 1;
+            goto done;
+        }
+        nsvg__deletePaths(p->plist);
+        p->plist = outline;
+    }
+    if (metrics) {
+        if (bench) benchmarkMetrics(err, p->plist, bench);
+        if (p->plist->npaths && (subpaths = (SVGmetrics*)malloc(p->plist->npaths*sizeof(SVGmetrics))) == NULL) {
+            status = 1;
+            goto done;
+        }
+        pathsMetrics(p->plist, &total, subpaths);
+        for (i = 0; i < p->plist->npaths; i++) {
+            output(out, "subpath %d: ", i);
+            outputMetrics(out, subpaths + i);
+            output(out, "\n");
+        }
+        output(out, "total: ");
+        outputMetrics(out, &total);
+        output(out, "\n");
+        goto done;
+    }
+    if (length >= 0.0) {
+        if (bench) benchmarkLengths(err, p->plist, bench);
+        i = pointAtLength(p->plist, length, &x, &y, &tx, &ty);
+        if (i < 0) goto done;
+        output(out, "point: %.15g,%.15g\ntangent: %.15g,%.15g\nsegment: %d\n",
+               trnc(x), trnc(y), trnc(tx), trnc(ty), i);
+        goto done;
+    }
+    if (ninside == 2 || nnearest == 2 || nrect == 4) {
+        if (bench) benchmarkSpatial(err, p->plist, bench);
+        index = spatialIndex(p->plist);
+        if (ninside == 2)
+            output(out, "nonzero: %s\nevenodd: %s\n",
+                   pointInPath(index, inside[0], inside[1], FILL_NONZERO) ? "inside" : "outside",
+                   pointInPath(index, inside[0], inside[1], FILL_EVENODD) ? "inside" : "outside");
+        if (nnearest == 2 && (i = nearestPoint(index, nearest[0], nearest[1], &x, &y, &tx)) >= 0)
+            output(out, "nearest: %.15g,%.15g\ndistance: %.15g\nsegment: %d\n", trnc(x), trnc(y), trnc(tx), i);
+        if (nrect == 4) {
+            if (rect[0] > rect[2]) { a = rect[0]; rect[0] = rect[2]; rect[2] = a; }
+            if (rect[1] > rect[3]) { a = rect[1]; rect[1] = rect[3]; rect[3] = a; }
+            output(out, "overlap nonzero: %s\noverlap evenodd: %s\n",
+                   rectOverlap(index, rect, FILL_NONZERO) ? "yes" : "no",
+                   rectOverlap(index, rect, FILL_EVENODD) ? "yes" : "no");
+        }
+        deleteSpatialIndex(index);
+        goto done;
+    }
+    if (meshFile) {
+        fillAttributes(pars, color, &rule);
+        if (meshTolerance <= 0.0) meshTolerance = 0.25;
+        if (bench) benchmarkTessellation(err, p->plist, meshTolerance, rule, bench);
+        if (!tessellatePaths(p->plist, meshTolerance, rule, &mesh) || !writeMesh(&mesh, meshFile)) {
+            output(out, "**Error: cannot write %s\n", meshFile);
+            status = 1;
+            goto done;
+        }
+        output(out, "vertices: %d\ntriangles: %d\n", mesh.nvertices, mesh.nindices / 3);
+        goto done;
+    }
+    if (image) {
+        raster.width = (size[0] >= 1) ? (int)size[0] : 256;
+        raster.height = (size[1] >= 1) ? (int)size[1] : raster.width;
+        j = (int)strlen(image);
+        raster.channels = (j > 4 && strcmp(image + j - 4, ".ppm") == 0) ? 4 : 1;
+        raster.pixels = (unsigned char*)malloc((size_t)raster.width * raster.height * raster.channels);
+        if (raster.pixels == NULL) {
+            status = 1;
+            goto done;
+        }
+        fitMatrix(p->plist, raster.width, raster.height, t);
+        fillAttributes(pars, color, &rule);
+        if (nthreads <= 0) nthreads = processors();
+        if (bench) benchmarkRaster(err, &raster, p->plist, t, rule, color, nthreads, bench);
+        if (!rasterizePaths(&raster, p->plist, t, rule, color, nthreads) || !writeRaster(&raster, image)) {
+            output(out, "**Error: cannot write %s\n", image);
+            status = 1;
+            goto done;
+        }
+        goto done;
+    }
+#ifdef DEBUG
+    printf("**generating SVG with %s coordinates**\n", ((absolute)? "absolute" : "relative"));
+#endif
+    if (svgz) {
+        if (bench) benchmarkCompression(err, p->plist, absolute, (int)level, bench);
+        if (!compressOutput(out, file, (int)level)) {
+            output(out, "allocation error: compressOutput\n");
+            status = 1;
+            goto done;
+        }
+    }
+    if (ntiles >= 4) {
+        if (tiles[2] < 0.0) { tiles[0] += tiles[2]; tiles[2] = -tiles[2]; }
+        if (tiles[3] < 0.0) { tiles[1] += tiles[3]; tiles[3] = -tiles[3]; }
+        memset(&grid, 0, sizeof(SVGgrid));
+        grid.x = tiles[0]; grid.y = tiles[1];
+        grid.width = tiles[2]; grid.height = tiles[3];
+        grid.columns = (tiles[4] >= 1.0) ? (int)tiles[4] : 1;
+        grid.rows = (tiles[5] >= 1.0) ? (int)tiles[5] : 1;
+        printer.out = out;
+        printer.absolute = absolute;
+        printer.pars = pars;
+        printer.end = end;
+        printer.grid = (grid.columns > 1 || grid.rows > 1);
+        grid.tile = printTile;
+        grid.data = &printer;
+        if (bench) benchmarkTiles(err, p->plist, &grid, bench);
+        if (!clipTiles(p->plist, &grid)) {
+            output(out, "allocation error: clipTiles\n");
+            status = 1;
+            goto done;
+        }
+        closeOutput(out);
+        goto done;
+    }
+    if (language) {
+        if (!createEmitter(&emitter, language, name, out)) {
+            output(out, "**Error: unknown language %s\n", language);
+            status = 1;
+            goto done;
+        }
+        emitPaths(&emitter, p->plist);
+        closeOutput(out);
+        goto done;
+    }
+    if (dedup) {
+        generateDeduplicated(out, p->plist, absolute, pars, end, dedup);
+        closeOutput(out);
+        goto done;
+    }
+    if (bench && d && p->passthrough) benchmarkPassthrough(err, p, d, absolute, bench);
+    else if (bench && d && !cubics) benchmarkCache(err, p, d, absolute, bench);
+    if (bench && cubics) benchmarkCubics(err, p->plist, bench);
+    if (cubics && !normalizeCubics(p->plist, &normalized)) {
+        output(out, "allocation error: normalizeCubics\n");
+        status = 1;
+        goto done;
+    }
+    if  (!pars) output(out, "<path d=\"");
+    else  output(out, "<path %s d=\"", pars);
+    if (cubics) generateCubics(out, &normalized, absolute);
+    else if (p->passthrough) generatePassthrough(out, p->plist, absolute);
+    else generateSVG(out, p->plist,absolute);
+    if (!end) output(out, "\"/>\n");
+    else output(out, "%s\"/>\n", end);
+    closeOutput(out);
+#ifdef DEBUG
+    printf("**finished**\n");
+#endif
+
+done:
+    freeMorph(&morph);
+    freeCubics(&source);
+    free(subpaths);
+    free(styled);
+    free(input);
+    free(raster.pixels);
+    freeMesh(&mesh);
+    freeCubics(&normalized);
+    return status;
+}
+
+/* conversion server */
+
+//  With --serve the program stays up and converts the requests of its clients on a
+//  Unix domain socket, so that scripts converting many paths pay neither the start
+//  of a process nor the allocations of a parser for each of them. A request is a
+//  command line: the count of its arguments, then the arguments, each ended by '\0'.
+//  The response is a line "status size errors" followed by the size bytes the command
+//  would have written on the standard output, then the errors bytes of its reports on
+//  the standard error. A thread runs the event loop (epoll): it accepts the
+//  connections, reads the requests, and hands each one to the worker chosen by its
+//  hash, so that a request repeated meets the cache holding its response, through
+//  the single producer ring of the worker. The workers keep their
+//  parser and their cache from one request to the next, and hand the responses back
+//  through a multiple producers ring, waking the loop with an eventfd. A connection
+//  has at most one request in progress, so that its responses come back in order.
+//  With --client the program sends the arguments following it as a request, a path
+//  given as "-" being read from its stdin and the names of the files written being
+//  made absolute, and prints the response.
+
+#define SERVER_SOCKET "/tmp/SVGparser.sock" // default path of the socket
+#define SERVER_RING 64              // capacity of the rings of the workers
+#define SERVER_CACHE 1024           // responses cached per worker
+#define SERVER_CACHED (1 << 16)     // size of the largest response cached
+#define SERVER_LATENCIES (1 << 16)  // last latencies kept for the percentiles
+#define SERVER_EVENTS 64
+
+#ifdef __linux__
+
+typedef struct SVGconnection {
+    int fd;                 // -1 once closed
+    int events;             // events watched by epoll
+    int eof;                // flag to indicate the client shut down its side
+    char* in;               // bytes received, not making a complete request yet
+    size_t size, capacity;
+    struct SVGrequest* received[2]; // first and last requests waiting for the one in progress
+    struct SVGrequest* request; // request in progress, if any
+    double start;           // time the request in progress was received, -1 if not measured
+    int cached;             // flag to indicate the response being sent comes from a cache
+    char* reply;            // response being sent, if any
+    size_t length, sent;
+    struct SVGconnection* next; // in the list of the connections to be freed
+} SVGconnection;
+
+typedef struct SVGrequest {
+    SVGconnection* connection;
+    char* text;             // arguments each ended by '\0', NULL for the end of a worker
+    size_t size;
+    uint64_t hash;
+    int status;             // exit status of the command
+    int cached;             // flag to indicate the response comes from the cache
+    double start;           // time the request was received
+    SVGoutput out;          // what the command writes on the standard output
+    SVGoutput err;          // what the command writes on the standard error
+    struct SVGrequest* next; // in the backlog of a worker whose ring is full
+} SVGrequest;
+
+// response of a worker to a request already served
+typedef struct SVGcached {
+    char* request;          // NULL if the entry is empty
+    size_t size;
+    uint64_t hash;
+    int status;
+    char* response;
+    size_t length;
+} SVGcached;
+
+typedef struct SVGserver {
+    int epoll;
+    int ready;              // eventfd of the loop, written when responses are done
+    int nworkers;
+    SVGring rings[STREAM_MAX_WORKERS];
+    int wakes[STREAM_MAX_WORKERS];  // eventfds of the workers, written when requests are pushed
+    SVGrequest* backlog[STREAM_MAX_WORKERS][2]; // first and last requests waiting for a ring
+    SVGmpscRing done;
+    SVGconnection* closed;  // connections to be freed after the events being processed
+    long long requests;     // requests answered
+    long long hits;         // requests answered from the caches
+    double* latencies;      // last SERVER_LATENCIES latencies, in seconds
+} SVGserver;
+
+static volatile sig_atomic_t serverStopped = 0;
+
+static void stopServer(int signal) {
+    (void)signal;
+    serverStopped = 1;
+}
+
+THREAD_FUNCTION(serverWorker) {
+    SVGserver* sv = (SVGserver*)((void**)arg)[0];
+    int k = (int)(intptr_t)((void**)arg)[1];
+    SVGPathparser* p = nsvg__createParser();
+    SVGcached* cache = (SVGcached*)calloc(SERVER_CACHE, sizeof(SVGcached));
+    SVGcached* e;
+    SVGrequest* r;
+    char** argv = NULL;
+    char* copy;
+    size_t i;
+    uint64_t n;
+    int argc, capacity = 0, cacheable;
+    if (p == NULL || cache == NULL) exit(1);
+    for (;;) {
+        while ((r = (SVGrequest*)ringPop(&sv->rings[k])) == NULL)
+            if (read(sv->wakes[k], &n, sizeof(n)) < 0 && errno != EINTR) exit(1);
+        if (r->text == NULL) break;
+        e = cache + r->hash % SERVER_CACHE;
+        if (e->request && e->hash == r->hash && e->size == r->size && memcmp(e->request, r->text, r->size) == 0) {
+            outputText(&r->out, e->response, e->length);
+            r->status = e->status;
+            r->cached = 1;
+        } else {
+            // argv[0] stands for the name of the program, in place of the count of the arguments
+            argc = atoi(r->text) + 1;
+            if (argc > capacity) {
+                capacity = 2*argc;
+                if ((argv = (char**)realloc(argv, capacity*sizeof(char*))) == NULL) exit(1);
+            }
+            argv[0] = "a";
+            for (cacheable = 1, argc = 1, i = strlen(r->text) + 1; i < r->size; i += strlen(r->text + i) + 1) {
+                argv[argc] = r->text + i;
+                // files and benchmarks are not responses
+                if (argv[argc][0] == '-' && strchr("sSvVbB", argv[argc][1]) && argv[argc][1]) cacheable = 0;
+                argc++;
+            }
+            // the arguments may be cut in place by runCommand
+            copy = NULL;
+            if (cacheable && (copy = (char*)malloc(r->size)) != NULL) memcpy(copy, r->text, r->size);
+            clearPaths(p->plist);
+            identityMatrix(p->matrix);
+            p->angle = 0;
+            p->precision = PRECISION_AUTO;
+            p->passthrough = 0;
+            r->status = runCommand(p, argc, argv, &r->out, &r->err);
+            // the reports on the standard error are not responses either
+            if (copy && r->err.size) {
+                free(copy);
+                copy = NULL;
+            }
+            if (copy && r->out.size <= SERVER_CACHED && (e->response == NULL || e->length < r->out.size)) {
+                free(e->response);
+                e->response = (char*)malloc(r->out.size + 1);
+            }
+            if (copy && e->response && r->out.size <= SERVER_CACHED) {
+                free(e->request);
+                e->request = copy;
+                e->size = r->size;
+                e->hash = r->hash;
+                e->status = r->status;
+                memcpy(e->response, r->out.buffer ? r->out.buffer : "", r->out.size);
+                e->length = r->out.size;
+            } else free(copy);
+        }
+        while (!mpscPush(&sv->done, r)) yieldThread();
+        n = 1;
+        if (write(sv->ready, &n, sizeof(n)) < 0) exit(1);
+    }
+    for (i = 0; i < SERVER_CACHE; i++) {
+        free(cache[i].request);
+        free(cache[i].response);
+    }
+    free(cache);
+    free(argv);
+    nsvg__deletePaths(p->plist);
+    free(p->elements);
+    free(p->lexemes);
+    free(p->matrix);
+    free(p);
+    THREAD_RETURN;
+}
+
+// writes the number of requests answered and the percentiles of their latencies to out
+static void reportLatencies(SVGserver* sv, SVGoutput* out) {
+    int n = (sv->requests < SERVER_LATENCIES) ? (int)sv->requests : SERVER_LATENCIES;
+    double* sorted = (double*)malloc((n ? n : 1)*sizeof(double));
+    if (sorted == NULL) return;
+    memcpy(sorted, sv->latencies, n*sizeof(double));
+    qsort(sorted, n, sizeof(double), compareDoubles);
+    output(out, "requests: %lld (%lld from the caches)\n", sv->requests, sv->hits);
+    if (n) output(out, "latency of the last %d: p50 %.1f us, p99 %.1f us, max %.1f us\n", n,
+                  sorted[n/2]*1e6, sorted[(int)(n*0.99)]*1e6, sorted[n-1]*1e6);
+    free(sorted);
+}
+
+// watches the events of connection c that its state calls for
+static void watchConnection(SVGserver* sv, SVGconnection* c) {
+    struct epoll_event ev;
+    int events = (c->eof ? 0 : EPOLLIN) | ((c->reply && c->sent < c->length) ? EPOLLOUT : 0);
+    if (events == c->events || c->fd < 0) return;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.ptr = c;
+    epoll_ctl(sv->epoll, EPOLL_CTL_MOD, c->fd, &ev);
+    c->events = events;
+}
+
+// closes connection c, freed once its request in progress is answered
+static void closeConnection(SVGserver* sv, SVGconnection* c) {
+    if (c->fd < 0) return;
+    epoll_ctl(sv->epoll, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    c->fd = -1;
+    if (c->request) return;
+    c->next = sv->closed;
+    sv->closed = c;
+}
+
+// pushes the requests waiting for the ring of worker k, and wakes the worker
+static void flushBacklog(SVGserver* sv, int k) {
+    SVGrequest* r;
+    uint64_t one = 1;
+    int pushed = 0;
+    while ((r = sv->backlog[k][0]) != NULL && ringPush(&sv->rings[k], r)) {
+        sv->backlog[k][0] = r->next;
+        pushed = 1;
+    }
+    if (pushed && write(sv->wakes[k], &one, sizeof(one)) < 0) exit(1);
+}
+
+static void dispatchRequest(SVGserver* sv, SVGconnection* c);
+
+//  Returns the size of the request at the start of the size bytes of in: its count of
+//  arguments, then the arguments, each ended by '\0'. Returns 0 if the request is not
+//  complete yet, and -1 if the count is not a number.
+static long requestSize(const char* in, size_t size) {
+    size_t i, count;
+    char* end;
+    for (i = 0; i < size && in[i]; i++);
+    if (i == size) return 0;
+    count = strtoul(in, &end, 10);
+    if (i == 0 || *end || in[0] == '-' || in[0] == '+' || space(in[0])) return -1;
+    for (i++; count > 0 && i < size; count--) {
+        while (i < size && in[i]) i++;
+        if (i++ == size) return 0;
+    }
+    return (count > 0) ? 0 : (long)i;
+}
+
+// sends the rest of the response of connection c, and goes on with its next request
+static void sendReply(SVGserver* sv, SVGconnection* c) {
+    ssize_t n;
+    while (c->sent < c->length) {
+        n = send(c->fd, c->reply + c->sent, c->length - c->sent, MSG_NOSIGNAL);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+            watchConnection(sv, c);
+            return;
+        }
+        if (n < 0) {
+            closeConnection(sv, c);
+            return;
+        }
+        c->sent += n;
+    }
+    free(c->reply);
+    c->reply = NULL;
+    if (c->start >= 0.0) {
+        sv->latencies[sv->requests++ % SERVER_LATENCIES] = seconds() - c->start;
+        sv->hits += c->cached;
+    }
+    dispatchRequest(sv, c);
+    if (c->eof && c->request == NULL && c->reply == NULL) closeConnection(sv, c);
+    else watchConnection(sv, c);
+}
+
+// makes the response of request r, answered by a worker or by the loop, and sends it
+static void answerRequest(SVGserver* sv, SVGrequest* r) {
+    SVGconnection* c = r->connection;
+    char header[64];
+    int n = snprintf(header, sizeof(header), "%d %lu %lu\n", r->status, (unsigned long)r->out.size,
+                     (unsigned long)r->err.size);
+    c->request = NULL;
+    if (c->fd >= 0 && (c->reply = (char*)malloc(n + r->out.size + r->err.size)) != NULL) {
+        memcpy(c->reply, header, n);
+        if (r->out.size) memcpy(c->reply + n, r->out.buffer, r->out.size);
+        if (r->err.size) memcpy(c->reply + n + r->out.size, r->err.buffer, r->err.size);
+        c->length = n + r->out.size + r->err.size;
+        c->sent = 0;
+        c->cached = r->cached;
+    }
+    free(r->text);
+    free(r->out.buffer);
+    free(r->err.buffer);
+    free(r);
+    if (c->fd < 0 || c->reply == NULL) {
+        closeConnection(sv, c);
+        if (c->fd < 0 && c->next == NULL && sv->closed != c) {
+            c->next = sv->closed;
+            sv->closed = c;
+        }
+        return;
+    }
+    sendReply(sv, c);
+}
+
+//  Hands the next request received on connection c, if none is in progress, to its
+//  worker. The requests --stats and --stop are answered by the loop.
+static void dispatchRequest(SVGserver* sv, SVGconnection* c) {
+    SVGrequest* r;
+    int k;
+    if (c->request || c->reply || c->fd < 0 || (r = c->received[0]) == NULL) return;
+    c->received[0] = r->next;
+    r->next = NULL;
+    c->request = r;
+    c->start = r->start;
+    if (strcmp(r->text, "1") == 0 && (strcmp(r->text + 2, "--stats") == 0 || strcmp(r->text + 2, "--stop") == 0)) {
+        if (r->text[4] == 's' && r->text[5] == 't' && r->text[6] == 'o') {
+            output(&r->out, "stopping\n");
+            serverStopped = 1;
+        }
+        reportLatencies(sv, &r->out);
+        c->start = -1.0;
+        answerRequest(sv, r);
+        return;
+    }
+    r->hash = hashText(r->text, r->size);
+    k = (int)(r->hash % (uint64_t)sv->nworkers);
+    if (sv->backlog[k][0]) sv->backlog[k][1]->next = r;
+    else sv->backlog[k][0] = r;
+    sv->backlog[k][1] = r;
+    flushBacklog(sv, k);
+}
+
+//  Reads what connection c received, and dispatches its next request. The complete
+//  requests are taken at once, so that their latencies include their wait behind the
+//  request in progress.
+static void readRequests(SVGserver* sv, SVGconnection* c) {
+    SVGrequest* r;
+    double now;
+    ssize_t n;
+    long i;
+    char* in;
+    for (;;) {
+        if (c->size == c->capacity) {
+            if ((in = (char*)realloc(c->in, c->capacity ? 2*c->capacity : 4096)) == NULL) exit(1);
+            c->in = in;
+            c->capacity = c->capacity ? 2*c->capacity : 4096;
+        }
+        n = recv(c->fd, c->in + c->size, c->capacity - c->size, 0);
+        if (n > 0) {
+            c->size += n;
+            continue;
+        }
+        if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) c->eof = 1;
+        break;
+    }
+    for (now = seconds(); (i = requestSize(c->in, c->size)) > 0; ) {
+        if ((r = (SVGrequest*)calloc(1, sizeof(SVGrequest))) == NULL || (r->text = (char*)malloc(i)) == NULL) exit(1);
+        memcpy(r->text, c->in, i);
+        r->size = i;
+        memmove(c->in, c->in + i, c->size - i);
+        c->size -= i;
+        r->connection = c;
+        r->start = now;
+        if (c->received[0]) c->received[1]->next = r;
+        else c->received[0] = r;
+        c->received[1] = r;
+    }
+    if (i < 0) c->eof = 1;
+    dispatchRequest(sv, c);
+    if (c->eof && c->request == NULL && c->reply == NULL) closeConnection(sv, c);
+    else watchConnection(sv, c);
+}
+
+//  Serves the requests of clients on the socket path with nworkers workers, until
+//  the request --stop or a SIGINT or SIGTERM, then prints the latencies on stderr.
+static int serve(char* path, int nworkers) {
+    SVGserver sv;
+    SVGthread workers[STREAM_MAX_WORKERS];
+    void* args[STREAM_MAX_WORKERS][2];
+    SVGrequest ends[STREAM_MAX_WORKERS];
+    SVGoutput report = { NULL, NULL, 0, 0, NULL };
+    struct sockaddr_un address;
+    struct epoll_event ev, events[SERVER_EVENTS];
+    struct sigaction action;
+    struct stat info;
+    SVGconnection* c;
+    SVGrequest* r;
+    uint64_t n;
+    size_t i;
+    int listener, fd, k, count;
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        printf("**Error: socket path too long %s\n", path);
+        return 1;
+    }
+    memset(&sv, 0, sizeof(SVGserver));
+    sv.nworkers = (nworkers < 1) ? 1 : (nworkers > STREAM_MAX_WORKERS) ? STREAM_MAX_WORKERS : nworkers;
+    sv.latencies = (double*)malloc(SERVER_LATENCIES*sizeof(double));
+    sv.done.mask = STREAM_MAX_WORKERS * 2 - 1;
+    sv.done.cells = (SVGcell*)malloc((sv.done.mask + 1) * sizeof(SVGcell));
+    if (sv.latencies == NULL || sv.done.cells == NULL) return 1;
+    for (i = 0; i <= sv.done.mask; i++) sv.done.cells[i].seq = i;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+    // replaces a socket left by a server that did not stop, but no other file and not
+    // the socket of a server still answering
+    if (lstat(path, &info) == 0) {
+        if (!S_ISSOCK(info.st_mode)) {
+            printf("**Error: %s exists and is not a socket\n", path);
+            return 1;
+        }
+        if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) >= 0 && connect(fd, (struct sockaddr*)&address, sizeof(address)) == 0) {
+            close(fd);
+            printf("**Error: a server is already listening on %s\n", path);
+            return 1;
+        }
+        if (fd >= 0) close(fd);
+        unlink(path);
+    }
+    if ((listener = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 ||
+        bind(listener, (struct sockaddr*)&address, sizeof(address)) < 0 || listen(listener, SOMAXCONN) < 0) {
+        printf("**Error: cannot listen on %s\n", path);
+        return 1;
+    }
+    fcntl(listener, F_SETFL, fcntl(listener, F_GETFL) | O_NONBLOCK);
+    if ((sv.epoll = epoll_create1(0)) < 0 || (sv.ready = eventfd(0, EFD_NONBLOCK)) < 0) return 1;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;
+    epoll_ctl(sv.epoll, EPOLL_CTL_ADD, listener, &ev);
+    ev.data.ptr = &sv.ready;
+    epoll_ctl(sv.epoll, EPOLL_CTL_ADD, sv.ready, &ev);
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = stopServer;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    for (k = 0; k < sv.nworkers; k++) {
+        sv.rings[k].mask = SERVER_RING - 1;
+        sv.rings[k].items = (void**)malloc(SERVER_RING * sizeof(void*));
+        if (sv.rings[k].items == NULL || (sv.wakes[k] = eventfd(0, 0)) < 0) return 1;
+        args[k][0] = &sv;
+        args[k][1] = (void*)(intptr_t)k;
+        if (!startThread(&workers[k], serverWorker, args[k])) return 1;
+    }
+    fprintf(stderr, "serving %s with %d workers\n", path, sv.nworkers);
+    while (!serverStopped) {
+        if ((count = epoll_wait(sv.epoll, events, SERVER_EVENTS, -1)) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        for (k = 0; k < count; k++) {
+            c = (SVGconnection*)events[k].data.ptr;
+            if (c == NULL) {
+                while ((fd = accept(listener, NULL, NULL)) >= 0) {
+                    if ((c = (SVGconnection*)calloc(1, sizeof(SVGconnection))) == NULL) exit(1);
+                    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+                    c->fd = fd;
+                    c->events = EPOLLIN;
+                    ev.events = EPOLLIN;
+                    ev.data.ptr = c;
+                    epoll_ctl(sv.epoll, EPOLL_CTL_ADD, fd, &ev);
+                }
+            } else if ((void*)c == (void*)&sv.ready) {
+                if (read(sv.ready, &n, sizeof(n)) < 0 && errno != EAGAIN) exit(1);
+                while ((r = (SVGrequest*)mpscPop(&sv.done)) != NULL) answerRequest(&sv, r);
+            } else if (c->fd >= 0) {
+                if (events[k].events & EPOLLOUT) sendReply(&sv, c);
+                if (c->fd >= 0 && (events[k].events & (EPOLLIN | EPOLLHUP | EPOLLERR))) readRequests(&sv, c);
+            }
+        }
+        for (k = 0; k < sv.nworkers; k++) flushBacklog(&sv, k);
+        while ((c = sv.closed) != NULL) {
+            sv.closed = c->next;
+            while ((r = c->received[0]) != NULL) {
+                c->received[0] = r->next;
+                free(r->text);
+                free(r);
+            }
+            free(c->in);
+            free(c->reply);
+            free(c);
+        }
+    }
+    for (k = 0; k < sv.nworkers; k++) {
+        ends[k].text = NULL;
+        while (!ringPush(&sv.rings[k], &ends[k])) yieldThread();
+        n = 1;
+        if (write(sv.wakes[k], &n, sizeof(n)) < 0) return 1;
+    }
+    for (k = 0; k < sv.nworkers; k++) {
+        joinThread(workers[k]);
+        close(sv.wakes[k]);
+        free(sv.rings[k].items);
+    }
+    reportLatencies(&sv, &report);
+    if (report.buffer) fputs(report.buffer, stderr);
+    free(report.buffer);
+    free(sv.latencies);
+    free(sv.done.cells);
+    close(sv.ready);
+    close(sv.epoll);
+    close(listener);
+    unlink(path);
+    return 0;
+}
+
+//  Sends the arguments argv[0..argc-1] as a request to the server on the socket path,
+//  and writes the response on stdout and its reports on stderr. Returns the exit status
+//  of the request, or 1 if the server cannot be reached.
+static int requestServer(char* path, int argc, char* argv[]) {
+    SVGoutput request = { NULL, NULL, 0, 0, NULL };
+    struct sockaddr_un address;
+    char header[64], buffer[1 << 16], directory[4096];
+    char *s, *text;
+    unsigned long size = 0, errors = 0;
+    size_t sent;
+    ssize_t n;
+    int fd, i, status = 1;
+    outputText(&request, header, snprintf(header, sizeof(header), "%d", argc) + 1);
+    for (i = 0; i < argc; i++) {
+        // the server cannot read the stdin of the client
+        text = (strcmp(argv[i], "-") == 0) ? readStream(stdin) : argv[i];
+        s = text ? text : "";
+        // nor does it write the files in the directory of the client
+        if (s[0] == '-' && s[1] && strchr("sSvV", s[1]) && s[2] && s[2] != '/' && getcwd(directory, sizeof(directory))) {
+            outputText(&request, s, 2);
+            outputText(&request, directory, strlen(directory));
+            outputText(&request, "/", 1);
+            outputText(&request, s + 2, strlen(s + 2) + 1);
+        } else outputText(&request, s, strlen(s) + 1);
+        if (text != argv[i]) free(text);
+    }
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 || connect(fd, (struct sockaddr*)&address, sizeof(address)) < 0) {
+        printf("**Error: cannot connect to %s\n", path);
+        return 1;
+    }
+    for (sent = 0; sent < request.size; sent += n)
+        if ((n = send(fd, request.buffer + sent, request.size - sent, MSG_NOSIGNAL)) <= 0) break;
+    // the header, a byte at a time, then the response
+    for (i = 0; i < (int)sizeof(header) - 1 && recv(fd, header + i, 1, 0) == 1 && header[i] != '\n'; i++);
+    header[i] = '\0';
+    if (sent == request.size && sscanf(header, "%d %lu %lu", &status, &size, &errors) == 3) {
+        while (size > 0 && (n = recv(fd, buffer, (size < sizeof(buffer)) ? size : sizeof(buffer), 0)) > 0) {
+            fwrite(buffer, 1, n, stdout);
+            size -= n;
+        }
+        fflush(stdout);
+        while (size == 0 && errors > 0 && (n = recv(fd, buffer, (errors < sizeof(buffer)) ? errors : sizeof(buffer), 0)) > 0) {
+            fwrite(buffer, 1, n, stderr);
+            errors -= n;
+        }
+    } else printf("**Error: no response from %s\n", path);
+    close(fd);
+    free(request.buffer);
+    return (size == 0 && errors == 0) ? status : 1;
+}
+
+#else
+
+static int serve(char* path, int nworkers) {
+    printf("**Error: the server needs Linux (epoll)\n");
+    return 1;
+}
+
+static int requestServer(char* path, int argc, char* argv[]) {
+    printf("**Error: the server needs Linux (epoll)\n");
+    return 1;
+}
+
+#endif
+
+int main(int argc, char *argv[]) {
+    SVGoutput out = { NULL, NULL, 0, 0, NULL };
+    SVGoutput err = { NULL, NULL, 0, 0, NULL };
+    SVGPathparser* p;
+    int i, nworkers = 0;
+    for (i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--client", 8) == 0)     // the arguments following it are the request
+            return requestServer(argv[i][8] ? argv[i] + 8 : SERVER_SOCKET, argc - i - 1, argv + i + 1);
+        if (argv[i][0] == '-' && (argv[i][1] == 'j' || argv[i][1] == 'J')) nworkers = atoi(argv[i] + 2);
+    }
+    for (i = 1; i < argc; i++)
+        if (strncmp(argv[i], "--serve", 7) == 0)
+            return serve(argv[i][7] ? argv[i] + 7 : SERVER_SOCKET, (nworkers > 0) ? nworkers : processors());
+    if ((p = nsvg__createParser()) == NULL) return 1;
+    out.file = stdout;
+    err.file = stderr;
+    return runCommand(p, argc, argv, &out, &err);
 }
@@ -1,5 +1,5 @@
 #!/bin/bash
-gcc SVGparser.c -std=c99 -lm
+gcc SVGparser.c -std=c99 -pthread -lm
 status=$?
 if [ $status -ne 0 ]
 then 
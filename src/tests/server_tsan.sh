@@ -0,0 +1,31 @@
+#!/bin/bash
+# Builds the program with ThreadSanitizer, sends concurrent spatial queries (-i, -n, -o)
+# to a server, and checks the responses against the program called directly and that
+# ThreadSanitizer reports no race. Linux only.
+cd "$(dirname "$0")"
+dir=$(mktemp -d)
+socket=$dir/SVGparser.sock
+gcc ../SVGparser.c -std=c99 -pthread -lm -O1 -g -fsanitize=thread -o $dir/a || exit 1
+path="M0 0 C40 90 80 -30 120 60 S200 100 160 20 Q100 -40 60 10 L20 80 A30 20 15 1 0 0 0 Z M50 30 h20 v20 h-20z"
+TSAN_OPTIONS="halt_on_error=0" $dir/a --serve$socket -j4 2> $dir/server.log &
+server=$!
+until $dir/a --client$socket --stats > /dev/null 2>&1; do sleep 0.1; done
+pids=()
+for k in $(seq 40); do
+    for q in "-i$k $((k*2))" "-n$((k*3)) -$k" "-o$k $k $((k+9)) $((k+5))"; do
+        ( $dir/a --client$socket "$q" "$path" > "$dir/served$k${q:1:1}"
+          $dir/a "$q" "$path" > "$dir/direct$k${q:1:1}" ) &
+        pids+=($!)
+    done
+done
+wait "${pids[@]}"
+$dir/a --client$socket --stop > /dev/null
+wait $server
+status=0
+for f in $dir/served*; do
+    cmp -s "$f" "${f/served/direct}" || { echo "different response: ${f#$dir/}"; status=1; }
+done
+if grep -q "ThreadSanitizer" $dir/server.log; then cat $dir/server.log; status=1; fi
+[ $status = 0 ] && echo "passed"
+rm -rf $dir
+exit $status